@@ -1,15 +1,42 @@
+#include <signal.h>
+#include <unistd.h>
+
 #include <atomic>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <optional>
 #include <thread>
 
 #include "reed/adb.hpp"
+#include "reed/brightness.hpp"
+#include "reed/clock_face.hpp"
 #include "reed/config.hpp"
+#include "reed/control.hpp"
+#include "reed/daemon.hpp"
+#include "reed/derived.hpp"
 #include "reed/device.hpp"
+#include "reed/encode_bench.hpp"
+#include "reed/gpu.hpp"
+#include "reed/history.hpp"
+#include "reed/host_metrics.hpp"
+#include "reed/hwmon.hpp"
+#include "reed/io_stats.hpp"
+#include "reed/log.hpp"
 #include "reed/media.hpp"
+#include "reed/overlay.hpp"
+#include "reed/procs.hpp"
+#include "reed/session.hpp"
+#include "reed/status.hpp"
+#include "reed/sysfs.hpp"
+#include "reed/timings.hpp"
 
 namespace fs = std::filesystem;
 
@@ -21,6 +48,33 @@ static void signal_handler(int sig) {
   }
 }
 
+static int64_t unix_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Prints the phase tree (and writes the trace) on the way out of main(),
+// after the command's own phase has closed
+struct TimingsReport {
+  std::string trace_path;
+
+  ~TimingsReport() {
+    if (!reed::Timings::enabled()) {
+      return;
+    }
+    std::cerr << "\n";
+    reed::Timings::print(std::cerr);
+    if (!trace_path.empty()) {
+      if (reed::Timings::write_trace(trace_path)) {
+        std::cerr << "Trace written to " << trace_path << "\n";
+      } else {
+        std::cerr << "Failed to write " << trace_path << "\n";
+      }
+    }
+  }
+};
+
 static void print_usage(const char* prog) {
   std::cout
       << "Usage: " << prog
@@ -32,6 +86,13 @@ static void print_usage(const char* prog) {
          "  brightness <0-100>      Set display brightness\n"
          "  list                    List media files on device\n"
          "  delete <file...>        Delete media files from device\n"
+         "  shell                   Interactive command prompt (one session)\n"
+         "  batch <file|->          Run commands from a file or stdin\n"
+         "  sensors [count]         Print GPU/net/disk/fan/top-process readings\n"
+         "  history [metric] [span] Sensor history recorded by the daemon\n"
+         "  clock [day|hour]        Upload a clock face bank for the daemon\n"
+         "  overlay [out.png]       Render overlay.json with current sensors\n"
+         "  encode-bench <file...>  Compare x264 settings on sample clips\n"
          "  daemon start            Start background daemon\n"
          "  daemon stop             Stop background daemon\n"
          "  daemon status           Show daemon status\n\n"
@@ -41,15 +102,29 @@ static void print_usage(const char* prog) {
          "  -v, --verbose           Verbose output\n"
          "  --ratio <2:1|1:1>       Display ratio (default: 2:1)\n"
          "  --brightness <0-100>    Set brightness with display command\n"
+         "  --fade <ms>             Ramp brightness smoothly over <ms>\n"
+         "  --size <WxH>            Clock face/composite size (default: panel)\n"
+         "  --onto <media>          Burn the overlay into this clip (MP4)\n"
+         "  --timings               Print time spent per phase on exit\n"
+         "  --trace <file.json>     Also write the phases as a Chrome trace\n"
          "  --keepalive             Stay running with keepalive (default: exit)\n"
          "  --foreground            Run daemon in foreground\n";
 }
 
+static void report_connect_failure(const reed::Device& device) {
+  std::cerr << "Failed to connect to " << device.port();
+  if (device.port_busy()) {
+    std::cerr << ": still in use by another process after "
+              << reed::Device::LOCK_WAIT.count() << " ms";
+  }
+  std::cerr << "\n";
+}
+
 static int cmd_info(const std::string& port, bool verbose) {
   reed::Device device(port, verbose);
 
   if (!device.connect()) {
-    std::cerr << "Failed to connect to " << port << "\n";
+    report_connect_failure(device);
     return 1;
   }
 
@@ -75,11 +150,15 @@ static int cmd_info(const std::string& port, bool verbose) {
     }
     std::cout << "\n";
   }
+  if (info->pump_rpm >= 0) {
+    std::cout << "  Pump: " << info->pump_rpm << " RPM\n";
+  }
 
   return 0;
 }
 
-static int cmd_upload(const std::string& file, bool verbose) {
+static int cmd_upload(const std::string& file, const std::string& ratio,
+                      bool verbose) {
   if (verbose) std::cout << "Checking file: " << file << "\n";
 
   if (!fs::exists(file)) {
@@ -98,47 +177,50 @@ static int cmd_upload(const std::string& file, bool verbose) {
   }
 
   auto type = reed::Media::detect_type(file);
-  std::string upload_path = file;
-  std::string remote_name = reed::Media::get_filename(file);
-
   if (verbose) std::cout << "Detected type: " << static_cast<int>(type) << "\n";
 
-  if (type == reed::MediaType::Gif) {
-    if (!reed::Media::is_ffmpeg_available()) {
-      std::cerr << "ffmpeg not found. Install ffmpeg to upload GIF files.\n";
-      return 1;
-    }
-
-    std::string converted_name = reed::Media::get_converted_name(file);
-    std::string converted_path =
-        std::string(reed::Media::TMP_DIR) + converted_name;
+  if (reed::Media::is_converted(file) && !reed::Media::is_ffmpeg_available()) {
+    std::cerr << "ffmpeg not found. Install ffmpeg to upload "
+              << (type == reed::MediaType::Gif ? "GIF files" : "images")
+              << ".\n";
+    return 1;
+  }
 
-    std::cout << "Converting GIF to MP4...\n";
-    if (verbose) std::cout << "Output path: " << converted_path << "\n";
+  std::cout << "Uploading " << reed::Media::get_filename(file) << "...\n";
+  reed::UploadReport report;
+  auto remote_name = reed::Media::upload(file, ratio, &report);
+  if (!remote_name) {
+    std::cerr << "Failed to upload file\n";
+    return 1;
+  }
 
-    if (!reed::Media::convert_gif_to_mp4(file, converted_path)) {
-      std::cerr << "Failed to convert GIF to MP4\n";
-      return 1;
+  if (type == reed::MediaType::Gif) {
+    std::cout << "Converted: " << reed::Media::get_filename(file) << " -> "
+              << *remote_name;
+    if (report.cached) {
+      std::cout << " (cached)";
+    } else if (report.gif.native) {
+      std::cout << " (" << report.gif.frames << " frames, "
+                << report.gif.unique << " distinct, "
+                << report.gif.duration_ms / 1000.0 << " s)";
     }
-
-    upload_path = converted_path;
-    remote_name = converted_name;
+    std::cout << "\n";
+  } else if (type == reed::MediaType::Image) {
+    const auto& image = report.image;
+    int64_t saved = static_cast<int64_t>(image.source_bytes) -
+                    static_cast<int64_t>(image.bytes);
     std::cout << "Converted: " << reed::Media::get_filename(file) << " -> "
-              << remote_name << "\n";
+              << *remote_name << ", " << image.source_bytes / 1024
+              << " KB -> " << image.bytes / 1024 << " KB (" << saved / 1024
+              << " KB saved" << (image.cached ? ", cached" : "") << ")\n";
   }
-
-  if (verbose)
-    std::cout << "Pushing via ADB: " << upload_path << " -> " << remote_name
-              << "\n";
-
-  std::cout << "Uploading " << remote_name << "...\n";
-  if (!reed::Adb::push(upload_path, remote_name)) {
-    std::cerr << "Failed to upload file\n";
-    return 1;
+  if (verbose) {
+    std::cout << "Pushed " << report.local_path << " -> " << *remote_name
+              << (report.pushed ? "" : " (already on the device)") << "\n";
   }
 
   std::cout << "Upload complete.\n";
-  std::cout << "Display with: reed-tpse display " << remote_name << "\n";
+  std::cout << "Display with: reed-tpse display " << *remote_name << "\n";
 
   return 0;
 }
@@ -152,10 +234,10 @@ static int cmd_display(const std::string& port,
     return 1;
   }
 
-  // Convert GIF filenames to MP4
+  // Use the names files get on upload (GIF -> MP4, local image -> JPEG)
   std::vector<std::string> media_files;
   for (const auto& f : files) {
-    if (reed::Media::detect_type(f) == reed::MediaType::Gif) {
+    if (reed::Media::is_converted(f)) {
       media_files.push_back(reed::Media::get_converted_name(f));
     } else {
       media_files.push_back(f);
@@ -164,7 +246,7 @@ static int cmd_display(const std::string& port,
 
   reed::Device device(port, verbose);
   if (!device.connect()) {
-    std::cerr << "Failed to connect to " << port << "\n";
+    report_connect_failure(device);
     return 1;
   }
 
@@ -215,7 +297,8 @@ static int cmd_display(const std::string& port,
   return 0;
 }
 
-static int cmd_brightness(const std::string& port, int value, bool verbose) {
+static int cmd_brightness(const std::string& port, int value, int fade_ms,
+                          bool verbose) {
   if (value < 0 || value > 100) {
     std::cerr << "Brightness must be 0-100\n";
     return 1;
@@ -223,14 +306,32 @@ static int cmd_brightness(const std::string& port, int value, bool verbose) {
 
   reed::Device device(port, verbose);
   if (!device.connect()) {
-    std::cerr << "Failed to connect to " << port << "\n";
+    report_connect_failure(device);
     return 1;
   }
 
   device.handshake();
-  device.set_brightness(value);
 
-  std::cout << "Brightness set to " << value << "\n";
+  if (fade_ms <= 0) {
+    device.set_brightness(value);
+    std::cout << "Brightness set to " << value << "\n";
+    return 0;
+  }
+
+  // The panel can't report its brightness; assume the last saved value
+  auto state = reed::ConfigManager::load_state();
+  reed::EventLoop loop;
+  reed::BrightnessAnimator animator(loop, [&](int v, bool final) {
+    return device.set_brightness(v, final) || !final;
+  });
+  animator.set_current(state ? state->brightness : value);
+  animator.ramp_to(value, std::chrono::milliseconds(fade_ms));
+  while (animator.ramping()) {
+    loop.run_once();
+  }
+
+  std::cout << "Brightness faded to " << value << " in "
+            << animator.steps_sent() << " steps\n";
   return 0;
 }
 
@@ -276,6 +377,635 @@ static int cmd_delete(const std::vector<std::string>& files) {
   return 0;
 }
 
+// Status of the daemon if one is running. A page left behind by a crashed
+// daemon names a pid that no longer exists.
+static std::optional<reed::DaemonStatus> running_daemon() {
+  auto status =
+      reed::StatusPage::read(reed::ConfigManager::get_status_path());
+  if (!status || status->pid <= 0 ||
+      (kill(status->pid, 0) != 0 && errno == ESRCH)) {
+    return std::nullopt;
+  }
+  return status;
+}
+
+static void print_metric(const char* label, double value, const char* unit) {
+  if (!std::isnan(value)) {
+    std::cout << "  " << label << " " << value << unit;
+  }
+}
+
+static std::string format_rate(double bytes_per_sec) {
+  static const char* units[] = {"B/s", "KB/s", "MB/s", "GB/s"};
+  int unit = 0;
+  while (bytes_per_sec >= 1000 && unit < 3) {
+    bytes_per_sec /= 1000;
+    ++unit;
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.1f %s", bytes_per_sec, units[unit]);
+  return text;
+}
+
+static int cmd_sensors(const reed::Config& config, int count) {
+  // REED_SENSOR_ROOT points at a fake tree holding sys/ and proc/,
+  // REED_NVML_LIBRARY at a stub NVML
+  const char* env_root = std::getenv("REED_SENSOR_ROOT");
+  const char* nvml = std::getenv("REED_NVML_LIBRARY");
+  std::string root = env_root ? env_root : "";
+  reed::GpuMonitor gpus(root, nvml ? nvml : reed::NVML_LIBRARY);
+  reed::NetSampler net(config.net_interfaces, root);
+  reed::DiskSampler disks(config.disk_devices, root);
+  reed::FanMonitor fans(root);
+  reed::ProcessScanner procs(root + "/proc");
+  reed::SysfsFile cpu_temp;
+  std::string cpu_temp_path = reed::find_cpu_temp_input(root);
+  if (!cpu_temp_path.empty()) {
+    cpu_temp.open(cpu_temp_path);
+  }
+  if (!cpu_temp.is_open() && gpus.count() == 0 && net.count() == 0 &&
+      disks.count() == 0 && fans.count() == 0 && !running_daemon()) {
+    std::cerr << "No sensors found\n";
+    return 1;
+  }
+
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  // Rates need a baseline
+  net.sample();
+  disks.sample();
+  procs.scan(0);
+
+  std::cout << std::fixed << std::setprecision(0);
+  for (int i = 0; i < count && g_running; ++i) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    gpus.update();
+    net.sample();
+    disks.sample();
+    fans.update();
+    procs.scan(3);
+
+    if (auto millidegrees = cpu_temp.read_int()) {
+      std::cout << "cpu:  temp " << *millidegrees / 1000 << "C\n";
+    }
+    for (size_t g = 0; g < gpus.count(); ++g) {
+      const auto& s = gpus.samples()[g];
+      std::cout << gpus.name(g) << ":";
+      print_metric("busy", s.busy_percent, "%");
+      print_metric("temp", s.temperature_c, "C");
+      print_metric("clock", s.clock_mhz, " MHz");
+      if (!std::isnan(s.vram_used_mb)) {
+        std::cout << "  vram " << s.vram_used_mb;
+        if (!std::isnan(s.vram_total_mb)) {
+          std::cout << "/" << s.vram_total_mb;
+        }
+        std::cout << " MB";
+      }
+      std::cout << "\n";
+    }
+    for (size_t n = 0; n < net.count(); ++n) {
+      std::cout << net.name(n) << ":  rx "
+                << format_rate(net.rx_bytes_per_sec(n)) << "  tx "
+                << format_rate(net.tx_bytes_per_sec(n)) << "\n";
+    }
+    for (size_t d = 0; d < disks.count(); ++d) {
+      std::cout << disks.name(d) << ":  read "
+                << format_rate(disks.read_bytes_per_sec(d)) << "  write "
+                << format_rate(disks.write_bytes_per_sec(d)) << "  busy "
+                << disks.busy_percent(d) << "%\n";
+    }
+    for (size_t f = 0; f < fans.count(); ++f) {
+      if (fans.rpm(f) >= 0) {
+        std::cout << fans.name(f) << ":  " << fans.rpm(f) << " RPM\n";
+      }
+    }
+    // The daemon owns the port; it publishes the pump speed the device
+    // reports in its keepalive replies
+    auto status = running_daemon();
+    if (status && status->pump_rpm >= 0) {
+      std::cout << "device pump:  " << status->pump_rpm << " RPM\n";
+    }
+    for (const auto& p : procs.top()) {
+      std::cout << "top " << p.name << " (" << p.pid << "):  cpu "
+                << p.cpu_percent << "%  rss " << p.rss_kb / 1024 << " MB\n";
+    }
+  }
+  return 0;
+}
+
+static int cmd_history(const std::vector<std::string>& args) {
+  reed::History history;
+  if (!history.open(reed::ConfigManager::get_history_path(),
+                    reed::History::DEFAULT_CAPACITY, true)) {
+    std::cerr << "No sensor history yet (the daemon records it)\n";
+    return 1;
+  }
+  int64_t now = unix_ms() / 1000;
+
+  if (args.empty()) {
+    std::cout << "Last 5 minutes (min / avg / max):\n";
+    for (size_t m = 0; m < history.count(); ++m) {
+      auto s = history.summarize(static_cast<int>(m), 0, 300, now);
+      if (s.count == 0) continue;
+      std::cout << "  " << history.name(m) << ": " << s.min << " / " << s.avg
+                << " / " << s.max << "\n";
+    }
+    return 0;
+  }
+
+  int metric = history.find(args[0]);
+  if (metric < 0) {
+    std::cerr << "No history for " << args[0] << "\n";
+    return 1;
+  }
+  std::string span = args.size() > 1 ? args[1] : "5m";
+  size_t tier = span == "24h" ? 2 : span == "1h" ? 1 : 0;
+  if (tier == 0 && span != "5m") {
+    std::cerr << "Span must be 5m, 1h or 24h\n";
+    return 1;
+  }
+
+  // One column per group of buckets
+  constexpr size_t COLUMNS = 60;
+  std::vector<float> points(reed::HISTORY_TIERS[tier].points);
+  size_t n = history.averages(metric, tier, now, points.data(), points.size());
+  auto summary = history.summarize(metric, tier, n, now);
+  if (summary.count == 0) {
+    std::cerr << "No samples for " << args[0] << " in the last " << span
+              << "\n";
+    return 1;
+  }
+
+  static const char* bars[] = {"\u2581", "\u2582", "\u2583", "\u2584",
+                               "\u2585", "\u2586", "\u2587", "\u2588"};
+  size_t group = (n + COLUMNS - 1) / COLUMNS;
+  float range = summary.max - summary.min;
+  std::string line;
+  for (size_t c = 0; c * group < n; ++c) {
+    float sum = 0;
+    int count = 0;
+    for (size_t i = c * group; i < std::min(n, (c + 1) * group); ++i) {
+      if (!std::isnan(points[i])) {
+        sum += points[i];
+        ++count;
+      }
+    }
+    if (count == 0) {
+      line += " ";
+      continue;
+    }
+    float level = range > 0 ? (sum / count - summary.min) / range : 0;
+    line += bars[std::min(7, static_cast<int>(level * 8))];
+  }
+
+  std::cout << args[0] << " over " << span << ": min " << summary.min
+            << ", avg " << summary.avg << ", max " << summary.max << "\n"
+            << line << "\n";
+  return 0;
+}
+
+static void print_result(const reed::CommandResult& result) {
+  if (result.output.empty()) return;
+  (result.ok ? std::cout : std::cerr) << result.output << "\n";
+}
+
+// While the daemon owns the port, have it run the command rather than
+// polling for the port lock. nullopt: no daemon took it.
+static std::optional<int> route_to_daemon(const std::string& port,
+                                          const std::vector<std::string>& args,
+                                          bool verbose) {
+  reed::ScopedTimer timer("route_to_daemon");
+  auto daemon = running_daemon();
+  if (!daemon || (!port.empty() && port != daemon->port)) {
+    return std::nullopt;
+  }
+
+  auto reply = reed::ControlClient::request(
+      reed::ConfigManager::get_control_path(), args);
+  if (reply.outcome == reed::ControlOutcome::NotSent) {
+    if (verbose) {
+      std::cout << "Could not hand the command to the daemon, opening the "
+                   "port directly\n";
+    }
+    return std::nullopt;
+  }
+  if (reply.outcome == reed::ControlOutcome::NoReply) {
+    // Running it here as well could apply it twice
+    std::cerr << "No reply from the daemon (pid " << daemon->pid
+              << "); the command may or may not have run\n";
+    return 1;
+  }
+
+  const auto& result = reply.result;
+  if (verbose) {
+    std::cout << "Routed to daemon (pid " << daemon->pid << ") in "
+              << result.elapsed.count() / 1000 << " ms\n";
+  }
+  print_result(result);
+  return result.ok ? 0 : 1;
+}
+
+static int cmd_clock(const std::vector<std::string>& args,
+                     const std::string& ratio, const std::string& size,
+                     bool verbose) {
+  reed::ClockFaceOptions options;
+  std::string span = args.empty() ? "day" : args[0];
+  if (span != "day" && span != "hour") {
+    std::cerr << "Usage: reed-tpse clock [day|hour]\n";
+    return 1;
+  }
+  options.span = span == "day" ? 1440 : 60;
+  options.prefix = "clock_" + span;
+  options.dir = std::string(reed::Media::TMP_DIR) + "clock/";
+  options.width = reed::Media::panel_width(ratio);
+  options.height = reed::Media::PANEL_HEIGHT;
+  if (!size.empty() && (std::sscanf(size.c_str(), "%dx%d", &options.width,
+                                    &options.height) != 2 ||
+                        options.width <= 0 || options.height <= 0)) {
+    std::cerr << "Invalid --size: " << size << "\n";
+    return 1;
+  }
+
+  if (!reed::Media::is_ffmpeg_available()) {
+    std::cerr << "ffmpeg not found. Install ffmpeg to render clock faces.\n";
+    return 1;
+  }
+  if (!reed::Adb::is_device_connected()) {
+    std::cerr << "No ADB device connected\n";
+    return 1;
+  }
+
+  // An ffmpeg that gives up early must not kill us on the next write
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::cout << "Rendering " << options.span << " faces at " << options.width
+            << "x" << options.height << "...\n";
+  auto start = std::chrono::steady_clock::now();
+  auto paths = reed::render_clock_faces(options);
+  if (!paths) {
+    std::cerr << "Failed to render clock faces\n";
+    return 1;
+  }
+  auto rendered = std::chrono::steady_clock::now();
+  uint64_t bytes = 0;
+  for (const auto& path : *paths) {
+    bytes += fs::file_size(path);
+  }
+  std::cout << "Rendered in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   rendered - start)
+                   .count()
+            << " ms, " << bytes / 1024 << " KB\n";
+
+  std::cout << "Uploading...\n";
+  auto pushed = reed::Media::upload_bank(*paths, options.prefix);
+  if (!pushed) {
+    std::cerr << "Failed to upload clock faces\n";
+    return 1;
+  }
+  std::cout << "Uploaded " << *pushed << " files ("
+            << paths->size() - *pushed << " already on the device) in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - rendered)
+                   .count()
+            << " ms\n";
+  if (verbose) {
+    std::cout << "Files: " << paths->front() << " ... " << paths->back()
+              << "\n";
+  }
+
+  // The daemon picks this up from config.json and switches every minute
+  if (!reed::ConfigManager::set_clock_face(options.prefix, options.span)) {
+    std::cerr << "Could not update " << reed::ConfigManager::get_config_path()
+              << " (not valid JSON?); set \"clock_face\" to \""
+              << options.prefix << "\" there by hand\n";
+    return 1;
+  }
+  std::cout << "The daemon now shows " << options.prefix
+            << "; set \"clock_face\" to \"\" in config.json to stop.\n";
+  return 0;
+}
+
+static int cmd_overlay(const reed::Config& config,
+                       const std::vector<std::string>& args,
+                       const std::string& onto, const std::string& size) {
+  std::string layout_path = reed::ConfigManager::get_overlay_path();
+  auto layout = reed::ConfigManager::load_overlay(layout_path);
+  if (!layout) {
+    std::cerr << "No valid overlay layout at " << layout_path << "\n";
+    return 1;
+  }
+  if (!reed::Media::is_ffmpeg_available()) {
+    std::cerr << "ffmpeg not found. Install ffmpeg to render overlays.\n";
+    return 1;
+  }
+  std::string output = std::string(reed::Media::TMP_DIR) + "overlay.png";
+  if (!onto.empty()) {
+    output = std::string(reed::Media::TMP_DIR) +
+             reed::Media::get_basename(onto) + "_overlay.mp4";
+    // Only the widgets go on top of the user's clip
+    layout->transparent = true;
+  }
+  if (!args.empty()) {
+    output = args[0];
+  }
+
+  // The same metrics the daemon has: sensors, then derived metrics
+  const char* root = std::getenv("REED_SENSOR_ROOT");
+  reed::HostMetrics host(config, root ? root : "");
+  reed::DerivedMetrics derived;
+  for (const auto& error : derived.compile(config.derived_metrics,
+                                           host.names(), 1000)) {
+    std::cerr << "Derived metric dropped: " << error << "\n";
+  }
+  std::vector<std::string> names = host.names();
+  for (size_t i = 0; i < derived.count(); ++i) {
+    names.push_back(derived.name(i));
+  }
+
+  auto micros = [](auto since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - since)
+        .count();
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  reed::OverlayRenderer overlay;
+  for (const auto& error : overlay.compile(*layout, names)) {
+    std::cerr << "Overlay: " << error << "\n";
+  }
+  std::cout << "Compiled " << layout->widgets.size() << " widgets ("
+            << overlay.widgets() << " bound to metrics) in " << micros(start)
+            << " us\n";
+
+  // Rates need a baseline
+  host.sample();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  host.sample();
+  derived.update(host.values(), 1);
+
+  start = std::chrono::steady_clock::now();
+  overlay.update(derived.values());
+  std::cout << "First frame in " << micros(start) << " us\n";
+
+  // A second tick shows what an unchanged layout costs per sample
+  host.sample();
+  derived.update(host.values(), 0.001);
+  start = std::chrono::steady_clock::now();
+  size_t areas = overlay.update(derived.values()).size();
+  std::cout << "Next tick in " << micros(start) << " us (" << overlay.drawn()
+            << " of " << overlay.widgets() << " widgets redrawn, " << areas
+            << " areas)\n";
+
+  // An ffmpeg that gives up early must not kill us on the next write
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::error_code ec;
+  fs::create_directories(reed::Media::TMP_DIR, ec);
+  if (onto.empty()) {
+    if (!reed::Media::write_png(output, overlay.width(), overlay.height(),
+                                overlay.pixels())) {
+      std::cerr << "Failed to write " << output << "\n";
+      return 1;
+    }
+    std::cout << "Wrote " << output << "\n";
+    return 0;
+  }
+
+  reed::CompositeJob job;
+  job.background = onto;
+  job.output = output;
+  job.overlay_width = overlay.width();
+  job.overlay_height = overlay.height();
+  job.width = overlay.width();
+  job.height = overlay.height();
+  if (!size.empty() &&
+      (std::sscanf(size.c_str(), "%dx%d", &job.width, &job.height) != 2 ||
+       job.width <= 0 || job.height <= 0)) {
+    std::cerr << "Invalid --size: " << size << "\n";
+    return 1;
+  }
+
+  std::cout << "Compositing onto " << onto << " at " << job.width << "x"
+            << job.height << "...\n";
+  start = std::chrono::steady_clock::now();
+  bool sent = false;
+  bool ok = reed::Media::composite(job, [&]() {
+    const std::vector<uint8_t>* frame = sent ? nullptr : &overlay.pixels();
+    sent = true;
+    return frame;
+  });
+  if (!ok) {
+    std::cerr << "Failed to composite onto " << onto << "\n";
+    return 1;
+  }
+  std::cout << "Wrote " << output << " (" << fs::file_size(output, ec) / 1024
+            << " KB) in " << micros(start) / 1000 << " ms\n";
+  return 0;
+}
+
+static int cmd_encode_bench(const std::vector<std::string>& files,
+                            bool verbose) {
+  if (files.empty()) {
+    std::cerr << "Usage: reed-tpse encode-bench <file...>\n";
+    return 1;
+  }
+  for (const auto& file : files) {
+    if (!fs::exists(file)) {
+      std::cerr << "File not found: " << file << "\n";
+      return 1;
+    }
+  }
+  if (!reed::Media::is_ffmpeg_available()) {
+    std::cerr << "ffmpeg not found. Install ffmpeg to run the benchmark.\n";
+    return 1;
+  }
+
+  auto throughput = reed::measure_adb_throughput();
+  if (throughput) {
+    std::cout << std::fixed << std::setprecision(2) << "ADB push: "
+              << throughput->overhead_s << " s + "
+              << throughput->bytes_per_s / (1024 * 1024) << " MB/s\n";
+  } else {
+    std::cout << "No ADB device; upload time not estimated\n";
+  }
+
+  reed::EncodeBenchOptions options;
+  options.grid = reed::default_encode_grid();
+  std::cout << "Encoding " << files.size() << " files with "
+            << options.grid.size() << " settings...\n";
+  auto runs = reed::run_encode_bench(files, options);
+  auto summaries =
+      reed::summarize_encode_bench(runs, options.grid, throughput);
+
+  auto scale_name = [](const reed::EncodeProfile& profile) {
+    return profile.max_height ? std::to_string(profile.max_height) + "p"
+                              : std::string("source");
+  };
+
+  if (verbose) {
+    for (const auto& run : runs) {
+      const auto& profile = options.grid[run.profile];
+      std::cout << run.input << " " << profile.preset << "/" << profile.crf
+                << "/" << scale_name(profile) << ": ";
+      if (!run.ok) {
+        std::cout << "failed\n";
+        continue;
+      }
+      std::cout << std::setprecision(2) << run.wall_s << " s, "
+                << run.bytes / 1024 << " KB, SSIM " << std::setprecision(4)
+                << run.ssim << "\n";
+    }
+  }
+
+  // Times are totals over the corpus, encoding on one thread
+  std::cout << "\npreset     crf  scale   encode s  cpu s  size KB  ssim    "
+               "psnr   upload s\n";
+  for (const auto& s : summaries) {
+    std::cout << std::left << std::setw(11) << s.profile.preset
+              << std::setw(5) << s.profile.crf << std::setw(8)
+              << scale_name(s.profile) << std::right;
+    if (s.ok == 0) {
+      std::cout << "failed\n";
+      continue;
+    }
+    std::cout << std::setprecision(2) << std::setw(8) << s.wall_s
+              << std::setw(7) << s.cpu_s << std::setw(9) << s.bytes / 1024
+              << std::setprecision(4) << std::setw(8) << s.ssim
+              << std::setprecision(1) << std::setw(7) << s.psnr;
+    if (s.upload_s >= 0) {
+      std::cout << std::setprecision(2) << std::setw(11) << s.upload_s;
+    }
+    std::cout << (s.ok < files.size() ? "  (some failed)" : "") << "\n";
+  }
+
+  auto best = reed::recommend_encode_profile(summaries, files.size());
+  if (!best) {
+    std::cerr << "No setting encoded any file\n";
+    return 1;
+  }
+  const auto& pick = summaries[*best];
+  std::cout << "\nRecommended: preset " << pick.profile.preset << ", crf "
+            << pick.profile.crf << ", scale " << scale_name(pick.profile)
+            << std::setprecision(4) << " (SSIM " << pick.ssim << ", "
+            << std::setprecision(2) << pick.wall_s << " s encode";
+  if (pick.upload_s >= 0) {
+    std::cout << " + " << pick.upload_s << " s upload";
+  }
+  std::cout << ")\n{\"preset\": \"" << pick.profile.preset
+            << "\", \"crf\": " << pick.profile.crf
+            << ", \"max_height\": " << pick.profile.max_height << "}\n";
+  return 0;
+}
+
+static int cmd_shell(const std::string& port, bool verbose) {
+  reed::Device device(port, verbose);
+  if (!device.connect()) {
+    report_connect_failure(device);
+    return 1;
+  }
+  device.handshake();
+
+  // A dead adb shell must not kill us on the next write
+  std::signal(SIGPIPE, SIG_IGN);
+
+  reed::Session session(device);
+  bool interactive = isatty(STDIN_FILENO);
+  if (interactive) {
+    std::cout << "Connected to " << port
+              << ". Type 'help' for commands, 'quit' to exit.\n";
+  }
+
+  std::string line;
+  while (true) {
+    if (interactive) std::cout << "reed> " << std::flush;
+    if (!std::getline(std::cin, line)) break;
+
+    auto args = reed::Session::split(line);
+    if (args.empty()) continue;
+    if (args[0] == "quit" || args[0] == "exit") break;
+    if (args[0] == "help") {
+      std::cout << reed::Session::help();
+      continue;
+    }
+
+    print_result(session.run(args));
+  }
+
+  return 0;
+}
+
+static int cmd_batch(const std::string& port, const std::string& source,
+                     bool verbose) {
+  std::ifstream file;
+  if (source != "-") {
+    file.open(source);
+    if (!file) {
+      std::cerr << "Cannot open " << source << "\n";
+      return 1;
+    }
+  }
+  std::istream& in = source == "-" ? std::cin : file;
+
+  auto start = std::chrono::steady_clock::now();
+
+  reed::Device device(port, verbose);
+  if (!device.connect()) {
+    report_connect_failure(device);
+    return 1;
+  }
+  device.handshake();
+  auto setup = std::chrono::steady_clock::now() - start;
+
+  std::signal(SIGPIPE, SIG_IGN);
+
+  size_t commands = 0;
+  size_t serial_commands = 0;
+  size_t failures = 0;
+  std::chrono::microseconds busy{0};
+  auto report = [&](const std::vector<reed::CommandResult>& results) {
+    for (const auto& r : results) {
+      print_result(r);
+      busy += r.elapsed;
+      if (r.serial) ++serial_commands;
+      if (!r.ok) ++failures;
+    }
+  };
+
+  {
+    reed::Session session(device);
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+      ++line_number;
+      auto args = reed::Session::split(line);
+      if (args.empty()) continue;
+
+      ++commands;
+      if (!session.submit(args)) {
+        std::cerr << source << ":" << line_number
+                  << ": unknown command: " << args[0] << "\n";
+        ++failures;
+      }
+      report(session.collect(false));
+    }
+    report(session.collect(true));
+  }
+
+  // Separately, every serial command would pay for its own connect +
+  // handshake (the setup measured above) and all would run one after another
+  auto total = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  auto separate = std::chrono::duration_cast<std::chrono::milliseconds>(
+      busy + setup * serial_commands);
+  std::cerr << "Batch: " << commands << " commands in " << total.count()
+            << " ms (separate invocations: ~" << separate.count()
+            << " ms est.)\n";
+
+  return failures == 0 ? 0 : 1;
+}
+
 static int cmd_daemon_start(const std::string& port, bool foreground,
                             bool verbose) {
   if (!foreground) {
@@ -295,47 +1025,12 @@ static int cmd_daemon_start(const std::string& port, bool foreground,
   }
 
   // Foreground daemon mode
-  auto state = reed::ConfigManager::load_state();
-  if (!state || state->media.empty()) {
-    std::cerr
-        << "No display state saved. Run 'reed-tpse display <file>' first.\n";
-    return 1;
-  }
-
   auto config = reed::ConfigManager::load_config();
   std::string actual_port =
       (config && !config->port.empty()) ? config->port : port;
-  int keepalive_interval = config ? config->keepalive_interval : 10;
-
-  reed::Device device(actual_port, verbose);
-  if (!device.connect()) {
-    std::cerr << "Failed to connect to " << actual_port << "\n";
-    return 1;
-  }
-
-  device.handshake();
-
-  reed::ScreenConfig screen_config;
-  screen_config.media = state->media;
-  screen_config.ratio = state->ratio;
-  screen_config.screen_mode = state->screen_mode;
-  screen_config.play_mode = state->play_mode;
-
-  device.set_screen_config(screen_config);
-  device.set_brightness(state->brightness);
-
-  std::cout << "Display restored. Running keepalive...\n";
-
-  std::signal(SIGINT, signal_handler);
-  std::signal(SIGTERM, signal_handler);
-
-  while (g_running) {
-    std::this_thread::sleep_for(std::chrono::seconds(keepalive_interval));
-    if (!g_running) break;
-    device.handshake();
-  }
 
-  return 0;
+  reed::Daemon daemon(actual_port, verbose);
+  return daemon.run();
 }
 
 static int cmd_daemon_stop() {
@@ -350,9 +1045,86 @@ static int cmd_daemon_stop() {
 }
 
 static int cmd_daemon_status() {
-  int ret =
-      std::system("systemctl --user status reed-tpse.service 2>/dev/null");
-  return ret == 0 ? 0 : 1;
+  auto status = running_daemon();
+  if (!status) {
+    std::cout << "Daemon is not running.\n";
+    return 1;
+  }
+
+  int64_t now = unix_ms();
+  std::cout << "Daemon is running.\n"
+            << "  PID: " << status->pid << "\n"
+            << "  Port: " << status->port << "\n"
+            << "  Uptime: " << (now - status->started_at_ms) / 1000 << "s\n"
+            << "  Media: " << status->media << "\n"
+            << "  Brightness: " << status->brightness << "\n";
+
+  if (status->last_keepalive_ms > 0) {
+    std::cout << "  Last keepalive: "
+              << (now - status->last_keepalive_ms) / 1000 << "s ago\n";
+  } else {
+    std::cout << "  Last keepalive: never\n";
+  }
+
+  std::cout << "  RTT p50/p90/p99/max: " << status->rtt_p50_us / 1000 << "/"
+            << status->rtt_p90_us / 1000 << "/" << status->rtt_p99_us / 1000
+            << "/" << status->rtt_max_us / 1000 << " ms\n"
+            << "  Keepalives: " << status->keepalives_ok << " ok, "
+            << status->keepalive_failures << " failed\n"
+            << "  Command failures: " << status->command_failures << "\n";
+
+  if (status->playlist_switches > 0) {
+    std::cout << "  Playlist switches: " << status->playlist_switches
+              << " (worst timer jitter "
+              << status->playlist_jitter_max_us / 1000.0 << " ms)\n";
+  }
+
+  std::cout << "  Receive buffer: peak " << status->rx_peak_bytes << " of "
+            << status->rx_capacity_bytes << " bytes, "
+            << status->rx_stale_frames << " stale frames skipped\n";
+
+  if (status->control_requests > 0) {
+    std::cout << "  Routed commands: " << status->control_requests << " ("
+              << status->control_failures << " failed, slowest "
+              << status->control_max_us / 1000 << " ms)\n";
+  }
+  if (status->pump_rpm >= 0) {
+    std::cout << "  Pump: " << status->pump_rpm << " RPM\n";
+  }
+  if (status->alert[0]) {
+    std::cout << "  Alert: " << status->alert << "\n";
+  }
+  if (status->alert_switches > 0) {
+    std::cout << "  Alert switches: " << status->alert_switches
+              << " (sample to frame " << status->alert_latency_us
+              << " us, worst " << status->alert_latency_max_us << " us)\n";
+  }
+  if (status->self_cpu_us > 0) {
+    int64_t uptime_s = std::max<int64_t>((now - status->started_at_ms) / 1000,
+                                         1);
+    std::cout << "  Own CPU: " << status->self_cpu_us / 1000 << " ms ("
+              << status->self_cpu_hour_us / 1000 << " ms/hour lately), "
+              << "run delay " << status->self_run_delay_us / 1000 << " ms\n"
+              << "  Own memory: " << status->self_rss_kb / 1024 << " MB (peak "
+              << status->self_rss_peak_kb / 1024 << " MB), "
+              << status->self_page_faults << " page faults\n"
+              << "  Wake-ups: " << status->self_wakeups << " ("
+              << status->self_wakeups * 60 / uptime_s << "/min), "
+              << status->self_context_switches << " context switches"
+              << (status->self_perf ? "" : " (getrusage)") << "\n";
+  }
+  if (status->over_budget & reed::OVER_CPU_BUDGET) {
+    std::cout << "  Over CPU budget\n";
+  }
+  if (status->over_budget & reed::OVER_RSS_BUDGET) {
+    std::cout << "  Over memory budget\n";
+  }
+  if (status->port_lock_wait_us > 1000) {
+    std::cout << "  Waited for port at start: "
+              << status->port_lock_wait_us / 1000 << " ms\n";
+  }
+
+  return 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -364,10 +1136,15 @@ int main(int argc, char* argv[]) {
   std::string port;
   bool verbose = false;
   std::string ratio = "2:1";
+  std::string size;
+  std::string onto;
+  bool timings = false;
+  std::string trace;
   int brightness = 100;
   bool keepalive = false;
   bool foreground = false;
   int keepalive_interval = 10;
+  int fade_ms = 0;
 
   auto config = reed::ConfigManager::load_config();
   if (config) {
@@ -394,6 +1171,17 @@ int main(int argc, char* argv[]) {
       if (++i < argc) ratio = argv[i];
     } else if (arg == "--brightness") {
       if (++i < argc) brightness = std::atoi(argv[i]);
+    } else if (arg == "--fade") {
+      if (++i < argc) fade_ms = std::atoi(argv[i]);
+    } else if (arg == "--size") {
+      if (++i < argc) size = argv[i];
+    } else if (arg == "--onto") {
+      if (++i < argc) onto = argv[i];
+    } else if (arg == "--timings") {
+      timings = true;
+    } else if (arg == "--trace") {
+      if (++i < argc) trace = argv[i];
+      timings = true;
     } else if (arg == "--keepalive") {
       keepalive = true;
     } else if (arg == "--foreground") {
@@ -413,9 +1201,46 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  if (verbose) {
+    reed::Log::set_level(reed::LogLevel::Debug);
+  }
+
+  if (timings) {
+    reed::Timings::enable();
+  }
+  TimingsReport report{trace};
+  reed::ScopedTimer command_timer(command);
+
+  if (!keepalive && !args.empty() &&
+      (command == "brightness" || command == "display")) {
+    std::vector<std::string> request = {command};
+    if (command == "brightness") {
+      request.push_back(args[0]);
+      request.push_back("--fade");
+      request.push_back(std::to_string(fade_ms));
+    } else {
+      for (const auto& f : args) {
+        request.push_back(reed::Media::is_converted(f)
+                              ? reed::Media::get_converted_name(f)
+                              : f);
+      }
+      request.insert(request.end(), {"--ratio", ratio, "--brightness",
+                                     std::to_string(brightness)});
+    }
+    if (auto routed = route_to_daemon(port, request, verbose)) {
+      return *routed;
+    }
+  } else if (command == "info") {
+    if (auto routed = route_to_daemon(port, {"info"}, verbose)) {
+      return *routed;
+    }
+  }
+
   // Auto-detect port for commands that need serial connection
-  bool needs_serial = (command == "info" || command == "display" ||
-                       command == "brightness" || command == "daemon");
+  bool needs_serial =
+      (command == "info" || command == "display" || command == "brightness" ||
+       command == "shell" || command == "batch" ||
+       (command == "daemon" && !args.empty() && args[0] == "start"));
   if (needs_serial && port.empty()) {
     if (verbose) {
       std::cout << "Auto-detecting device...\n";
@@ -439,7 +1264,7 @@ int main(int argc, char* argv[]) {
       std::cerr << "Usage: reed-tpse upload <file>\n";
       return 1;
     }
-    return cmd_upload(args[0], verbose);
+    return cmd_upload(args[0], ratio, verbose);
   } else if (command == "display") {
     if (args.empty()) {
       std::cerr << "Usage: reed-tpse display <file...>\n";
@@ -452,7 +1277,7 @@ int main(int argc, char* argv[]) {
       std::cerr << "Usage: reed-tpse brightness <0-100>\n";
       return 1;
     }
-    return cmd_brightness(port, std::atoi(args[0].c_str()), verbose);
+    return cmd_brightness(port, std::atoi(args[0].c_str()), fade_ms, verbose);
   } else if (command == "list") {
     return cmd_list();
   } else if (command == "delete") {
@@ -461,6 +1286,25 @@ int main(int argc, char* argv[]) {
       return 1;
     }
     return cmd_delete(args);
+  } else if (command == "shell") {
+    return cmd_shell(port, verbose);
+  } else if (command == "batch") {
+    if (args.empty()) {
+      std::cerr << "Usage: reed-tpse batch <file|->\n";
+      return 1;
+    }
+    return cmd_batch(port, args[0], verbose);
+  } else if (command == "sensors") {
+    int count = args.empty() ? 1 : std::atoi(args[0].c_str());
+    return cmd_sensors(config.value_or(reed::Config{}), std::max(count, 1));
+  } else if (command == "history") {
+    return cmd_history(args);
+  } else if (command == "clock") {
+    return cmd_clock(args, ratio, size, verbose);
+  } else if (command == "overlay") {
+    return cmd_overlay(config.value_or(reed::Config{}), args, onto, size);
+  } else if (command == "encode-bench") {
+    return cmd_encode_bench(args, verbose);
   } else if (command == "daemon") {
     if (args.empty()) {
       std::cerr << "Usage: reed-tpse daemon <start|stop|status>\n";
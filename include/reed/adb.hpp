@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <map>
 #include <optional>
 #include <string>
 #include <vector>
@@ -16,9 +18,47 @@ class Adb {
   static std::optional<std::vector<std::string>> list_media();
   static bool remove(const std::string& filename);
 
+  // Size of a file in MEDIA_PATH, used to verify a push landed intact
+  static std::optional<uint64_t> remote_size(const std::string& filename);
+
+  // Many files in one adb invocation each, for asset banks: one push into
+  // MEDIA_PATH, and the sizes of every file matching a shell glob there
+  static bool push_all(const std::vector<std::string>& local_paths);
+  static std::optional<std::map<std::string, uint64_t>> remote_sizes(
+      const std::string& glob);
+
  private:
   static std::optional<std::string> run_command(
       const std::vector<std::string>& args);
 };
 
+// One long-lived `adb shell` process. Each run() costs a pipe round trip
+// instead of an adb client start-up and a new transport connection.
+class AdbShell {
+ public:
+  AdbShell() = default;
+  ~AdbShell();
+
+  AdbShell(const AdbShell&) = delete;
+  AdbShell& operator=(const AdbShell&) = delete;
+
+  bool start();
+  void stop();
+  bool is_running() const { return pid_ > 0; }
+
+  // Run a device shell command; returns its combined stdout/stderr, or
+  // nullopt if the shell died (it is then stopped and can be restarted)
+  std::optional<std::string> run(const std::string& command,
+                                 int timeout_ms = 10000);
+
+  std::optional<std::vector<std::string>> list_media();
+  bool remove(const std::string& filename);
+
+ private:
+  int pid_ = -1;
+  int in_fd_ = -1;   // Our end of the shell's stdin
+  int out_fd_ = -1;  // Our end of the shell's stdout/stderr
+  std::string buffer_;
+};
+
 }  // namespace reed
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace reed {
+
+// Threshold rules over the daemon's metrics, evaluated once per sample.
+// A rule fires after its metric has been past the threshold for
+// hold_seconds worth of consecutive samples, and ends once the metric has
+// been back past `clear` (hysteresis) for as long.
+class AlertEngine {
+ public:
+  // Resolves each rule's metric against names; rules naming an unknown
+  // metric are dropped, one message each. Rules keep their state across
+  // a recompile if their name stays the same.
+  std::vector<std::string> compile(const std::vector<AlertRule>& rules,
+                                   const std::vector<std::string>& names,
+                                   int interval_ms);
+
+  // values holds one value per name given to compile() (NaN = unavailable,
+  // which never fires or ends a rule). Returns the rules that fired or
+  // ended.
+  const std::vector<size_t>& update(const double* values);
+
+  size_t count() const { return rules_.size(); }
+  const AlertRule& rule(size_t i) const { return rules_[i].rule; }
+  bool active(size_t i) const { return rules_[i].active; }
+  double value(size_t i) const { return rules_[i].value; }
+
+  // First active rule with media / with a brightness, -1 if none
+  int screen_rule() const;
+  int brightness_rule() const;
+
+ private:
+  struct State {
+    AlertRule rule;
+    size_t slot;
+    int hold_samples;
+    int pending = 0;  // Consecutive samples towards the other state
+    bool active = false;
+    double value = 0;
+  };
+
+  std::vector<State> rules_;
+  std::vector<size_t> changed_;
+};
+
+}  // namespace reed
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "config.hpp"
+#include "event_loop.hpp"
+
+namespace reed {
+
+enum class RampCurve { Linear, Smooth };
+
+// Interpolates brightness over time without flooding the serial link.
+// Steps are paced by the measured cost of sending one, values the link had
+// no time for are skipped, and every ramp ends on an acknowledged send of
+// the exact target. Optionally follows a daily BrightnessPoint schedule.
+class BrightnessAnimator {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // final = last step of a ramp; only that one needs to wait for a reply.
+  // Returns false if the command failed.
+  using SendFn = std::function<bool(int value, bool final)>;
+
+  static constexpr std::chrono::milliseconds MIN_STEP{40};
+
+  BrightnessAnimator(EventLoop& loop, SendFn send);
+  ~BrightnessAnimator();
+
+  BrightnessAnimator(const BrightnessAnimator&) = delete;
+  BrightnessAnimator& operator=(const BrightnessAnimator&) = delete;
+
+  // What the panel currently shows, e.g. after a direct set_brightness
+  void set_current(int value) { current_ = value; }
+
+  // duration 0 sends the target immediately
+  void ramp_to(int target, std::chrono::milliseconds duration,
+               RampCurve curve = RampCurve::Smooth);
+  void cancel();
+
+  // Replaces the daily schedule and ramps to its active point over
+  // `initial_ramp`. An empty schedule disables it.
+  void set_schedule(const std::vector<BrightnessPoint>& points,
+                    std::chrono::milliseconds initial_ramp);
+  bool has_schedule() const { return !schedule_.empty(); }
+
+  bool ramping() const { return ramping_; }
+  int current() const { return current_; }
+  int target() const { return target_; }
+
+  std::chrono::microseconds step_cost() const { return step_cost_; }
+  uint64_t steps_sent() const { return steps_sent_; }
+  uint64_t levels_skipped() const { return levels_skipped_; }
+
+ private:
+  EventLoop& loop_;
+  SendFn send_;
+
+  int current_ = -1;
+  int start_ = 0;
+  int target_ = 0;
+  RampCurve curve_ = RampCurve::Smooth;
+  Clock::time_point ramp_start_;
+  std::chrono::milliseconds ramp_duration_{0};
+  bool ramping_ = false;
+  int timer_ = -1;
+  std::chrono::milliseconds timer_interval_{0};
+
+  std::vector<BrightnessPoint> schedule_;
+  int alarm_ = -1;
+
+  // Moving average of how long one unacknowledged step keeps us busy
+  std::chrono::microseconds step_cost_{0};
+  uint64_t steps_sent_ = 0;
+  uint64_t levels_skipped_ = 0;
+
+  std::chrono::milliseconds step_interval() const;
+  void on_tick();
+  bool emit(int value, bool final);
+  void finish();
+  void arm_schedule();
+  void on_schedule_alarm();
+};
+
+}  // namespace reed
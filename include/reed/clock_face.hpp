@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace reed {
+
+// A bank of pre-rendered clock faces, one image per minute, uploaded once.
+// The daemon then only has to send a screen config naming the right file
+// at each minute boundary.
+struct ClockFaceOptions {
+  int width = 480;
+  int height = 480;
+  int span = 1440;  // Minutes covered: 1440 (a day) or 60 (an hour)
+  std::string prefix = "clock";
+  std::string dir = "/tmp/reed-tpse/clock/";
+  unsigned jobs = 0;  // Render/encode workers; 0 = one per core
+};
+
+// File name of the face for `index` (minute of the day, or of the hour for
+// a 60-minute bank), both locally and on the device
+std::string clock_face_name(const std::string& prefix, int index);
+
+// Renders a face into rgb (width * height * 3 bytes)
+void render_clock_face(const ClockFaceOptions& options, int index,
+                       std::vector<uint8_t>& rgb);
+
+// Renders every minute of the span. Each worker takes a contiguous share of
+// the minutes and streams its frames to its own ffmpeg, which writes PNGs
+// into options.dir. Returns the paths in minute order.
+std::optional<std::vector<std::string>> render_clock_faces(
+    const ClockFaceOptions& options);
+
+}  // namespace reed
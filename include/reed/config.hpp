@@ -1,15 +1,64 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
 
 namespace reed {
 
+// Daily brightness target: from `minute` (after local midnight) on, ramp
+// to `value` over `ramp_seconds`
+struct BrightnessPoint {
+  int minute = 0;
+  int value = 100;
+  int ramp_seconds = 0;
+};
+
+enum class DerivedOp { Ewma, Rate, Percentile, Min, Max };
+
+// A metric computed from a sensor or another derived metric, e.g.
+// {"name":"gpu.temp.smooth","source":"gpu0.temp","op":"ewma","alpha":0.2}
+struct DerivedMetricSpec {
+  std::string name;
+  std::string source;
+  DerivedOp op = DerivedOp::Ewma;
+  double alpha = 0.3;       // ewma: weight of the newest sample
+  double percentile = 95;   // percentile: 0-100
+  int window = 60;          // percentile/min/max: seconds
+  double round = 0;         // Output step (e.g. 1 for whole degrees); 0 = off
+};
+
+// Switches the panel while a metric is past a threshold, e.g.
+// {"metric":"cpu.temp","above":90,"clear":85,"for":3,"media":"hot.mp4"}
+struct AlertRule {
+  std::string name;
+  std::string metric;   // Sensor or derived metric
+  bool above = true;    // Fires above threshold; false = below
+  double threshold = 0;
+  double clear = 0;     // Ends once back past this (hysteresis)
+  int hold_seconds = 0; // Debounce: must hold this long to fire or end
+  std::string media;    // Shown while active; empty = leave the screen
+  std::string ratio;    // Empty = keep the current ratio
+  int brightness = -1;  // While active; -1 = leave brightness
+};
+
 struct Config {
   std::string port;  // Empty = auto-detect
   int brightness = 100;
   int keepalive_interval = 10;
+  int state_write_delay_ms = 1000;  // Daemon coalesces state saves this long
+  int fade_in_ms = 0;               // Daemon start-up brightness fade
+  int sample_interval_ms = 1000;    // Daemon sensor sampling; 0 = off
+  std::vector<BrightnessPoint> brightness_schedule;
+  std::vector<std::string> net_interfaces;  // Empty = physical interfaces
+  std::vector<std::string> disk_devices;    // Empty = physical disks
+  std::vector<DerivedMetricSpec> derived_metrics;
+  std::vector<AlertRule> alerts;  // Earlier rules win the screen
+  std::string clock_face;  // Bank from `reed-tpse clock`; empty = off
+  int clock_span = 1440;   // Minutes in that bank: 1440 or 60
+  int cpu_budget_ms = 0;   // Daemon CPU per hour before warning; 0 = off
+  int rss_budget_mb = 0;   // Daemon resident memory before warning; 0 = off
 };
 
 struct DisplayState {
@@ -20,18 +69,91 @@ struct DisplayState {
   int brightness = 100;
 };
 
+// One entry of a host-driven rotation. Time-of-day bounds are minutes after
+// local midnight; an end before the start wraps past midnight.
+struct PlaylistItem {
+  std::string media;  // Remote name, or a local file uploaded ahead of time
+  std::string ratio;  // Empty = keep the current ratio
+  int duration = 0;   // Seconds; 0 = until end_minute
+  int start_minute = -1;  // -1 = eligible at any time
+  int end_minute = -1;
+};
+
+struct Playlist {
+  std::vector<PlaylistItem> items;
+};
+
+enum class WidgetType { Rect, Text, Value, Bar };
+
+// A font of the overlay: the built-in bitmap font drawn `scale` times
+// larger
+struct OverlayFont {
+  std::string name;
+  int scale = 2;
+};
+
+// One element of an overlay layout. Rect and text widgets never change;
+// value and bar widgets are bound to a metric.
+struct OverlayWidget {
+  WidgetType type = WidgetType::Text;
+  int x = 0;
+  int y = 0;
+  int width = 0;   // rect, bar
+  int height = 0;  // rect, bar
+  uint32_t color = 0xFFFFFF;  // 0xRRGGBB
+  uint32_t track = 0x303840;  // bar: the unfilled part
+  std::string font;           // text, value; empty = "default"
+  std::string text;           // text: the label; value: unit after it
+  std::string metric;         // value, bar
+  int decimals = 0;           // value
+  double divisor = 1;         // value: e.g. 1048576 to show bytes as MiB
+  double min = 0;             // bar: empty at or below
+  double max = 100;           // bar: full at or above
+  bool align_right = false;   // text, value: x is the right edge
+};
+
+struct OverlayLayout {
+  int width = 480;
+  int height = 480;
+  uint32_t background = 0x101418;
+  bool transparent = false;  // "background":"transparent", for compositing
+  std::vector<OverlayFont> fonts;
+  std::vector<OverlayWidget> widgets;  // Drawn in order
+};
+
 class ConfigManager {
  public:
   static std::string get_config_dir();
   static std::string get_state_dir();
+  static std::string get_runtime_dir();
   static std::string get_config_path();
   static std::string get_state_path();
+  static std::string get_status_path();
+  static std::string get_control_path();
+  static std::string get_playlist_path();
+  static std::string get_history_path();
+  static std::string get_overlay_path();
 
   static std::optional<Config> load_config();
   static bool save_config(const Config& config);
+  // Sets clock_face and clock_span in config.json and leaves every other
+  // key exactly as written. Fails without writing when the file exists
+  // but is not a JSON object.
+  static bool set_clock_face(const std::string& prefix, int span);
 
   static std::optional<DisplayState> load_state();
   static bool save_state(const DisplayState& state);
+
+  static std::optional<Playlist> load_playlist();
+  static std::optional<OverlayLayout> load_overlay(const std::string& path);
+
+  static std::string serialize_config(const Config& config);
+  static std::string serialize_state(const DisplayState& state);
+
+  // Write to a temp file in the same directory, fsync, then rename over
+  // path, so a crash never leaves a truncated file behind
+  static bool write_file_atomic(const std::string& path,
+                                const std::string& content);
 };
 
 }  // namespace reed
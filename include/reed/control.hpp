@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "event_loop.hpp"
+#include "session.hpp"
+
+namespace reed {
+
+// Unix socket through which other processes hand serial commands to the
+// daemon that owns the port, instead of opening it themselves. A request
+// is one command line (Session::split syntax); the reply is "OK <n>\n" or
+// "ERR <n>\n" followed by n bytes of output. Requests are served one at a
+// time, in arrival order, on the daemon's event loop.
+class ControlServer {
+ public:
+  using Handler =
+      std::function<CommandResult(const std::vector<std::string>& args)>;
+  // Called after each reply, once the counters below include it
+  using ServedFn = std::function<void()>;
+
+  ControlServer(EventLoop& loop, Handler handler, ServedFn on_served = {});
+  ~ControlServer();
+
+  ControlServer(const ControlServer&) = delete;
+  ControlServer& operator=(const ControlServer&) = delete;
+
+  bool listen(const std::string& path);
+  void close();
+
+  uint64_t requests() const { return requests_; }
+  uint64_t failures() const { return failures_; }
+  std::chrono::microseconds max_latency() const { return max_latency_; }
+
+ private:
+  static constexpr size_t MAX_LINE = 4096;
+
+  EventLoop& loop_;
+  Handler handler_;
+  ServedFn on_served_;
+  std::string path_;
+  int listen_fd_ = -1;
+  std::map<int, std::string> clients_;  // fd -> unterminated input
+
+  uint64_t requests_ = 0;
+  uint64_t failures_ = 0;
+  std::chrono::microseconds max_latency_{0};
+
+  void on_accept();
+  void on_client(int fd);
+  void drop_client(int fd);
+};
+
+// What became of a ControlClient request
+enum class ControlOutcome {
+  NotSent,  // Nothing listening, the line never got through, or an
+            // argument holds a newline and cannot be sent on one line
+  NoReply,  // Sent, but the reply broke off or timed out; the daemon may
+            // have run the command, so it must not be run again
+  Replied,
+};
+
+struct ControlReply {
+  ControlOutcome outcome = ControlOutcome::NotSent;
+  CommandResult result;  // Only when Replied
+};
+
+class ControlClient {
+ public:
+  // Send one command to the daemon listening at path. Only NotSent lets
+  // the caller fall back to opening the port itself.
+  static ControlReply request(const std::string& path,
+                              const std::vector<std::string>& args,
+                              int timeout_ms = 30000);
+
+  // Inverse of Session::split; nullopt if an argument holds a newline
+  static std::optional<std::string> join(
+      const std::vector<std::string>& args);
+};
+
+}  // namespace reed
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "alerts.hpp"
+#include "brightness.hpp"
+#include "config.hpp"
+#include "control.hpp"
+#include "derived.hpp"
+#include "device.hpp"
+#include "event_loop.hpp"
+#include "history.hpp"
+#include "host_metrics.hpp"
+#include "persist.hpp"
+#include "playlist.hpp"
+#include "self_profile.hpp"
+#include "status.hpp"
+
+namespace reed {
+
+// Foreground keepalive daemon: restores the saved display, keeps the panel
+// alive, runs the optional playlist and brightness schedule, and hot-reloads
+// config.json, display.json and playlist.json when they change on disk. It
+// holds the serial port exclusively and serves info/brightness/display for
+// other processes over a control socket.
+class Daemon {
+ public:
+  Daemon(const std::string& port, bool verbose = false);
+  ~Daemon();
+
+  Daemon(const Daemon&) = delete;
+  Daemon& operator=(const Daemon&) = delete;
+
+  // Blocks until SIGINT/SIGTERM. Returns a process exit code.
+  int run();
+
+ private:
+  std::string port_;
+  bool verbose_;
+  Device device_;
+  EventLoop loop_;
+  PlaylistScheduler playlist_;
+  BrightnessAnimator brightness_;
+
+  ControlServer control_;
+  DebouncedWriter state_writer_;
+
+  Config config_;
+  DisplayState applied_;
+  DisplayState saved_;  // display.json as last read or queued for writing
+
+  StatusPage status_page_;
+  DaemonStatus status_;
+  RttWindow rtt_;
+
+  // Self-measurement against config_'s CPU and RSS budgets
+  SelfProfiler profiler_;
+  CpuWindow cpu_window_;
+  int profile_timer_ = -1;
+
+  // Host sensors, sampled every sample_interval_ms into history_, and
+  // the metrics derived from them
+  std::unique_ptr<HostMetrics> host_;
+  DerivedMetrics derived_;
+  History history_;
+  std::vector<int> history_ids_;  // Per host_ metric, then per derived_
+  uint64_t history_generation_ = 0;  // 0 = derived_ needs compiling
+  std::chrono::steady_clock::time_point last_sample_;
+
+  // Alert rules over host_ and derived_. Switches are written straight
+  // from the sample tick with bodies encoded ahead of time; while a rule
+  // holds the screen or brightness, other changes only update applied_.
+  AlertEngine alerts_;
+  std::vector<std::string> alert_frames_;  // Per rule; empty = no media
+  std::string base_frame_;                 // base_screen(), to restore
+  int alert_screen_ = -1;      // Rule shown, -1 = none, -2 = to refresh
+  int alert_brightness_ = -1;  // Same for brightness
+
+  // Minute-indexed clock face from config_.clock_face; shown instead of
+  // applied_'s media, below alerts
+  std::string clock_media_;  // Empty = off
+  int clock_alarm_ = -1;
+
+  int confirm_timer_ = -1;  // Second send after post_screen()
+
+  int signal_fd_ = -1;
+  int inotify_fd_ = -1;
+  int config_wd_ = -1;
+  int state_wd_ = -1;
+  int keepalive_timer_ = -1;
+  int sample_timer_ = -1;
+
+  bool setup_signals();
+  bool setup_watches();
+
+  void apply_screen(const DisplayState& state);
+  ScreenConfig base_screen() const;  // applied_ with the clock face
+  // One screen frame written without waiting; confirmed 500 ms later
+  void post_screen(const std::string& frame);
+  void confirm_screen();
+  bool send_brightness(int value, bool final);
+
+  void keepalive();
+  void start_sampling();
+  void sample();
+  void compile_derived();
+  void compile_alerts();
+  void prepare_frames();
+  void switch_alerts(std::chrono::steady_clock::time_point sampled);
+  void update_clock();
+  void on_signal();
+  void on_inotify();
+  void reload_config();
+  void reload_state();
+  void reload_playlist();
+  void on_playlist_switch(const PlaylistItem& item,
+                          const std::string& remote_name);
+  void profile_self();
+  void publish_status();
+
+  CommandResult on_control(const std::vector<std::string>& args);
+  CommandResult control_info();
+  CommandResult control_brightness(const std::vector<std::string>& args);
+  CommandResult control_display(const std::vector<std::string>& args);
+  void save_state();
+};
+
+}  // namespace reed
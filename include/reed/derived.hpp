@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace reed {
+
+// Metrics computed from other metrics (host sensors or other derived
+// metrics, as declared in config.json's derived_metrics). The declarations
+// are compiled once into a flat, dependency-ordered list; each tick then
+// walks that list and recomputes only the nodes whose source changed or
+// whose own state has not settled yet.
+class DerivedMetrics {
+ public:
+  // Resolves sources against the input names and orders the nodes so each
+  // comes after its source. Declarations with an unknown source, a
+  // duplicate name or a dependency cycle are dropped; returns one message
+  // per dropped declaration. All node state starts over.
+  std::vector<std::string> compile(const std::vector<DerivedMetricSpec>& specs,
+                                   const std::vector<std::string>& inputs,
+                                   int interval_ms);
+
+  // One tick. inputs holds one value per input name given to compile()
+  // (NaN = unavailable); dt is the time since the previous tick. Returns
+  // the derived metrics whose value changed, in evaluation order.
+  const std::vector<size_t>& update(const double* inputs, double dt_seconds);
+
+  size_t count() const { return nodes_.size(); }
+  const std::string& name(size_t i) const { return nodes_[i].name; }
+  double value(size_t i) const { return values_[inputs_ + i]; }
+  const std::vector<size_t>& changed() const { return changed_list_; }
+
+  // The inputs of the last update() followed by every derived value
+  const double* values() const { return values_.data(); }
+
+  // Nodes recomputed by the last update(); the rest were skipped
+  size_t evaluated() const { return evaluated_; }
+
+ private:
+  struct Node {
+    std::string name;
+    DerivedOp op;
+    size_t source;  // Slot in values_
+    double alpha;
+    double percentile;
+    double round;
+
+    bool settled = false;  // Same input again would not change anything
+    double state = 0;      // EWMA accumulator / previous input for rate
+    bool primed = false;
+    // Sliding window: samples in arrival order (ring) and sorted
+    std::vector<double> ring;
+    std::vector<double> sorted;
+    size_t ring_size = 0;
+    size_t ring_next = 0;
+  };
+
+  // values_ holds the inputs followed by the nodes, in evaluation order
+  size_t inputs_ = 0;
+  std::vector<Node> nodes_;
+  std::vector<double> values_;
+  std::vector<uint8_t> dirty_;
+  std::vector<size_t> changed_list_;
+  size_t evaluated_ = 0;
+
+  double evaluate(Node& node, double input, double dt_seconds);
+  void push_window(Node& node, double input);
+};
+
+}  // namespace reed
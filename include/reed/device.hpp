@@ -1,10 +1,15 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "protocol.hpp"
+#include "ring_buffer.hpp"
 
 namespace reed {
 
@@ -16,6 +21,7 @@ struct DeviceInfo {
   std::string firmware;
   std::string hardware;
   std::vector<std::string> attributes;
+  int pump_rpm = -1;  // -1 = not reported
 };
 
 struct ScreenConfig {
@@ -36,19 +42,60 @@ class Device {
   // Auto-detect device by scanning /dev/ttyACM* and attempting handshake
   static std::optional<std::string> find_device(bool verbose = false);
 
-  bool connect();
+  // How long connect() waits by default for another process to release
+  // the port
+  static constexpr std::chrono::milliseconds LOCK_WAIT{5000};
+
+  // Opens the port and takes exclusive ownership of it (flock + TIOCEXCL).
+  // If another process holds it, polls every 25 ms for up to lock_wait.
+  // This is not a queue: waiters are not served in order, and one may
+  // lose every race until it gives up.
+  bool connect(std::chrono::milliseconds lock_wait = LOCK_WAIT);
   void disconnect();
   bool is_connected() const { return fd_ >= 0; }
   const std::string& port() const { return port_; }
 
+  // Contention seen by the last connect(): whether it gave up because the
+  // port was held, how long it waited, and how many attempts were refused
+  bool port_busy() const { return port_busy_; }
+  std::chrono::microseconds lock_wait() const { return lock_wait_; }
+  int lock_retries() const { return lock_retries_; }
+
   std::optional<Response> send_command(const std::string& request_state,
                                        const std::string& cmd_type,
                                        const std::string& content = "",
                                        bool wait_response = true);
 
+  // Receive buffer statistics: peak fill, frames skipped because nobody was
+  // waiting for them (replies to fire-and-forget commands, unsolicited
+  // frames), bytes outside any frame, and bytes lost to a full buffer
+  size_t rx_capacity() const { return rx_.capacity(); }
+  size_t rx_peak() const { return rx_.peak(); }
+  uint64_t rx_reads() const { return rx_reads_; }
+  uint64_t rx_frames() const { return rx_frames_; }
+  uint64_t rx_stale_frames() const { return rx_stale_frames_; }
+  uint64_t rx_discarded_bytes() const { return rx_discarded_bytes_; }
+  uint64_t rx_overflow_bytes() const { return rx_overflow_bytes_; }
+
   std::optional<DeviceInfo> handshake();
+  // Handshake that only reports whether the device answered. Allocation-free
+  // once the I/O buffers are warm, for the daemon's keepalive.
+  bool keepalive();
+  // Pump speed from the last handshake or keepalive reply, -1 if the
+  // device does not report one
+  int pump_rpm() const { return pump_rpm_; }
   std::optional<Response> set_screen_config(const ScreenConfig& config);
-  std::optional<Response> set_brightness(int value);
+  // The waterBlockScreenId body for config, for sending later with post()
+  static std::string encode_screen_config(const ScreenConfig& config);
+
+  // Writes one POST with ready-made content and returns as soon as it is
+  // on the wire, without waiting for the reply (the next exchange skips
+  // it as stale). No allocation once the buffers are warm; for switches
+  // that must not wait behind a round trip.
+  bool post(std::string_view cmd_type, std::string_view content);
+  // wait_response = false writes the frame and returns once it is on the
+  // wire; used for intermediate steps of a brightness ramp
+  std::optional<Response> set_brightness(int value, bool wait_response = true);
   std::optional<Response> delete_media(const std::vector<std::string>& files);
 
  private:
@@ -56,8 +103,48 @@ class Device {
   bool verbose_;
   int fd_ = -1;
   int seq_number_ = 0;
+  int pump_rpm_ = -1;
+
+  bool port_busy_ = false;
+  std::chrono::microseconds lock_wait_{0};
+  int lock_retries_ = 0;
+
+  bool open_exclusive(std::chrono::milliseconds lock_wait);
+
+  // Reused for every exchange; see keepalive()
+  static constexpr size_t BUFFER_RESERVE = 4096;
+  static constexpr size_t RX_CAPACITY = 16384;
+  std::vector<uint8_t> tx_;
+  std::vector<uint8_t> scratch_;
+
+  // Bytes read from the port but not consumed yet, including anything that
+  // arrived after the last frame
+  RingBuffer rx_{RX_CAPACITY};
+  uint64_t rx_reads_ = 0;
+  uint64_t rx_frames_ = 0;
+  uint64_t rx_stale_frames_ = 0;
+  uint64_t rx_discarded_bytes_ = 0;
+  uint64_t rx_overflow_bytes_ = 0;
 
-  std::vector<uint8_t> read_response(int timeout_ms = 1000);
+  // Moves whatever the port has pending into rx_ in one read. Returns the
+  // number of bytes read.
+  size_t fill();
+  // The first complete frame in rx_, markers included; consume it from
+  // rx_ when done. Bytes before it are dropped.
+  bool next_frame(const uint8_t*& frame, size_t& size);
+  // Waits for a complete frame to arrive
+  bool read_response(const uint8_t*& frame, size_t& size,
+                     int timeout_ms = 1000);
+  // Builds the next frame into tx_ and writes it out
+  bool write_frame(std::string_view request_state, std::string_view cmd_type,
+                   std::string_view content);
+  // Sends one frame; with wait_response, returns the parsed reply, which
+  // points into scratch_ and is valid until the next exchange. Frames
+  // already buffered when a reply is expected are skipped as stale.
+  std::optional<FrameView> exchange(std::string_view request_state,
+                                    std::string_view cmd_type,
+                                    std::string_view content,
+                                    bool wait_response);
 };
 
 }  // namespace reed
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "media.hpp"
+
+namespace reed {
+
+// Measures what the x264 settings cost and buy on real clips: every input
+// is encoded with every profile of a grid, timed, and scored against its
+// source. With the measured ADB push throughput added, the profile that
+// gets acceptable quality onto the panel soonest becomes the recommended
+// default.
+struct EncodeBenchOptions {
+  std::vector<EncodeProfile> grid;  // Empty = default_encode_grid()
+  std::string dir = "/tmp/reed-tpse/bench/";
+  unsigned jobs = 0;  // Encodes at a time; 0 = one per core
+};
+
+// One input encoded with one profile
+struct EncodeRun {
+  size_t profile = 0;  // Index into the grid
+  std::string input;
+  bool ok = false;
+  double wall_s = 0;
+  double cpu_s = 0;  // ffmpeg's user + system time
+  uint64_t bytes = 0;
+  double ssim = 0;  // Against the source, at the source size
+  double psnr = 0;  // dB, capped at 100 for identical frames
+};
+
+// Cost of `adb push`: a fixed start-up part and a transfer rate
+struct AdbThroughput {
+  double overhead_s = 0;
+  double bytes_per_s = 0;
+
+  double upload_s(uint64_t bytes) const {
+    return overhead_s + static_cast<double>(bytes) / bytes_per_s;
+  }
+};
+
+// Totals of one profile over the whole corpus
+struct EncodeSummary {
+  EncodeProfile profile;
+  size_t ok = 0;  // Inputs that encoded and scored
+  double wall_s = 0;
+  double cpu_s = 0;
+  uint64_t bytes = 0;
+  double ssim = 0;  // Means over the inputs
+  double psnr = 0;
+  double upload_s = -1;  // Pushing every output; -1 = no device measured
+};
+
+// presets ultrafast..slow x CRF 20..30 x source size or panel height
+std::vector<EncodeProfile> default_encode_grid();
+
+// Pushes two scratch files of different sizes to the device and derives
+// the overhead and rate from the pair; nullopt without a device
+std::optional<AdbThroughput> measure_adb_throughput(
+    const std::string& dir = "/tmp/reed-tpse/bench/");
+
+// Encodes and scores every input with every profile. Each ffmpeg runs
+// single-threaded, so runs in parallel do not skew each other's timings.
+std::vector<EncodeRun> run_encode_bench(const std::vector<std::string>& inputs,
+                                        const EncodeBenchOptions& options);
+
+std::vector<EncodeSummary> summarize_encode_bench(
+    const std::vector<EncodeRun>& runs,
+    const std::vector<EncodeProfile>& grid,
+    const std::optional<AdbThroughput>& throughput);
+
+// Index of the profile with the least encode + upload time among those
+// that handled every input at a mean SSIM of at least min_ssim; if none
+// does, the one with the best SSIM. nullopt when nothing encoded.
+std::optional<size_t> recommend_encode_profile(
+    const std::vector<EncodeSummary>& summaries, size_t inputs,
+    double min_ssim = 0.97);
+
+}  // namespace reed
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace reed {
+
+// Minimal epoll-based loop. Callbacks run on the thread calling run().
+class EventLoop {
+ public:
+  using Callback = std::function<void()>;
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  bool is_valid() const { return epoll_fd_ >= 0; }
+
+  // Watch fd for readability. The loop does not take ownership of fd.
+  bool add(int fd, Callback cb);
+  void remove(int fd);
+
+  // timerfd-backed timer; returns its id (the timerfd) or -1. The first
+  // expiry is after `interval`, then every `interval` if repeat is set.
+  int add_timer(std::chrono::milliseconds interval, Callback cb,
+                bool repeat = true);
+  bool rearm_timer(int id, std::chrono::milliseconds interval,
+                   bool repeat = true);
+  void remove_timer(int id);
+
+  // One-shot CLOCK_REALTIME timer for absolute wall-clock deadlines. It
+  // starts disarmed; set_alarm() (re)arms it. The callback also runs if the
+  // system clock is stepped, so the owner can recompute its deadline.
+  int add_alarm(Callback cb);
+  bool set_alarm(int id, std::chrono::system_clock::time_point when);
+
+  // Dispatch ready events, waiting at most timeout_ms (-1 = forever)
+  void run_once(int timeout_ms = -1);
+  void run();
+  void stop() { running_ = false; }
+
+  // Times epoll_wait has returned, i.e. how often the process woke up
+  uint64_t wakeups() const { return wakeups_; }
+
+ private:
+  int epoll_fd_ = -1;
+  bool running_ = false;
+  bool dispatching_ = false;
+  uint64_t wakeups_ = 0;
+  std::unordered_map<int, Callback> handlers_;
+  std::unordered_map<int, Callback> timers_;
+  std::vector<int> removed_;
+  std::vector<int> removed_timers_;
+};
+
+}  // namespace reed
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace reed {
+
+// Built-in 5x8 bitmap font: printable ASCII plus the degree sign. Each
+// glyph is 5 columns, bit 0 = top row; rows 0-6 hold the cap height and
+// row 7 the descenders.
+constexpr int GLYPH_WIDTH = 5;
+constexpr int GLYPH_HEIGHT = 8;
+constexpr int GLYPH_ADVANCE = 6;
+
+// Glyph index of a code point; anything the font lacks maps to '?'
+uint8_t glyph_index(uint32_t codepoint);
+
+const uint8_t* glyph_columns(uint8_t index);
+
+// Decodes UTF-8 text into glyph indices
+std::vector<uint8_t> glyph_run(const std::string& text);
+
+// Width in pixels of a run of `length` glyphs drawn `scale` times larger
+inline int glyph_run_width(size_t length, int scale) {
+  return length ? static_cast<int>(length * GLYPH_ADVANCE - 1) * scale : 0;
+}
+
+}  // namespace reed
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace reed {
+
+// Decodes a GIF animation one frame at a time onto a full-size canvas,
+// applying each frame's transparency and disposal the way browsers do.
+class GifDecoder {
+ public:
+  // Larger logical screens are refused rather than allocated
+  static constexpr size_t MAX_PIXELS = 16 * 1024 * 1024;
+
+  // Reads the whole file and its header; false if it is not a GIF or
+  // its screen is over MAX_PIXELS
+  bool open(const std::string& path);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // Composites the next frame. Returns false at the end of the file, or
+  // on corrupt data, in which case error() says what was wrong.
+  bool next();
+
+  // The canvas after the last next(): width * height pixels, bytes in
+  // memory R, G, B, A (A = 0 where nothing was drawn yet)
+  const std::vector<uint32_t>& canvas() const { return canvas_; }
+
+  // How long the last frame stays up, with browser rules for tiny delays
+  int delay_ms() const { return delay_ms_; }
+
+  const std::string& error() const { return error_; }
+
+ private:
+  std::vector<uint8_t> data_;
+  size_t pos_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  uint32_t global_palette_[256] = {};
+  bool has_global_palette_ = false;
+
+  std::vector<uint32_t> canvas_;
+  std::vector<uint32_t> saved_;  // For disposal "restore to previous"
+  std::vector<uint8_t> indices_;  // The frame clipped to the screen
+  int delay_ms_ = 0;
+  std::string error_;
+
+  // Disposal of the frame drawn last, applied before the next one
+  int dispose_ = 0;
+  int dispose_x_ = 0, dispose_y_ = 0, dispose_w_ = 0, dispose_h_ = 0;
+
+  bool fail(const std::string& message);
+  bool read_palette(uint32_t* palette, int entries);
+  bool skip_sub_blocks();
+  bool decode_lzw(int min_code_size, int w, const std::vector<int>& rows,
+                  int visible_w, int visible_h);
+  void dispose();
+};
+
+}  // namespace reed
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace reed {
+
+// One reading per GPU. NaN = not reported by this driver.
+struct GpuSample {
+  double busy_percent = NAN;
+  double vram_used_mb = NAN;
+  double vram_total_mb = NAN;
+  double temperature_c = NAN;
+  double clock_mhz = NAN;
+};
+
+// A source of GPU metrics. Devices are discovered when the backend is
+// opened; read() then fills one sample per device.
+class GpuBackend {
+ public:
+  virtual ~GpuBackend() = default;
+
+  virtual const char* backend_name() const = 0;
+  virtual size_t count() const = 0;
+  virtual const std::string& device_name(size_t index) const = 0;
+
+  // out has count() entries
+  virtual void read(GpuSample* out) = 0;
+};
+
+// amdgpu, i915/xe and other DRM drivers through /sys/class/drm. root is
+// prepended to every path, so a fake tree can stand in for /sys. Returns
+// nullptr if no card exposes anything we can read.
+std::unique_ptr<GpuBackend> open_sysfs_gpus(const std::string& root = "");
+
+// NVIDIA through NVML, loaded with dlopen so there is no link-time
+// dependency. Returns nullptr if the library is missing or init fails.
+constexpr const char* NVML_LIBRARY = "libnvidia-ml.so.1";
+std::unique_ptr<GpuBackend> open_nvml(const std::string& library = NVML_LIBRARY);
+
+// All GPUs from every available backend. update() reads each backend once
+// (one batch per tick); samples() returns the cached result until the
+// next update().
+class GpuMonitor {
+ public:
+  explicit GpuMonitor(const std::string& sysfs_root = "",
+                      const std::string& nvml_library = NVML_LIBRARY);
+
+  size_t count() const { return names_.size(); }
+  const std::string& name(size_t index) const { return names_[index]; }
+
+  void update();
+  const std::vector<GpuSample>& samples() const { return samples_; }
+
+ private:
+  std::vector<std::unique_ptr<GpuBackend>> backends_;
+  std::vector<std::string> names_;
+  std::vector<GpuSample> samples_;
+};
+
+}  // namespace reed
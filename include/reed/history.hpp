@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace reed {
+
+// Resolution and length of each downsampling tier
+struct HistoryTier {
+  int seconds;
+  int points;
+};
+constexpr HistoryTier HISTORY_TIERS[] = {
+    {1, 300},    // 5 minutes
+    {10, 360},   // 1 hour
+    {60, 1440},  // 24 hours
+};
+constexpr size_t HISTORY_TIER_COUNT =
+    sizeof(HISTORY_TIERS) / sizeof(HISTORY_TIERS[0]);
+
+constexpr uint32_t HISTORY_MAGIC = 0x54534948;  // "HIST" little-endian
+constexpr uint32_t HISTORY_VERSION = 1;
+
+// Min/max/avg over a stretch of one tier; count = samples behind it,
+// 0 if there were none (the floats are then NaN)
+struct HistorySummary {
+  float min;
+  float max;
+  float avg;
+  uint32_t count;
+};
+
+// Fixed-size store of metric history. Every sample updates one bucket in
+// each tier (min, max, sum, count kept incrementally), so no tier is ever
+// recomputed from another. Buckets live in per-tier rings indexed by wall
+// time, laid out as separate min/max/sum/count arrays so scans over a tier
+// are straight loops. The whole store is one mapping: anonymous memory,
+// or a file, in which case history survives restarts with no replay.
+class History {
+ public:
+  static constexpr size_t NAME_SIZE = 48;
+  static constexpr size_t DEFAULT_CAPACITY = 64;
+
+  History() = default;
+  ~History();
+
+  History(const History&) = delete;
+  History& operator=(const History&) = delete;
+
+  // Maps the store. Empty path = anonymous memory. A file from another
+  // version or capacity is reset. read_only maps an existing file for
+  // inspection (e.g. by the CLI while the daemon writes it).
+  bool open(const std::string& path = "", size_t capacity = DEFAULT_CAPACITY,
+            bool read_only = false);
+  void close();
+  bool is_open() const { return base_ != nullptr; }
+
+  // Schedules write-back of a file-backed store
+  void flush();
+
+  size_t capacity() const;
+  size_t count() const;
+  std::string_view name(size_t metric) const;
+
+  // Index of a metric; with create, adds it if there is room. -1 if not
+  // found or full.
+  int find(std::string_view name, bool create = false);
+
+  // Records value at unix time `now` (seconds). NaN is ignored.
+  void add(int metric, int64_t now, double value);
+
+  // Over the newest `points` buckets of a tier ending at `now`
+  HistorySummary summarize(int metric, size_t tier, size_t points,
+                           int64_t now) const;
+
+  // Bucket averages of a tier, oldest first, ending at `now`; empty
+  // buckets are NaN. Returns the number written (min(points, tier size)).
+  size_t averages(int metric, size_t tier, int64_t now, float* out,
+                  size_t points) const;
+
+ private:
+  struct Header;
+  struct Tier {
+    int64_t* bucket;  // Newest bucket number (time / seconds)
+    float* min;
+    float* max;
+    float* sum;
+    uint32_t* count;
+  };
+
+  uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+  bool read_only_ = false;
+
+  Header* header() const;
+  Tier tier(int metric, size_t t) const;
+  static size_t metric_size();
+  static size_t layout_size(size_t capacity);
+  void reset(size_t capacity);
+};
+
+}  // namespace reed
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "gpu.hpp"
+#include "hwmon.hpp"
+#include "io_stats.hpp"
+#include "sysfs.hpp"
+
+namespace reed {
+
+// Every host sensor as one flat list of named values, sampled together
+// once per tick:
+//   cpu.temp                           C (package)
+//   gpu<N>.busy .temp .clock .vram     percent, C, MHz, MB
+//   net.<iface>.rx .tx                 bytes/s
+//   disk.<dev>.read .write .busy       bytes/s, percent
+//   fan.<chip>/<label>                 RPM
+class HostMetrics {
+ public:
+  explicit HostMetrics(const Config& config, const std::string& root = "");
+
+  void sample();
+
+  size_t count() const { return names_.size(); }
+  const std::string& name(size_t i) const { return names_[i]; }
+  double value(size_t i) const { return values_[i]; }  // NaN = unavailable
+  const std::vector<std::string>& names() const { return names_; }
+  const double* values() const { return values_.data(); }
+
+  // Changes whenever the list of names does (fan hotplug); indices from
+  // an older generation must be looked up again
+  uint64_t generation() const { return generation_; }
+
+ private:
+  GpuMonitor gpus_;
+  NetSampler net_;
+  DiskSampler disks_;
+  FanMonitor fans_;
+  SysfsFile cpu_temp_;
+
+  std::vector<std::string> names_;
+  std::vector<double> values_;
+  uint64_t generation_ = 0;
+  uint64_t fan_discoveries_ = 0;
+
+  void build_names();
+};
+
+}  // namespace reed
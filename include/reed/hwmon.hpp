@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "reed/sysfs.hpp"
+
+namespace reed {
+
+// Fan and pump speeds from every hwmon chip. hwmonN numbering changes
+// between boots, so fans are named "<chip>/<label>" (fanN_label, or
+// "fanN" without one) and listed in name order. Discovery opens each
+// fanN_input once; it runs again only when a hwmon device is added or
+// removed (kernel uevent) or a chip stops answering.
+class FanMonitor {
+ public:
+  // root is prepended to /sys paths, so a fake tree can stand in for /sys
+  explicit FanMonitor(const std::string& root = "");
+  ~FanMonitor();
+
+  FanMonitor(const FanMonitor&) = delete;
+  FanMonitor& operator=(const FanMonitor&) = delete;
+
+  size_t count() const { return fans_.size(); }
+  const std::string& name(size_t i) const { return fans_[i].name; }
+
+  // One pread per fan, after rediscovering if hotplug was seen
+  void update();
+  int rpm(size_t i) const { return rpms_[i]; }  // -1 = unreadable
+
+  uint64_t discoveries() const { return discoveries_; }
+
+ private:
+  struct Fan {
+    std::string name;
+    SysfsFile input;
+  };
+
+  std::string root_;
+  int uevent_fd_ = -1;
+  bool rescan_ = false;
+  std::vector<Fan> fans_;
+  std::vector<int> rpms_;
+  uint64_t discoveries_ = 0;
+
+  void discover();
+  // Drains pending uevents; true if any concerned hwmon
+  bool hotplug_pending();
+};
+
+// The CPU package temperature input of the first CPU sensor chip
+// (coretemp "Package id 0", k10temp/zenpower "Tdie" or "Tctl", or that
+// chip's temp1), empty if there is none. Values are millidegrees.
+std::string find_cpu_temp_input(const std::string& root = "");
+
+}  // namespace reed
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "reed/sysfs.hpp"
+
+namespace reed {
+
+// Increase of a kernel counter between two reads. A counter that went
+// down wrapped at 32 bits only if the old value was just under 2^32 and
+// the wrapped increase is small (under 2^30); otherwise it was reset
+// (interface re-created, device re-attached) and counts as 0.
+uint64_t counter_delta(uint64_t previous, uint64_t current);
+
+// A /proc table with one record per line, keyed by a name in column
+// key_column (columns split on spaces and ':'). Only the wanted keys are
+// parsed. Each key's line offset is remembered, so a read only fetches
+// the file up to the last wanted line and checks the key in place; the
+// index is rebuilt when lines move.
+class ProcTable {
+ public:
+  ProcTable(const std::string& path, int key_column,
+            std::vector<std::string> keys);
+
+  bool is_open() const { return file_.is_open(); }
+  const std::vector<std::string>& keys() const { return keys_; }
+
+  // Re-read the file. Returns false if it could not be read.
+  bool read();
+
+  // Counters following key i in the last read, up to max; returns how
+  // many were parsed, 0 if the key is missing
+  size_t values(size_t i, uint64_t* out, size_t max) const;
+
+  // Index rebuilds so far (1 after the first read)
+  uint64_t reindexes() const { return reindexes_; }
+
+ private:
+  SysfsFile file_;
+  int key_column_;
+  std::vector<std::string> keys_;
+  std::vector<long> offsets_;  // Of the first value after the key; -1 = none
+  std::vector<char> buf_;
+  size_t size_ = 0;
+  size_t want_ = 0;  // Bytes to read next time; 0 = whole file
+  uint64_t reindexes_ = 0;
+
+  bool read_whole();
+  bool check_offsets() const;
+  void reindex();
+};
+
+// Bytes per second for a set of network interfaces, from /proc/net/dev
+class NetSampler {
+ public:
+  // Empty interfaces = every interface with a device behind it in
+  // /sys/class/net. root is prepended to /proc and /sys paths.
+  explicit NetSampler(std::vector<std::string> interfaces = {},
+                      const std::string& root = "");
+
+  size_t count() const { return table_.keys().size(); }
+  const std::string& name(size_t i) const { return table_.keys()[i]; }
+
+  // Read the counters; rates cover the time since the previous sample
+  // and are 0 after the first
+  bool sample();
+  double rx_bytes_per_sec(size_t i) const { return rates_[i].rx; }
+  double tx_bytes_per_sec(size_t i) const { return rates_[i].tx; }
+
+  uint64_t reindexes() const { return table_.reindexes(); }
+
+ private:
+  struct Counters {
+    uint64_t rx = 0;
+    uint64_t tx = 0;
+    bool valid = false;
+  };
+  struct Rates {
+    double rx = 0;
+    double tx = 0;
+  };
+
+  ProcTable table_;
+  std::vector<Counters> last_;
+  std::vector<Rates> rates_;
+  int64_t last_ns_ = 0;
+};
+
+// Read/write bytes per second and utilisation for block devices, from
+// /proc/diskstats
+class DiskSampler {
+ public:
+  // Empty devices = every block device backed by hardware in /sys/block
+  explicit DiskSampler(std::vector<std::string> devices = {},
+                       const std::string& root = "");
+
+  size_t count() const { return table_.keys().size(); }
+  const std::string& name(size_t i) const { return table_.keys()[i]; }
+
+  bool sample();
+  double read_bytes_per_sec(size_t i) const { return rates_[i].read; }
+  double write_bytes_per_sec(size_t i) const { return rates_[i].write; }
+  double busy_percent(size_t i) const { return rates_[i].busy; }
+
+  uint64_t reindexes() const { return table_.reindexes(); }
+
+ private:
+  struct Counters {
+    uint64_t sectors_read = 0;
+    uint64_t sectors_written = 0;
+    uint64_t io_ms = 0;
+    bool valid = false;
+  };
+  struct Rates {
+    double read = 0;
+    double write = 0;
+    double busy = 0;
+  };
+
+  ProcTable table_;
+  std::vector<Counters> last_;
+  std::vector<Rates> rates_;
+  int64_t last_ns_ = 0;
+};
+
+}  // namespace reed
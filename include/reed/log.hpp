@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+namespace reed {
+
+enum class LogLevel { Debug = 0, Info = 1, Warning = 2, Error = 3 };
+
+// One structured field. Keys are upper-case journal field names without
+// the REED_ prefix; values must not contain newlines.
+struct LogField {
+  std::string_view key;
+  std::string_view value;
+};
+
+// Leveled, structured logger. Callers format into a fixed-size slot of a
+// lock-free single-producer/single-consumer ring and return; a background
+// thread does the actual writing, either as native journald entries (when
+// running under systemd) or as text lines on stderr. Nothing on the
+// calling side allocates or takes a lock; the one system call is a futex
+// wake, and only when the writer is asleep on an empty ring.
+//
+// The producer is the first thread that logs (the one driving the Device);
+// other threads fall back to writing synchronously.
+class Log {
+ public:
+  static constexpr size_t SLOTS = 128;
+  static constexpr size_t SLOT_SIZE = 1024;  // Longer records are truncated
+
+  // Warnings and errors with the same message are limited to BURST per
+  // RATE_WINDOW; the next one let through reports how many were dropped
+  static constexpr int BURST = 3;
+  static constexpr int64_t RATE_WINDOW_MS = 60000;
+
+  static void set_level(LogLevel level);
+  static bool enabled(LogLevel level);
+
+  static void write(LogLevel level, std::string_view message,
+                    std::initializer_list<LogField> fields = {});
+
+  // As write(), with data appended as a HEX field
+  static void hex(LogLevel level, std::string_view message,
+                  const uint8_t* data, size_t size,
+                  std::initializer_list<LogField> fields = {});
+
+  // Wait until everything queued so far has been written
+  static void flush();
+
+  // Records lost because the ring was full, or rate limited
+  static uint64_t dropped();
+  static uint64_t suppressed();
+};
+
+}  // namespace reed
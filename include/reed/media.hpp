@@ -1,23 +1,131 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace reed {
 
 enum class MediaType { Unknown, Video, Gif, Image };
 
+// x264 settings for clips converted for the panel. The defaults are x264's
+// own; `reed-tpse encode-bench` measures the alternatives.
+struct EncodeProfile {
+  std::string preset = "medium";
+  int crf = 23;
+  int max_height = 0;  // Downscale to at most this many rows; 0 = keep
+};
+
+// An overlay burned into a background clip in a single encode
+struct CompositeJob {
+  std::string background;  // Video, GIF or still image
+  std::string output;      // Faststart MP4
+  int width = 960;         // Panel resolution
+  int height = 480;
+  int overlay_width = 0;   // Size of the RGBA frames fed in
+  int overlay_height = 0;
+  int overlay_fps = 1;
+  int still_seconds = 10;  // Clip length for a still background
+  // Rendered on demand, so speed over size; max_height is not used, the
+  // output is always panel-sized
+  EncodeProfile encode = {"veryfast", 23, 0};
+};
+
+// Hands out overlay frames (RGBA) in order, nullptr when done. The last
+// frame stays up until the background ends, so a static overlay is one
+// frame.
+using FrameSource = std::function<const std::vector<uint8_t>*()>;
+
+// What a GIF conversion did with the frames
+struct GifStats {
+  size_t frames = 0;
+  size_t unique = 0;  // Frames encoded; the others were merged into these
+  int duration_ms = 0;
+  bool native = false;  // Decoded by reed; false = handed whole to ffmpeg
+};
+
+// A still image re-encoded for the panel
+struct PreparedImage {
+  std::string path;  // Local JPEG to push
+  uint64_t source_bytes = 0;
+  uint64_t bytes = 0;
+  bool cached = false;  // Made by an earlier upload of the same content
+};
+
+// What Media::upload did, for commands that report it
+struct UploadReport {
+  MediaType type = MediaType::Unknown;
+  std::string local_path;  // File pushed: the source or its conversion
+  bool cached = false;     // Conversion reused from an earlier upload
+  GifStats gif;            // Gif, when converted now
+  PreparedImage image;     // Image
+  bool pushed = false;     // false: this content was already there
+};
+
 class Media {
  public:
   static constexpr const char* TMP_DIR = "/tmp/reed-tpse/";
+  static constexpr int PANEL_HEIGHT = 480;
+
+  // Panel width for a screen ratio ("2:1" or "1:1")
+  static int panel_width(const std::string& ratio);
 
   static MediaType detect_type(const std::string& path);
   static std::string get_extension(const std::string& path);
   static std::string get_basename(const std::string& path);
   static std::string get_filename(const std::string& path);
+  // Name on the device after conversion: GIF -> .mp4, image -> .jpg
   static std::string get_converted_name(const std::string& original);
+  // Whether upload converts this file: a GIF, or a local image
+  static bool is_converted(const std::string& path);
+  // Decodes the GIF itself, merges runs of identical or near-identical
+  // frames into one longer frame and has ffmpeg encode only the distinct
+  // ones, at their own durations (variable frame rate). GIFs the decoder
+  // rejects are converted by ffmpeg alone, at the source rate.
   static bool convert_gif_to_mp4(const std::string& input,
-                                 const std::string& output);
+                                 const std::string& output,
+                                 GifStats* stats = nullptr);
+
+  // ffmpeg output options for a profile: the scale filter (even
+  // dimensions, at most max_height rows) and the x264/MP4 settings
+  static std::string encode_args(const EncodeProfile& profile);
+  // Just the x264/MP4 settings, for commands that scale in their own
+  // filter graph
+  static std::string codec_args(const EncodeProfile& profile);
   static bool is_ffmpeg_available();
+
+  // Downsizes an image to cover the panel (never enlarging it), drops its
+  // metadata and re-encodes it as JPEG. Results are cached in TMP_DIR by
+  // content hash and panel size, so an unchanged image is only hashed.
+  static std::optional<PreparedImage> prepare_image(const std::string& path,
+                                                    const std::string& ratio);
+
+  // Encodes an RGBA frame (width * height * 4 bytes) to a PNG with ffmpeg
+  static bool write_png(const std::string& path, int width, int height,
+                        const std::vector<uint8_t>& rgba);
+
+  // Decodes the background, scales and crops it to the panel and overlays
+  // the frames piped in, all in one ffmpeg filter graph, so the result is
+  // encoded once
+  static bool composite(const CompositeJob& job, const FrameSource& frames);
+
+  // Convert if needed (GIF -> MP4, image -> panel-sized JPEG) and push to
+  // the device, verifying the remote size. Conversions are cached in
+  // TMP_DIR by content hash. The push is skipped only when the last push
+  // under this name was the same content and the remote size still
+  // matches. Returns the remote file name.
+  static std::optional<std::string> upload(const std::string& path,
+                                           const std::string& ratio = "2:1",
+                                           UploadReport* report = nullptr);
+
+  // Uploads a bank of files sharing a name prefix (already in a format the
+  // panel plays) with three adb invocations in total rather than three per
+  // file: list what is there, push what is missing or differs, verify.
+  // Returns the number of files pushed.
+  static std::optional<size_t> upload_bank(
+      const std::vector<std::string>& paths, const std::string& prefix);
 };
 
 }  // namespace reed
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+
+namespace reed {
+
+struct Rect {
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+};
+
+// Renders an overlay layout (overlay.json) into an RGBA frame. The layout is
+// compiled once: rect and text widgets are drawn into a cached background,
+// and the rest become a flat draw list with fonts resolved, metrics bound
+// to value slots and fixed text turned into glyph runs. Each update then
+// re-rasterises only the widgets whose shown value changed, on top of the
+// background restored under them.
+class OverlayRenderer {
+ public:
+  // Binds widgets to metric names. Widgets naming an unknown metric or
+  // font are dropped, one message each.
+  std::vector<std::string> compile(const OverlayLayout& layout,
+                                   const std::vector<std::string>& metrics);
+
+  // values holds one value per metric name given to compile() (NaN shows
+  // as "--" or an empty bar). Returns the areas of the frame that changed;
+  // the first update after compile() redraws everything.
+  const std::vector<Rect>& update(const double* values);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  const std::vector<uint8_t>& pixels() const { return pixels_; }  // RGBA
+
+  size_t widgets() const { return ops_.size(); }
+
+  // Widgets drawn by the last update(); the rest were left alone
+  size_t drawn() const { return drawn_; }
+
+ private:
+  static constexpr size_t MAX_RUN = 40;
+
+  struct Op {
+    WidgetType type;
+    size_t slot;
+    int x, y, width, height;  // Bar box; value anchor (x may be the right)
+    int scale;
+    bool align_right;
+    uint32_t color;
+    uint32_t track;
+    int decimals;
+    double divisor;
+    double min, max;
+    size_t unit_offset, unit_length;  // Precomputed run in units_
+
+    bool valid = false;     // Drawn at least once
+    int64_t shown = 0;      // Quantized value on the panel
+    Rect box;               // Where it was drawn
+    // Glyphs of the value being drawn
+    std::array<uint8_t, MAX_RUN> run;
+    size_t run_length = 0;
+  };
+
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<uint8_t> background_;
+  std::vector<uint8_t> pixels_;
+  std::vector<Op> ops_;
+  std::vector<uint8_t> units_;
+  std::vector<Rect> restored_;
+  std::vector<Rect> dirty_;  // restored_ plus boxes drawn again over them
+  std::vector<uint8_t> redraw_;
+  size_t drawn_ = 0;
+  bool fresh_ = false;  // Compiled, nothing handed out yet
+
+  int64_t quantize(const Op& op, double value) const;
+  void layout_value(Op& op, double value);
+  Rect box_of(const Op& op) const;
+  void draw(const Op& op);
+  void restore(const Rect& rect);
+
+  void fill(std::vector<uint8_t>& target, Rect rect, uint32_t color,
+            uint8_t alpha = 255);
+  void draw_run(std::vector<uint8_t>& target, const uint8_t* run,
+                size_t length, int x, int y, int scale, uint32_t color);
+};
+
+}  // namespace reed
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "event_loop.hpp"
+
+namespace reed {
+
+// Coalesces bursts of saves to one file. The first update after an idle
+// period arms a one-shot timer; updates arriving before it fires only
+// replace the pending content. Each flush is an atomic replace.
+class DebouncedWriter {
+ public:
+  DebouncedWriter(EventLoop& loop, std::string path,
+                  std::chrono::milliseconds delay);
+  ~DebouncedWriter();
+
+  DebouncedWriter(const DebouncedWriter&) = delete;
+  DebouncedWriter& operator=(const DebouncedWriter&) = delete;
+
+  void set_delay(std::chrono::milliseconds delay) { delay_ = delay; }
+  void update(std::string content);
+
+  // Write pending content now. Returns false if the write failed.
+  bool flush();
+  bool pending() const { return pending_; }
+
+  // Write amplification = writes / updates
+  uint64_t updates() const { return updates_; }
+  uint64_t writes() const { return writes_; }
+  uint64_t bytes_written() const { return bytes_written_; }
+  uint64_t failures() const { return failures_; }
+
+ private:
+  EventLoop& loop_;
+  std::string path_;
+  std::chrono::milliseconds delay_;
+  std::string content_;
+  std::string written_;
+  bool pending_ = false;
+  int timer_ = -1;
+
+  uint64_t updates_ = 0;
+  uint64_t writes_ = 0;
+  uint64_t bytes_written_ = 0;
+  uint64_t failures_ = 0;
+};
+
+}  // namespace reed
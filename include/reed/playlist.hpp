@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "config.hpp"
+#include "event_loop.hpp"
+
+namespace reed {
+
+// Host-driven rotation of display content. Slots are scheduled on an
+// absolute CLOCK_REALTIME timerfd, chained from the previous deadline so
+// errors never accumulate. The asset for the next slot is uploaded and
+// verified on a worker thread while the current slot plays; the result
+// comes back to the loop through an eventfd, so the loop never waits on
+// ADB. A slot whose asset is not ready yet switches when it lands.
+class PlaylistScheduler {
+ public:
+  using Clock = std::chrono::system_clock;
+  // Runs on the loop thread when a slot begins; remote_name is the
+  // verified file name on the device
+  using SwitchFn = std::function<void(const PlaylistItem& item,
+                                      const std::string& remote_name)>;
+
+  PlaylistScheduler(EventLoop& loop, SwitchFn on_switch, bool verbose = false);
+  ~PlaylistScheduler();
+
+  PlaylistScheduler(const PlaylistScheduler&) = delete;
+  PlaylistScheduler& operator=(const PlaylistScheduler&) = delete;
+
+  // Replaces any running playlist; the first eligible item starts now
+  bool start(const Playlist& playlist);
+  void stop();
+  bool active() const { return !playlist_.items.empty(); }
+
+  uint64_t switches() const { return switches_; }
+  int64_t max_jitter_us() const { return max_jitter_us_; }
+
+  // Upload (converting GIFs) or look up an item's media on the device and
+  // confirm its size. Blocking, so run on a worker; returns the remote
+  // name.
+  static std::optional<std::string> prepare_asset(const std::string& media,
+                                                  bool verbose = false);
+
+ private:
+  static constexpr size_t NONE = static_cast<size_t>(-1);
+
+  EventLoop& loop_;
+  SwitchFn on_switch_;
+  bool verbose_;
+
+  Playlist playlist_;
+  int alarm_ = -1;
+  size_t current_ = NONE;
+  size_t next_ = NONE;
+  Clock::time_point next_start_;
+
+  // media -> remote name from its latest verification; only touched on
+  // the loop thread. Every slot verifies again before it starts, so a
+  // file removed from the device drops out.
+  std::map<std::string, std::string> prepared_;
+
+  // Shared with the upload workers, which may outlive this scheduler
+  struct Uploads;
+  std::shared_ptr<Uploads> uploads_;
+  uint64_t last_ticket_ = 0;
+  uint64_t upload_ticket_ = 0;    // Of the upload in flight; 0 for none
+  size_t upload_index_ = NONE;    // Item being uploaded
+  size_t queued_index_ = NONE;    // Item to upload once that finishes
+  size_t waiting_index_ = NONE;   // Slot that began before its upload ended
+  Clock::time_point waiting_scheduled_;
+  std::chrono::microseconds waiting_jitter_{0};
+
+  uint64_t switches_ = 0;
+  int64_t max_jitter_us_ = 0;
+
+  void schedule_after(Clock::time_point slot_start);
+  void on_alarm();
+  void begin_preload(size_t index);
+  void start_upload(size_t index);
+  void on_uploaded();
+  void switch_to(size_t index, Clock::time_point scheduled,
+                 std::chrono::microseconds jitter);
+  void show(size_t index, const std::optional<std::string>& remote,
+            Clock::time_point scheduled, std::chrono::microseconds jitter);
+};
+
+}  // namespace reed
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace reed {
+
+struct ProcessUsage {
+  int pid = 0;
+  char name[16] = {};  // comm, NUL-terminated
+  double cpu_percent = 0;  // Of one CPU, since the previous scan
+  uint64_t rss_kb = 0;
+};
+
+enum class ProcessOrder { Cpu, Memory };
+
+// Top-N processes by CPU or memory. A scan lists /proc with getdents64
+// into a fixed buffer and reads one small file per process, relative to
+// the /proc fd: <pid>/schedstat for CPU order, <pid>/statm for memory
+// order. Those files are kept open in a PID-keyed open-addressing table
+// (within a share of RLIMIT_NOFILE), so an unchanged process costs one
+// pread. The top N are picked with a bounded heap and only they get their
+// name and other metric read. Nothing is allocated once the table has
+// grown to the process count.
+class ProcessScanner {
+ public:
+  explicit ProcessScanner(const std::string& proc = "/proc");
+  ~ProcessScanner();
+
+  ProcessScanner(const ProcessScanner&) = delete;
+  ProcessScanner& operator=(const ProcessScanner&) = delete;
+
+  bool is_open() const { return proc_fd_ >= 0; }
+
+  // Returns false if /proc could not be read
+  bool scan(size_t n, ProcessOrder order = ProcessOrder::Cpu);
+
+  // Highest first; at most n entries
+  const std::vector<ProcessUsage>& top() const { return top_; }
+  size_t processes() const { return processes_; }
+  size_t open_files() const { return open_files_; }
+
+ private:
+  struct Slot {
+    int32_t pid = 0;  // 0 = empty
+    int cpu_fd = -1;
+    int mem_fd = -1;
+    uint64_t runtime_ns = 0;
+    int64_t sampled_ns = 0;  // 0 = no CPU baseline yet
+  };
+
+  int proc_fd_ = -1;
+  bool has_schedstat_ = false;  // Else CPU time comes from <pid>/stat
+  long tick_ns_;
+  long page_kb_;
+  size_t file_budget_ = 0;
+  size_t open_files_ = 0;
+
+  // Previous and current scan; swapped after each scan. A slot's fds move
+  // with it, and whatever is left in the previous table belonged to a
+  // process that exited.
+  std::vector<Slot> previous_;
+  std::vector<Slot> current_;
+  size_t processes_ = 0;
+
+  std::vector<ProcessUsage> top_;
+
+  void reserve_slots(size_t processes);
+  Slot* find(std::vector<Slot>& table, int32_t pid);
+  Slot* insert(std::vector<Slot>& table, int32_t pid);
+  void close_slot(Slot& slot);
+
+  // Reads <pid>/<file> through the slot's cached fd (opening it within the
+  // budget) into buf; returns bytes read, <= 0 if the process is gone
+  long read_file(Slot& slot, int& fd, const char* file, char* buf,
+                 size_t size);
+  bool sample_cpu(Slot& slot, int64_t now, double& percent);
+  bool sample_rss(Slot& slot, uint64_t& rss_kb);
+  void read_name(int pid, char (&name)[16]);
+};
+
+}  // namespace reed
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "picojson.h"
@@ -20,6 +22,15 @@ struct Response {
   std::string status;
 };
 
+// Parsed response that points into the buffer it was parsed from; valid
+// until that buffer is modified
+struct FrameView {
+  std::string_view message;  // Everything between length and CRC
+  std::string_view body;
+  std::string_view version;
+  std::string_view status;
+};
+
 // Calculate CRC (sum of all bytes & 0xFF)
 uint8_t calculate_crc(const std::vector<uint8_t>& data);
 
@@ -39,4 +50,25 @@ std::vector<uint8_t> build_frame(const std::string& request_state,
 // Parse a response frame
 std::optional<Response> parse_response(const std::vector<uint8_t>& data);
 
+// Owning copy of a view, with the body parsed as JSON
+Response to_response(const FrameView& view);
+
+// Allocation-free variants for the keepalive path: buffers are cleared and
+// refilled, so once their capacity covers the largest frame no memory is
+// allocated.
+void build_frame_into(std::vector<uint8_t>& out, std::string_view request_state,
+                      std::string_view cmd_type, std::string_view content,
+                      std::string_view version, int ack_number);
+
+// Unescapes data[0, size) into scratch and parses it in place
+std::optional<FrameView> parse_frame(const uint8_t* data, size_t size,
+                                     std::vector<uint8_t>& scratch);
+
+// Whether text is well-formed JSON, without building a DOM
+bool is_valid_json(std::string_view text);
+
+// Pump speed if the device reports one: the first numeric member whose key
+// contains "pump" (any case, any depth). Scans in place, no allocation.
+std::optional<int> find_pump_rpm(std::string_view json);
+
 }  // namespace reed
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace reed {
+
+// Fixed-capacity byte FIFO whose storage is mapped twice back to back, so
+// the readable bytes and the free space are each one contiguous span no
+// matter where they wrap. Readers get pointers straight into the buffer;
+// nothing is ever copied or compacted.
+class RingBuffer {
+ public:
+  // capacity is rounded up to a whole number of pages
+  explicit RingBuffer(size_t capacity);
+  ~RingBuffer();
+
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer& operator=(const RingBuffer&) = delete;
+
+  bool is_valid() const { return base_ != nullptr; }
+  size_t capacity() const { return capacity_; }
+  size_t size() const { return static_cast<size_t>(tail_ - head_); }
+  size_t free_space() const { return capacity_ - size(); }
+
+  // size() readable bytes
+  const uint8_t* data() const { return base_ + head_ % capacity_; }
+  void consume(size_t n);
+
+  // free_space() writable bytes; commit() what was written
+  uint8_t* write_ptr() { return base_ + tail_ % capacity_; }
+  void commit(size_t n);
+
+  void clear() { head_ = tail_; }
+
+  // Highest size() ever reached
+  size_t peak() const { return peak_; }
+
+ private:
+  uint8_t* base_ = nullptr;
+  size_t capacity_ = 0;
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  size_t peak_ = 0;
+};
+
+}  // namespace reed
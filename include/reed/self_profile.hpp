@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "sysfs.hpp"
+
+namespace reed {
+
+// What this process has cost since it started
+struct SelfUsage {
+  int64_t cpu_us = 0;  // task-clock, all threads
+  uint64_t context_switches = 0;
+  uint64_t page_faults = 0;
+  int64_t run_delay_us = 0;  // Main thread runnable but not running
+  uint64_t rss_kb = 0;       // VmRSS
+  uint64_t rss_peak_kb = 0;  // VmHWM
+};
+
+// Reads the process's own cost: perf_event_open software counters
+// (task-clock, context switches, page faults) counting every thread started
+// after open(), plus /proc/self/schedstat and /proc/self/status. Where perf
+// events are not allowed (perf_event_paranoid 3, seccomp), the three
+// counters come from getrusage() instead.
+class SelfProfiler {
+ public:
+  SelfProfiler() = default;
+  ~SelfProfiler();
+
+  SelfProfiler(const SelfProfiler&) = delete;
+  SelfProfiler& operator=(const SelfProfiler&) = delete;
+
+  void open();
+  bool uses_perf() const { return task_clock_fd_ >= 0; }
+
+  SelfUsage read() const;
+
+ private:
+  int task_clock_fd_ = -1;
+  int switches_fd_ = -1;
+  int faults_fd_ = -1;
+  SysfsFile schedstat_;
+  SysfsFile status_;
+};
+
+// CPU time over the last hour, from cumulative readings taken once a
+// minute. Until an hour has passed, what was used so far is scaled up.
+class CpuWindow {
+ public:
+  static constexpr size_t MINUTES = 60;
+
+  void add(int64_t cpu_us);
+  size_t minutes() const { return count_ > 0 ? count_ - 1 : 0; }
+
+  // 0 until two readings are in
+  int64_t per_hour_us() const;
+
+ private:
+  std::array<int64_t, MINUTES + 1> readings_{};
+  size_t next_ = 0;
+  size_t count_ = 0;
+};
+
+}  // namespace reed
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "adb.hpp"
+#include "device.hpp"
+
+namespace reed {
+
+struct CommandResult {
+  bool ok = false;
+  std::string output;
+  std::chrono::microseconds elapsed{0};
+  bool serial = false;  // Ran on the serial link (vs. adb only)
+};
+
+// Runs CLI-style commands ("brightness 50", "upload a.gif") against one
+// connected Device and one persistent adb shell. ADB work (upload, list,
+// delete) runs on a worker thread in submission order, overlapping serial
+// commands; display first waits for earlier ADB work, since it may name a
+// file that is still being uploaded. Results come back in submission order.
+class Session {
+ public:
+  explicit Session(Device& device);
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+  // Words of one command line, honouring '...' and "..." quoting. A '#'
+  // at the start of a word begins a comment.
+  static std::vector<std::string> split(const std::string& line);
+
+  // Queue one command; returns false for an unknown command
+  bool submit(const std::vector<std::string>& args);
+
+  // Results that are ready, in submission order; with wait, all of them
+  std::vector<CommandResult> collect(bool wait);
+
+  // Submit and wait for just this command
+  CommandResult run(const std::vector<std::string>& args);
+
+  static std::string help();
+
+ private:
+  Device& device_;
+  AdbShell shell_;
+  bool shell_tried_ = false;
+
+  std::deque<std::shared_future<CommandResult>> pending_;
+  std::shared_future<CommandResult> last_adb_;
+
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::packaged_task<CommandResult()>> queue_;
+  bool stopping_ = false;
+
+  void worker_loop();
+  void submit_adb(std::function<CommandResult()> job);
+  void submit_serial(std::function<CommandResult()> job);
+
+  CommandResult cmd_info();
+  CommandResult cmd_brightness(const std::vector<std::string>& args);
+  CommandResult cmd_display(const std::vector<std::string>& args);
+  CommandResult cmd_sleep(const std::vector<std::string>& args);
+  CommandResult cmd_upload(const std::string& file);
+  CommandResult cmd_list();
+  CommandResult cmd_delete(const std::vector<std::string>& files);
+
+  AdbShell* adb_shell();
+};
+
+}  // namespace reed
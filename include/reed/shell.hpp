@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace reed {
+
+// Wraps arg in single quotes for /bin/sh (and adb shell), so spaces,
+// quotes and metacharacters in file names pass through literally
+std::string shell_quote(const std::string& arg);
+
+}  // namespace reed
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace reed {
+
+constexpr uint32_t STATUS_MAGIC = 0x44454552;  // "REED" little-endian
+constexpr uint32_t STATUS_VERSION = 7;
+
+constexpr uint8_t OVER_CPU_BUDGET = 1;
+constexpr uint8_t OVER_RSS_BUDGET = 2;
+
+// Snapshot of daemon health. Trivially copyable so it can live in shared
+// memory; all strings are NUL-terminated and truncated to fit.
+struct DaemonStatus {
+  int32_t pid = 0;
+  int32_t brightness = 0;
+  int64_t started_at_ms = 0;      // Unix epoch
+  int64_t last_keepalive_ms = 0;  // Unix epoch, 0 = none yet
+  uint32_t rtt_p50_us = 0;
+  uint32_t rtt_p90_us = 0;
+  uint32_t rtt_p99_us = 0;
+  uint32_t rtt_max_us = 0;
+  uint64_t keepalives_ok = 0;
+  uint64_t keepalive_failures = 0;
+  uint64_t command_failures = 0;
+  uint64_t playlist_switches = 0;
+  int64_t playlist_jitter_max_us = 0;  // Worst timer wake vs. deadline
+  uint64_t control_requests = 0;  // Commands routed from other processes
+  uint64_t control_failures = 0;
+  uint32_t control_max_us = 0;     // Slowest routed command
+  uint32_t port_lock_wait_us = 0;  // Waited for the port at start-up
+  uint32_t rx_capacity_bytes = 0;
+  uint32_t rx_peak_bytes = 0;     // Fullest the receive buffer has been
+  uint64_t rx_stale_frames = 0;   // Replies nobody was waiting for
+  int32_t pump_rpm = -1;          // From the device's replies; -1 = none
+  uint64_t alert_switches = 0;    // Screen/brightness changes by alerts
+  uint32_t alert_latency_us = 0;  // Sample to frame written, last switch
+  uint32_t alert_latency_max_us = 0;
+  // The daemon's own cost, measured once a minute
+  int64_t self_cpu_us = 0;       // Since start, all threads
+  int64_t self_cpu_hour_us = 0;  // Over the last hour
+  int64_t self_run_delay_us = 0;  // Main thread waiting for a CPU
+  uint64_t self_context_switches = 0;
+  uint64_t self_page_faults = 0;
+  uint64_t self_wakeups = 0;  // Event loop wake-ups
+  uint32_t self_rss_kb = 0;
+  uint32_t self_rss_peak_kb = 0;
+  uint8_t self_perf = 0;    // 1 = perf event counters, 0 = getrusage
+  uint8_t over_budget = 0;  // OVER_CPU_BUDGET | OVER_RSS_BUDGET
+  char port[64] = {};
+  char media[192] = {};
+  char alert[48] = {};  // Rule holding the screen or brightness
+};
+
+// On-disk/in-memory layout of the status file. Readers map it and copy
+// `status` under the seqlock: retry while `seq` is odd or changed.
+struct StatusPageLayout {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;  // sizeof(StatusPageLayout) of the writer
+  std::atomic<uint32_t> seq;
+  DaemonStatus status;
+};
+
+// Rolling window of recent round-trip times for percentile reporting
+class RttWindow {
+ public:
+  static constexpr size_t CAPACITY = 64;
+
+  void add(uint32_t rtt_us);
+  size_t size() const { return count_; }
+
+  // p in [0, 100]; returns 0 when empty
+  uint32_t percentile(int p) const;
+
+ private:
+  std::array<uint32_t, CAPACITY> samples_{};
+  size_t next_ = 0;
+  size_t count_ = 0;
+};
+
+// Daemon-side publisher of a seqlock-protected status page in tmpfs
+class StatusPage {
+ public:
+  StatusPage() = default;
+  ~StatusPage();
+
+  StatusPage(const StatusPage&) = delete;
+  StatusPage& operator=(const StatusPage&) = delete;
+
+  bool create(const std::string& path);
+  void publish(const DaemonStatus& status);
+  void close();
+
+  // Lock-free read of a page published by another process
+  static std::optional<DaemonStatus> read(const std::string& path);
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+  StatusPageLayout* page_ = nullptr;
+};
+
+// Copy a string into a fixed char array, always NUL-terminating
+template <size_t N>
+void copy_status_string(char (&dst)[N], const std::string& src) {
+  size_t n = src.size() < N - 1 ? src.size() : N - 1;
+  src.copy(dst, n);
+  dst[n] = '\0';
+}
+
+}  // namespace reed
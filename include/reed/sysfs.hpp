@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace reed {
+
+// A sysfs or procfs attribute opened once and re-read with pread, so each
+// sample costs one system call and no path lookup
+class SysfsFile {
+ public:
+  SysfsFile() = default;
+  explicit SysfsFile(const std::string& path) { open(path); }
+  ~SysfsFile();
+
+  SysfsFile(SysfsFile&& other) noexcept;
+  SysfsFile& operator=(SysfsFile&& other) noexcept;
+  SysfsFile(const SysfsFile&) = delete;
+  SysfsFile& operator=(const SysfsFile&) = delete;
+
+  bool open(const std::string& path);
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+  int fd() const { return fd_; }
+
+  // Whole contents from offset 0, NUL-terminated; returns bytes read, or
+  // -1 with errno set
+  long read(char* buf, size_t size) const;
+
+  // First integer in the file. When given, *error is set to the errno of
+  // a failed read, or 0 if the read worked (even if no integer was there).
+  std::optional<int64_t> read_int(int* error = nullptr) const;
+
+  // Contents with the trailing newline removed (for one-off reads)
+  static std::optional<std::string> read_string(const std::string& path);
+
+ private:
+  int fd_ = -1;
+};
+
+}  // namespace reed
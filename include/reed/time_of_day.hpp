@@ -0,0 +1,15 @@
+#pragma once
+
+#include <chrono>
+
+namespace reed {
+
+// Local wall-clock helpers shared by the daemon's daily schedules. Minutes
+// are counted from local midnight.
+int minute_of_day(std::chrono::system_clock::time_point t);
+
+// First local time strictly after `after` whose wall clock reads `minute`
+std::chrono::system_clock::time_point next_occurrence(
+    int minute, std::chrono::system_clock::time_point after);
+
+}  // namespace reed
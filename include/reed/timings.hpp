@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace reed {
+
+// Per-phase wall and CPU time for `--timings`. Phases are ScopedTimers;
+// a timer opened while another is open on the same thread becomes its
+// child, so the phases form a tree. Recording is off by default, and a
+// disabled timer costs one relaxed atomic load.
+//
+// CPU time is the thread's own plus that of child processes (adb, ffmpeg)
+// reaped while the phase was open, so it is exact for the single-threaded
+// CLI commands and approximate when uploads run alongside.
+class Timings {
+ public:
+  // Phases past this many are counted but not kept (a daemon left running
+  // with --timings must not grow without bound)
+  static constexpr size_t MAX_PHASES = 100000;
+
+  static void enable();
+  static bool enabled();
+
+  // The phase tree, one line per phase with wall and CPU milliseconds.
+  // Repeats of a phase under the same parent share a line with a count.
+  static void print(std::ostream& out);
+
+  // Every phase as a Chrome trace event ("ph":"X"), for chrome://tracing
+  // or ui.perfetto.dev
+  static bool write_trace(const std::string& path);
+};
+
+class ScopedTimer {
+ public:
+  // The phase is called "name", or "name detail" when detail is given
+  explicit ScopedTimer(std::string_view name, std::string_view detail = {});
+  ~ScopedTimer();
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  long index_ = -1;  // The phase recorded; -1 when not recording
+  long parent_ = -1;
+};
+
+}  // namespace reed
@@ -1,10 +1,21 @@
 #include "reed/adb.hpp"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <array>
+#include <cctype>
 #include <cstdio>
+#include <cstdlib>
 #include <memory>
 #include <sstream>
 
+#include "reed/shell.hpp"
+#include "reed/timings.hpp"
+
 namespace reed {
 
 namespace {
@@ -13,10 +24,31 @@ struct PipeCloser {
     if (f) pclose(f);
   }
 };
+
+constexpr const char* SHELL_DONE_MARKER = "__reed_done__";
+
+std::vector<std::string> split_lines(const std::string& text) {
+  std::vector<std::string> lines;
+  std::istringstream iss(text);
+  std::string line;
+
+  while (std::getline(iss, line)) {
+    while (!line.empty() &&
+           (line.back() == '\r' || line.back() == '\n' || line.back() == ' ')) {
+      line.pop_back();
+    }
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+
+  return lines;
+}
 }  // namespace
 
 std::optional<std::string> Adb::run_command(
     const std::vector<std::string>& args) {
+  ScopedTimer timer("adb", args.empty() ? std::string() : args[0]);
   std::string cmd = "adb";
   for (const auto& arg : args) {
     cmd += " ";
@@ -94,27 +126,192 @@ std::optional<std::vector<std::string>> Adb::list_media() {
     return std::vector<std::string>{};
   }
 
-  std::vector<std::string> files;
-  std::istringstream iss(*result);
-  std::string line;
+  return split_lines(*result);
+}
 
-  while (std::getline(iss, line)) {
-    while (!line.empty() &&
-           (line.back() == '\r' || line.back() == '\n' || line.back() == ' ')) {
-      line.pop_back();
+bool Adb::remove(const std::string& filename) {
+  std::string remote_path = std::string(MEDIA_PATH) + filename;
+  auto result = run_command({"shell", "rm", remote_path});
+
+  return result && result->find("No such file") == std::string::npos;
+}
+
+std::optional<uint64_t> Adb::remote_size(const std::string& filename) {
+  std::string remote_path = std::string(MEDIA_PATH) + filename;
+  auto result = run_command({"shell", "stat", "-c", "%s", remote_path});
+
+  if (!result || result->empty() ||
+      !std::isdigit(static_cast<unsigned char>(result->front()))) {
+    return std::nullopt;
+  }
+
+  return std::strtoull(result->c_str(), nullptr, 10);
+}
+
+bool Adb::push_all(const std::vector<std::string>& local_paths) {
+  if (local_paths.empty()) {
+    return true;
+  }
+  std::vector<std::string> args = {"push"};
+  args.insert(args.end(), local_paths.begin(), local_paths.end());
+  args.push_back(MEDIA_PATH);
+  auto result = run_command(args);
+
+  return result && result->find("pushed") != std::string::npos &&
+         result->find("error:") == std::string::npos;
+}
+
+std::optional<std::map<std::string, uint64_t>> Adb::remote_sizes(
+    const std::string& glob) {
+  // "<size> <path>" per file; an unmatched glob is a stat error, i.e. none
+  auto result = run_command(
+      {"shell", "stat -c '%s %n' " + std::string(MEDIA_PATH) + glob});
+  if (!result) {
+    return std::nullopt;
+  }
+
+  std::map<std::string, uint64_t> sizes;
+  for (const auto& line : split_lines(*result)) {
+    size_t space = line.find(' ');
+    if (space == std::string::npos ||
+        !std::isdigit(static_cast<unsigned char>(line.front()))) {
+      continue;
     }
-    if (!line.empty()) {
-      files.push_back(line);
+    size_t slash = line.rfind('/');
+    std::string name = line.substr(
+        slash == std::string::npos || slash < space ? space + 1 : slash + 1);
+    sizes[name] = std::strtoull(line.c_str(), nullptr, 10);
+  }
+  return sizes;
+}
+
+AdbShell::~AdbShell() {
+  stop();
+}
+
+bool AdbShell::start() {
+  ScopedTimer timer("adb shell start");
+  stop();
+
+  int to_child[2];
+  int from_child[2];
+  if (pipe2(to_child, O_CLOEXEC) != 0) {
+    return false;
+  }
+  if (pipe2(from_child, O_CLOEXEC) != 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    close(from_child[0]);
+    close(from_child[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    dup2(to_child[0], STDIN_FILENO);
+    dup2(from_child[1], STDOUT_FILENO);
+    dup2(from_child[1], STDERR_FILENO);
+    execlp("adb", "adb", "shell", static_cast<char*>(nullptr));
+    _exit(127);
+  }
+
+  close(to_child[0]);
+  close(from_child[1]);
+  pid_ = pid;
+  in_fd_ = to_child[1];
+  out_fd_ = from_child[0];
+  buffer_.clear();
+
+  // Round trip once so a missing device fails here, not on first use
+  return run("true").has_value();
+}
+
+void AdbShell::stop() {
+  if (in_fd_ >= 0) {
+    close(in_fd_);  // EOF makes the remote shell exit
+    in_fd_ = -1;
+  }
+  if (out_fd_ >= 0) {
+    close(out_fd_);
+    out_fd_ = -1;
+  }
+  if (pid_ > 0) {
+    kill(pid_, SIGTERM);
+    waitpid(pid_, nullptr, 0);
+    pid_ = -1;
+  }
+}
+
+std::optional<std::string> AdbShell::run(const std::string& command,
+                                         int timeout_ms) {
+  if (pid_ <= 0) {
+    return std::nullopt;
+  }
+  ScopedTimer timer("adb shell");
+
+  std::string line = command + " 2>&1; echo " + SHELL_DONE_MARKER + "\n";
+  const char* p = line.data();
+  size_t left = line.size();
+  while (left > 0) {
+    ssize_t n = write(in_fd_, p, left);
+    if (n <= 0) {
+      stop();
+      return std::nullopt;
     }
+    p += n;
+    left -= static_cast<size_t>(n);
   }
 
-  return files;
+  std::string marker = std::string(SHELL_DONE_MARKER) + "\n";
+  struct pollfd pfd;
+  pfd.fd = out_fd_;
+  pfd.events = POLLIN;
+
+  while (true) {
+    size_t end = buffer_.find(marker);
+    if (end != std::string::npos) {
+      std::string output = buffer_.substr(0, end);
+      buffer_.erase(0, end + marker.size());
+      return output;
+    }
+
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+      stop();
+      return std::nullopt;
+    }
+
+    char buf[4096];
+    ssize_t n = read(out_fd_, buf, sizeof(buf));
+    if (n <= 0) {
+      stop();
+      return std::nullopt;
+    }
+    buffer_.append(buf, static_cast<size_t>(n));
+  }
 }
 
-bool Adb::remove(const std::string& filename) {
-  std::string remote_path = std::string(MEDIA_PATH) + filename;
-  auto result = run_command({"shell", "rm", remote_path});
+std::optional<std::vector<std::string>> AdbShell::list_media() {
+  auto result = run(std::string("ls -1 ") + Adb::MEDIA_PATH);
+  if (!result) {
+    return std::nullopt;
+  }
+
+  if (result->find("No such file") != std::string::npos) {
+    return std::vector<std::string>{};
+  }
+
+  return split_lines(*result);
+}
 
+bool AdbShell::remove(const std::string& filename) {
+  auto result = run("rm " + shell_quote(std::string(Adb::MEDIA_PATH) +
+                                        filename));
   return result && result->find("No such file") == std::string::npos;
 }
 
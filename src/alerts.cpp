@@ -0,0 +1,97 @@
+#include "reed/alerts.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace reed {
+
+std::vector<std::string> AlertEngine::compile(
+    const std::vector<AlertRule>& rules, const std::vector<std::string>& names,
+    int interval_ms) {
+  std::vector<std::string> errors;
+
+  std::unordered_map<std::string, bool> was_active;
+  for (const State& state : rules_) {
+    was_active.emplace(state.rule.name, state.active);
+  }
+
+  std::unordered_map<std::string, size_t> slots;
+  for (size_t i = 0; i < names.size(); ++i) {
+    slots.emplace(names[i], i);
+  }
+
+  rules_.clear();
+  for (const AlertRule& rule : rules) {
+    auto slot = slots.find(rule.metric);
+    if (slot == slots.end()) {
+      errors.push_back(rule.name + ": unknown metric " + rule.metric);
+      continue;
+    }
+
+    State state;
+    state.rule = rule;
+    state.slot = slot->second;
+    int64_t ms = static_cast<int64_t>(rule.hold_seconds) * 1000;
+    int interval = std::max(1, interval_ms);
+    state.hold_samples =
+        static_cast<int>(std::max<int64_t>(1, (ms + interval - 1) / interval));
+    auto it = was_active.find(rule.name);
+    state.active = it != was_active.end() && it->second;
+    state.value = NAN;
+    rules_.push_back(state);
+  }
+
+  changed_.clear();
+  changed_.reserve(rules_.size());
+  return errors;
+}
+
+const std::vector<size_t>& AlertEngine::update(const double* values) {
+  changed_.clear();
+
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    State& s = rules_[i];
+    double v = values[s.slot];
+    s.value = v;
+    if (std::isnan(v)) {
+      s.pending = 0;
+      continue;
+    }
+
+    bool toward_other;
+    if (!s.active) {
+      toward_other = s.rule.above ? v > s.rule.threshold : v < s.rule.threshold;
+    } else {
+      toward_other = s.rule.above ? v <= s.rule.clear : v >= s.rule.clear;
+    }
+
+    s.pending = toward_other ? s.pending + 1 : 0;
+    if (s.pending >= s.hold_samples) {
+      s.active = !s.active;
+      s.pending = 0;
+      changed_.push_back(i);
+    }
+  }
+  return changed_;
+}
+
+int AlertEngine::screen_rule() const {
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    if (rules_[i].active && !rules_[i].rule.media.empty()) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+int AlertEngine::brightness_rule() const {
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    if (rules_[i].active && rules_[i].rule.brightness >= 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+}  // namespace reed
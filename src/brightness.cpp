@@ -0,0 +1,186 @@
+#include "reed/brightness.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "reed/time_of_day.hpp"
+
+namespace reed {
+
+namespace {
+
+using WallClock = std::chrono::system_clock;
+
+// The point in effect right now: the latest one at or before the current
+// minute, or yesterday's last one if today's first hasn't been reached
+const BrightnessPoint& active_point(const std::vector<BrightnessPoint>& points,
+                                    WallClock::time_point now) {
+  int m = minute_of_day(now);
+  const BrightnessPoint* active = &points.back();
+  for (const auto& point : points) {
+    if (point.minute <= m) {
+      active = &point;
+    }
+  }
+  return *active;
+}
+
+}  // namespace
+
+BrightnessAnimator::BrightnessAnimator(EventLoop& loop, SendFn send)
+    : loop_(loop), send_(std::move(send)) {}
+
+BrightnessAnimator::~BrightnessAnimator() {
+  cancel();
+  if (alarm_ >= 0) {
+    loop_.remove_timer(alarm_);
+  }
+}
+
+void BrightnessAnimator::ramp_to(int target, std::chrono::milliseconds duration,
+                                 RampCurve curve) {
+  target = std::clamp(target, 0, 100);
+  cancel();
+
+  target_ = target;
+  if (current_ < 0 || current_ == target || duration.count() <= 0) {
+    emit(target, true);
+    return;
+  }
+
+  start_ = current_;
+  curve_ = curve;
+  ramp_start_ = Clock::now();
+  ramp_duration_ = duration;
+  ramping_ = true;
+
+  // No point ticking faster than one level per tick, and never faster than
+  // the link drains a frame
+  auto per_level = duration / std::abs(target - start_);
+  timer_interval_ = std::max(step_interval(), per_level);
+  timer_ = loop_.add_timer(timer_interval_, [this]() { on_tick(); });
+  if (timer_ < 0) {
+    finish();
+  }
+}
+
+void BrightnessAnimator::cancel() {
+  if (timer_ >= 0) {
+    loop_.remove_timer(timer_);
+    timer_ = -1;
+  }
+  ramping_ = false;
+}
+
+void BrightnessAnimator::set_schedule(
+    const std::vector<BrightnessPoint>& points,
+    std::chrono::milliseconds initial_ramp) {
+  schedule_ = points;
+  std::sort(schedule_.begin(), schedule_.end(),
+            [](const BrightnessPoint& a, const BrightnessPoint& b) {
+              return a.minute < b.minute;
+            });
+
+  if (schedule_.empty()) {
+    if (alarm_ >= 0) {
+      loop_.remove_timer(alarm_);
+      alarm_ = -1;
+    }
+    return;
+  }
+
+  if (alarm_ < 0) {
+    alarm_ = loop_.add_alarm([this]() { on_schedule_alarm(); });
+  }
+
+  ramp_to(active_point(schedule_, WallClock::now()).value, initial_ramp);
+  arm_schedule();
+}
+
+std::chrono::milliseconds BrightnessAnimator::step_interval() const {
+  // Leave the link idle at least half the time so keepalives and screen
+  // commands are never stuck behind a queue of brightness frames
+  auto paced = std::chrono::ceil<std::chrono::milliseconds>(step_cost_ * 2);
+  return std::max(MIN_STEP, paced);
+}
+
+void BrightnessAnimator::on_tick() {
+  auto elapsed = Clock::now() - ramp_start_;
+  if (elapsed >= ramp_duration_) {
+    finish();
+    return;
+  }
+
+  double f = std::chrono::duration<double>(elapsed) / ramp_duration_;
+  if (curve_ == RampCurve::Smooth) {
+    f = f * f * (3.0 - 2.0 * f);
+  }
+
+  int value = start_ + static_cast<int>(std::lround((target_ - start_) * f));
+  if (value == target_) {
+    finish();
+    return;
+  }
+  if (value == current_) {
+    return;
+  }
+
+  // Ticks that were late (link busy, loop blocked) collapse into one step
+  // to wherever the curve is now
+  levels_skipped_ += std::abs(value - current_) - 1;
+  emit(value, false);
+
+  auto interval = std::max(step_interval(), timer_interval_);
+  if (interval != timer_interval_) {
+    timer_interval_ = interval;
+    loop_.rearm_timer(timer_, timer_interval_);
+  }
+}
+
+bool BrightnessAnimator::emit(int value, bool final) {
+  auto start = Clock::now();
+  bool ok = send_(value, final);
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - start);
+
+  // Acknowledged sends include the device's reply delay, which says
+  // nothing about how fast frames drain
+  if (!final) {
+    step_cost_ = step_cost_.count() == 0 ? cost : (step_cost_ * 3 + cost) / 4;
+  }
+
+  ++steps_sent_;
+  if (ok) {
+    current_ = value;
+  }
+  return ok;
+}
+
+void BrightnessAnimator::finish() {
+  cancel();
+  emit(target_, true);
+}
+
+void BrightnessAnimator::arm_schedule() {
+  auto now = WallClock::now();
+  auto next = WallClock::time_point::max();
+  for (const auto& point : schedule_) {
+    next = std::min(next, next_occurrence(point.minute, now));
+  }
+  loop_.set_alarm(alarm_, next);
+}
+
+void BrightnessAnimator::on_schedule_alarm() {
+  if (schedule_.empty()) {
+    return;
+  }
+
+  const auto& point = active_point(schedule_, WallClock::now());
+  if (point.value != target_) {
+    ramp_to(point.value, std::chrono::seconds(point.ramp_seconds));
+  }
+  arm_schedule();
+}
+
+}  // namespace reed
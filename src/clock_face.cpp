@@ -0,0 +1,276 @@
+#include "reed/clock_face.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
+#include "reed/font.hpp"
+#include "reed/shell.hpp"
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+struct Color {
+  uint8_t r, g, b;
+};
+
+constexpr Color BACKGROUND{16, 20, 24};
+constexpr Color DIAL{190, 196, 204};
+constexpr Color HAND{240, 240, 240};
+constexpr Color ACCENT{255, 120, 40};
+
+constexpr double PI = 3.14159265358979323846;
+
+// Draws one face after another into the same buffer. The dial never
+// changes, so it is drawn once and copied in for each frame; only the
+// hands and the digits are drawn per minute.
+class Painter {
+ public:
+  explicit Painter(const ClockFaceOptions& options)
+      : width_(options.width), height_(options.height), span_(options.span) {
+    // Wide panels get the dial on the left and large digits on the right
+    bool wide = width_ >= height_ * 3 / 2;
+    double side = wide ? height_ : std::min(width_, height_);
+    cx_ = wide ? side / 2 : width_ / 2.0;
+    cy_ = height_ / 2.0;
+    radius_ = side * 0.45;
+
+    if (wide) {
+      scale_ = std::max(1, static_cast<int>(std::min(
+                               (width_ - side) * 0.85 / 29, height_ * 0.4 / 7)));
+      text_x_ = static_cast<int>(side + (width_ - side - 29 * scale_) / 2);
+      text_y_ = static_cast<int>(cy_ - 3.5 * scale_);
+    } else {
+      scale_ = std::max(1, static_cast<int>(radius_ * 0.55 / 29));
+      text_x_ = static_cast<int>(cx_ - 14.5 * scale_);
+      text_y_ = static_cast<int>(cy_ + radius_ * 0.3);
+    }
+
+    background_.resize(static_cast<size_t>(width_) * height_ * 3);
+    for (size_t i = 0; i < background_.size(); i += 3) {
+      background_[i] = BACKGROUND.r;
+      background_[i + 1] = BACKGROUND.g;
+      background_[i + 2] = BACKGROUND.b;
+    }
+    std::swap(background_, pixels_);
+    ring(radius_, radius_ * 0.02, DIAL);
+    for (int tick = 0; tick < 60; ++tick) {
+      bool hour = tick % 5 == 0;
+      double a = tick * PI / 30;
+      double inner = radius_ * (hour ? 0.82 : 0.9);
+      segment(cx_ + std::sin(a) * inner, cy_ - std::cos(a) * inner,
+              cx_ + std::sin(a) * radius_ * 0.94,
+              cy_ - std::cos(a) * radius_ * 0.94,
+              radius_ * (hour ? 0.018 : 0.007), DIAL);
+    }
+    std::swap(background_, pixels_);
+  }
+
+  const std::vector<uint8_t>& draw(int index) {
+    pixels_ = background_;
+
+    int hour = index / 60 % 24;
+    int minute = index % 60;
+    if (span_ > 60) {
+      double a = (hour % 12 + minute / 60.0) * PI / 6;
+      hand(a, radius_ * 0.5, radius_ * 0.035);
+    }
+    hand(minute * PI / 30, radius_ * 0.78, radius_ * 0.022);
+    disc(cx_, cy_, radius_ * 0.05, ACCENT);
+
+    // "HH:MM", or ":MM" for an hour's bank, which has no hour to show
+    char text[8];
+    std::snprintf(text, sizeof(text), "%02d:%02d", hour, minute);
+    int first = span_ > 60 ? 0 : 2;
+    int x = text_x_ + (span_ > 60 ? 0 : GLYPH_ADVANCE * scale_);
+    for (int i = first; i < 5; ++i, x += GLYPH_ADVANCE * scale_) {
+      glyph(glyph_index(static_cast<uint32_t>(text[i])), x, text_y_);
+    }
+    return pixels_;
+  }
+
+ private:
+  int width_;
+  int height_;
+  int span_;
+  double cx_, cy_, radius_;
+  int scale_, text_x_, text_y_;
+  std::vector<uint8_t> background_;
+  std::vector<uint8_t> pixels_;
+
+  void blend(int x, int y, Color c, double coverage) {
+    if (coverage <= 0) {
+      return;
+    }
+    uint8_t* p = &pixels_[(static_cast<size_t>(y) * width_ + x) * 3];
+    coverage = std::min(coverage, 1.0);
+    p[0] = static_cast<uint8_t>(p[0] + (c.r - p[0]) * coverage + 0.5);
+    p[1] = static_cast<uint8_t>(p[1] + (c.g - p[1]) * coverage + 0.5);
+    p[2] = static_cast<uint8_t>(p[2] + (c.b - p[2]) * coverage + 0.5);
+  }
+
+  // Calls fn(x, y) for every pixel centre in the box, clipped to the frame
+  template <typename Fn>
+  void each_pixel(double x0, double y0, double x1, double y1, Fn fn) {
+    int xa = std::max(0, static_cast<int>(std::floor(x0)));
+    int ya = std::max(0, static_cast<int>(std::floor(y0)));
+    int xb = std::min(width_ - 1, static_cast<int>(std::ceil(x1)));
+    int yb = std::min(height_ - 1, static_cast<int>(std::ceil(y1)));
+    for (int y = ya; y <= yb; ++y) {
+      for (int x = xa; x <= xb; ++x) {
+        fn(x, y, x + 0.5, y + 0.5);
+      }
+    }
+  }
+
+  // Shapes are drawn from their signed distance: a pixel half inside the
+  // edge gets half the colour, which is all the anti-aliasing needed
+  void disc(double cx, double cy, double r, Color c) {
+    each_pixel(cx - r - 1, cy - r - 1, cx + r + 1, cy + r + 1,
+               [&](int x, int y, double px, double py) {
+                 double d = std::hypot(px - cx, py - cy) - r;
+                 blend(x, y, c, 0.5 - d);
+               });
+  }
+
+  void ring(double r, double half_width, Color c) {
+    double outer = r + half_width + 1;
+    each_pixel(cx_ - outer, cy_ - outer, cx_ + outer, cy_ + outer,
+               [&](int x, int y, double px, double py) {
+                 double d =
+                     std::fabs(std::hypot(px - cx_, py - cy_) - r) - half_width;
+                 blend(x, y, c, 0.5 - d);
+               });
+  }
+
+  void segment(double ax, double ay, double bx, double by, double half_width,
+               Color c) {
+    double dx = bx - ax;
+    double dy = by - ay;
+    double length2 = std::max(dx * dx + dy * dy, 1e-9);
+    double pad = half_width + 1;
+    each_pixel(std::min(ax, bx) - pad, std::min(ay, by) - pad,
+               std::max(ax, bx) + pad, std::max(ay, by) + pad,
+               [&](int x, int y, double px, double py) {
+                 double t = std::clamp(
+                     ((px - ax) * dx + (py - ay) * dy) / length2, 0.0, 1.0);
+                 double d = std::hypot(px - ax - t * dx, py - ay - t * dy) -
+                            half_width;
+                 blend(x, y, c, 0.5 - d);
+               });
+  }
+
+  void hand(double angle, double length, double half_width) {
+    // A short tail past the centre, like a real hand
+    double tail = radius_ * 0.08;
+    segment(cx_ - std::sin(angle) * tail, cy_ + std::cos(angle) * tail,
+            cx_ + std::sin(angle) * length, cy_ - std::cos(angle) * length,
+            half_width, HAND);
+  }
+
+  void glyph(uint8_t g, int x0, int y0) {
+    const uint8_t* columns = glyph_columns(g);
+    for (int col = 0; col < GLYPH_WIDTH; ++col) {
+      for (int row = 0; row < GLYPH_HEIGHT; ++row) {
+        if (!(columns[col] & (1 << row))) {
+          continue;
+        }
+        each_pixel(x0 + col * scale_, y0 + row * scale_,
+                   x0 + (col + 1) * scale_ - 1, y0 + (row + 1) * scale_ - 1,
+                   [&](int x, int y, double, double) {
+                     blend(x, y, ACCENT, 1);
+                   });
+      }
+    }
+  }
+};
+
+// Renders minutes [first, last) and pipes them as PPM to one ffmpeg
+bool render_range(const ClockFaceOptions& options, int first, int last) {
+  std::string pattern = options.dir + options.prefix + "_%04d.png";
+  std::string cmd =
+      "ffmpeg -y -loglevel error -f image2pipe -c:v ppm -i - "
+      "-start_number " +
+      std::to_string(first) + " " + shell_quote(pattern);
+
+  FILE* pipe = popen(cmd.c_str(), "w");
+  if (!pipe) {
+    return false;
+  }
+
+  Painter painter(options);
+  char header[32];
+  int header_size = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n",
+                                  options.width, options.height);
+  bool ok = true;
+  for (int index = first; index < last && ok; ++index) {
+    const auto& pixels = painter.draw(index);
+    ok = std::fwrite(header, 1, header_size, pipe) ==
+             static_cast<size_t>(header_size) &&
+         std::fwrite(pixels.data(), 1, pixels.size(), pipe) == pixels.size();
+  }
+  return pclose(pipe) == 0 && ok;
+}
+
+}  // namespace
+
+std::string clock_face_name(const std::string& prefix, int index) {
+  char suffix[16];
+  std::snprintf(suffix, sizeof(suffix), "_%04d.png", index);
+  return prefix + suffix;
+}
+
+void render_clock_face(const ClockFaceOptions& options, int index,
+                       std::vector<uint8_t>& rgb) {
+  Painter painter(options);
+  rgb = painter.draw(index);
+}
+
+std::optional<std::vector<std::string>> render_clock_faces(
+    const ClockFaceOptions& options) {
+  if (options.width <= 0 || options.height <= 0 ||
+      (options.span != 60 && options.span != 1440)) {
+    return std::nullopt;
+  }
+  std::error_code ec;
+  fs::create_directories(options.dir, ec);
+
+  unsigned jobs = options.jobs > 0
+                      ? options.jobs
+                      : std::max(1u, std::thread::hardware_concurrency());
+  jobs = std::min(jobs, static_cast<unsigned>(options.span));
+
+  // Contiguous shares, so each ffmpeg numbers its own files
+  std::vector<std::thread> workers;
+  std::vector<char> ok(jobs, 0);  // Not vector<bool>: written concurrently
+  for (unsigned j = 0; j < jobs; ++j) {
+    int first = static_cast<int>(options.span * j / jobs);
+    int last = static_cast<int>(options.span * (j + 1) / jobs);
+    workers.emplace_back([&options, &ok, j, first, last]() {
+      ok[j] = render_range(options, first, last);
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  std::vector<std::string> paths;
+  for (int index = 0; index < options.span; ++index) {
+    paths.push_back(options.dir + clock_face_name(options.prefix, index));
+  }
+  bool all = std::all_of(ok.begin(), ok.end(), [](char b) { return b; });
+  if (!all || !std::all_of(paths.begin(), paths.end(), [](const auto& p) {
+        std::error_code ec;
+        return fs::exists(p, ec);
+      })) {
+    return std::nullopt;
+  }
+  return paths;
+}
+
+}  // namespace reed
@@ -1,8 +1,16 @@
 #include "reed/config.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
 #include <sstream>
 
 #include "reed/picojson.h"
@@ -30,6 +38,15 @@ int get_int(const picojson::value& v, const std::string& key, int def = 0) {
   return static_cast<int>(it->second.get<double>());
 }
 
+double get_double(const picojson::value& v, const std::string& key,
+                  double def = 0) {
+  if (!v.is<picojson::object>()) return def;
+  const auto& obj = v.get<picojson::object>();
+  auto it = obj.find(key);
+  if (it == obj.end() || !it->second.is<double>()) return def;
+  return it->second.get<double>();
+}
+
 const picojson::value& get_value(const picojson::value& v,
                                  const std::string& key) {
   static picojson::value null_val;
@@ -40,6 +57,95 @@ const picojson::value& get_value(const picojson::value& v,
   return it->second;
 }
 
+std::vector<std::string> get_string_list(const picojson::value& v,
+                                         const std::string& key) {
+  std::vector<std::string> list;
+  const auto& array = get_value(v, key);
+  if (array.is<picojson::array>()) {
+    for (const auto& item : array.get<picojson::array>()) {
+      if (item.is<std::string>()) {
+        list.push_back(item.get<std::string>());
+      }
+    }
+  }
+  return list;
+}
+
+picojson::value to_json_array(const std::vector<std::string>& list) {
+  picojson::array array;
+  for (const auto& item : list) {
+    array.push_back(picojson::value(item));
+  }
+  return picojson::value(array);
+}
+
+constexpr const char* DERIVED_OP_NAMES[] = {"ewma", "rate", "percentile",
+                                            "min", "max"};
+
+std::optional<DerivedOp> parse_derived_op(const std::string& name) {
+  for (size_t i = 0; i < std::size(DERIVED_OP_NAMES); ++i) {
+    if (name == DERIVED_OP_NAMES[i]) {
+      return static_cast<DerivedOp>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+// "HH:MM" -> minutes after midnight, -1 if absent or malformed
+int get_minute_of_day(const picojson::value& v, const std::string& key) {
+  std::string text = get_string(v, key, "");
+  int hour = 0;
+  int minute = 0;
+  char sep = 0;
+  std::istringstream iss(text);
+  if (!(iss >> hour >> sep >> minute) || sep != ':' || hour < 0 ||
+      hour > 23 || minute < 0 || minute > 59) {
+    return -1;
+  }
+  return hour * 60 + minute;
+}
+
+constexpr const char* WIDGET_TYPE_NAMES[] = {"rect", "text", "value", "bar"};
+
+std::optional<WidgetType> parse_widget_type(const std::string& name) {
+  for (size_t i = 0; i < std::size(WIDGET_TYPE_NAMES); ++i) {
+    if (name == WIDGET_TYPE_NAMES[i]) {
+      return static_cast<WidgetType>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+// "#RRGGBB" -> 0xRRGGBB, def if absent or malformed
+uint32_t get_color(const picojson::value& v, const std::string& key,
+                   uint32_t def) {
+  std::string text = get_string(v, key, "");
+  if (text.size() != 7 || text[0] != '#' ||
+      text.find_first_not_of("0123456789abcdefABCDEF", 1) !=
+          std::string::npos) {
+    return def;
+  }
+  return static_cast<uint32_t>(std::stoul(text.substr(1), nullptr, 16));
+}
+
+std::optional<picojson::value> read_json(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    return std::nullopt;
+  }
+
+  std::ostringstream ss;
+  ss << file.rdbuf();
+
+  picojson::value json;
+  std::string err = picojson::parse(json, ss.str());
+  if (!err.empty()) {
+    return std::nullopt;
+  }
+
+  return json;
+}
+
 }  // namespace
 
 std::string ConfigManager::get_config_dir() {
@@ -70,6 +176,16 @@ std::string ConfigManager::get_state_dir() {
   return ".local/state/reed-tpse";
 }
 
+std::string ConfigManager::get_runtime_dir() {
+  const char* xdg_runtime = std::getenv("XDG_RUNTIME_DIR");
+  if (xdg_runtime && *xdg_runtime) {
+    return std::string(xdg_runtime) + "/reed-tpse";
+  }
+
+  // tmpfs fallback, per-user so daemons of different users don't collide
+  return "/dev/shm/reed-tpse-" + std::to_string(getuid());
+}
+
 std::string ConfigManager::get_config_path() {
   return get_config_dir() + "/config.json";
 }
@@ -78,6 +194,26 @@ std::string ConfigManager::get_state_path() {
   return get_state_dir() + "/display.json";
 }
 
+std::string ConfigManager::get_playlist_path() {
+  return get_config_dir() + "/playlist.json";
+}
+
+std::string ConfigManager::get_overlay_path() {
+  return get_config_dir() + "/overlay.json";
+}
+
+std::string ConfigManager::get_history_path() {
+  return get_state_dir() + "/history.bin";
+}
+
+std::string ConfigManager::get_status_path() {
+  return get_runtime_dir() + "/status";
+}
+
+std::string ConfigManager::get_control_path() {
+  return get_runtime_dir() + "/control";
+}
+
 std::optional<Config> ConfigManager::load_config() {
   std::string path = get_config_path();
 
@@ -85,46 +221,336 @@ std::optional<Config> ConfigManager::load_config() {
     return Config{};
   }
 
-  std::ifstream file(path);
-  if (!file) {
-    return std::nullopt;
-  }
-
-  std::ostringstream ss;
-  ss << file.rdbuf();
-
-  picojson::value json;
-  std::string err = picojson::parse(json, ss.str());
-  if (!err.empty()) {
+  auto parsed = read_json(path);
+  if (!parsed) {
     return std::nullopt;
   }
+  const picojson::value& json = *parsed;
 
   Config config;
   config.port = get_string(json, "port", "");
   config.brightness = get_int(json, "brightness", 100);
   config.keepalive_interval = get_int(json, "keepalive_interval", 10);
+  config.state_write_delay_ms = get_int(json, "state_write_delay_ms", 1000);
+  config.fade_in_ms = get_int(json, "fade_in_ms", 0);
+  config.sample_interval_ms = get_int(json, "sample_interval_ms", 1000);
+  config.net_interfaces = get_string_list(json, "net_interfaces");
+  config.disk_devices = get_string_list(json, "disk_devices");
+  config.clock_face = get_string(json, "clock_face", "");
+  config.clock_span = get_int(json, "clock_span", 1440);
+  if (config.clock_span != 60) {
+    config.clock_span = 1440;
+  }
+  config.cpu_budget_ms = std::max(get_int(json, "cpu_budget_ms", 0), 0);
+  config.rss_budget_mb = std::max(get_int(json, "rss_budget_mb", 0), 0);
+
+  const auto& schedule_val = get_value(json, "brightness_schedule");
+  if (schedule_val.is<picojson::array>()) {
+    for (const auto& v : schedule_val.get<picojson::array>()) {
+      BrightnessPoint point;
+      point.minute = get_minute_of_day(v, "at");
+      point.value = get_int(v, "value", -1);
+      point.ramp_seconds = get_int(v, "ramp", 0);
+      if (point.minute < 0 || point.value < 0 || point.value > 100) {
+        continue;
+      }
+      config.brightness_schedule.push_back(point);
+    }
+  }
+
+  const auto& derived_val = get_value(json, "derived_metrics");
+  if (derived_val.is<picojson::array>()) {
+    for (const auto& v : derived_val.get<picojson::array>()) {
+      DerivedMetricSpec spec;
+      spec.name = get_string(v, "name", "");
+      spec.source = get_string(v, "source", "");
+      auto op = parse_derived_op(get_string(v, "op", ""));
+      spec.alpha = get_double(v, "alpha", spec.alpha);
+      spec.percentile = get_double(v, "percentile", spec.percentile);
+      spec.window = get_int(v, "window", spec.window);
+      spec.round = get_double(v, "round", spec.round);
+      if (spec.name.empty() || spec.source.empty() || !op ||
+          spec.alpha <= 0 || spec.alpha > 1 || spec.percentile < 0 ||
+          spec.percentile > 100 || spec.window <= 0 || spec.round < 0) {
+        continue;
+      }
+      spec.op = *op;
+      config.derived_metrics.push_back(spec);
+    }
+  }
+
+  const auto& alerts_val = get_value(json, "alerts");
+  if (alerts_val.is<picojson::array>()) {
+    for (const auto& v : alerts_val.get<picojson::array>()) {
+      AlertRule rule;
+      rule.metric = get_string(v, "metric", "");
+      rule.name = get_string(v, "name", rule.metric);
+      rule.above = get_value(v, "above").is<double>();
+      if (!rule.above && !get_value(v, "below").is<double>()) {
+        continue;
+      }
+      rule.threshold = get_double(v, rule.above ? "above" : "below");
+      rule.clear = get_double(v, "clear", rule.threshold);
+      rule.hold_seconds = get_int(v, "for", 0);
+      rule.media = get_string(v, "media", "");
+      rule.ratio = get_string(v, "ratio", "");
+      rule.brightness = get_int(v, "brightness", -1);
+      // clear must not be past the threshold, or the rule would flap
+      bool ordered = rule.above ? rule.clear <= rule.threshold
+                                : rule.clear >= rule.threshold;
+      if (rule.metric.empty() || !ordered || rule.hold_seconds < 0 ||
+          rule.brightness > 100 ||
+          (rule.media.empty() && rule.brightness < 0)) {
+        continue;
+      }
+      config.alerts.push_back(rule);
+    }
+  }
 
   return config;
 }
 
-bool ConfigManager::save_config(const Config& config) {
-  std::string dir = get_config_dir();
-  fs::create_directories(dir);
+std::optional<Playlist> ConfigManager::load_playlist() {
+  std::string path = get_playlist_path();
 
-  std::string path = get_config_path();
-  std::ofstream file(path);
-  if (!file) {
-    return false;
+  if (!fs::exists(path)) {
+    return std::nullopt;
+  }
+
+  auto json = read_json(path);
+  if (!json) {
+    return std::nullopt;
+  }
+
+  Playlist playlist;
+
+  const auto& items_val = get_value(*json, "items");
+  if (items_val.is<picojson::array>()) {
+    for (const auto& v : items_val.get<picojson::array>()) {
+      PlaylistItem item;
+      item.media = get_string(v, "media", "");
+      item.ratio = get_string(v, "ratio", "");
+      item.duration = get_int(v, "duration", 0);
+      item.start_minute = get_minute_of_day(v, "start");
+      item.end_minute = get_minute_of_day(v, "end");
+
+      // An item needs something to show and some way to end
+      if (item.media.empty() ||
+          (item.duration <= 0 && item.end_minute < 0)) {
+        continue;
+      }
+      playlist.items.push_back(item);
+    }
+  }
+
+  return playlist;
+}
+
+std::optional<OverlayLayout> ConfigManager::load_overlay(
+    const std::string& path) {
+  auto json = read_json(path);
+  if (!json) {
+    return std::nullopt;
+  }
+
+  OverlayLayout layout;
+  layout.width = get_int(*json, "width", layout.width);
+  layout.height = get_int(*json, "height", layout.height);
+  layout.background = get_color(*json, "background", layout.background);
+  layout.transparent = get_string(*json, "background") == "transparent";
+  if (layout.width <= 0 || layout.height <= 0 || layout.width > 4096 ||
+      layout.height > 4096) {
+    return std::nullopt;
+  }
+
+  const auto& fonts_val = get_value(*json, "fonts");
+  if (fonts_val.is<picojson::object>()) {
+    for (const auto& [name, v] : fonts_val.get<picojson::object>()) {
+      OverlayFont font;
+      font.name = name;
+      font.scale = get_int(v, "scale", font.scale);
+      if (font.scale >= 1 && font.scale <= 64) {
+        layout.fonts.push_back(font);
+      }
+    }
+  }
+
+  const auto& widgets_val = get_value(*json, "widgets");
+  if (widgets_val.is<picojson::array>()) {
+    for (const auto& v : widgets_val.get<picojson::array>()) {
+      auto type = parse_widget_type(get_string(v, "type"));
+      if (!type) {
+        continue;
+      }
+      OverlayWidget widget;
+      widget.type = *type;
+      widget.x = get_int(v, "x");
+      widget.y = get_int(v, "y");
+      widget.width = get_int(v, "width");
+      widget.height = get_int(v, "height");
+      widget.color = get_color(v, "color", widget.color);
+      widget.track = get_color(v, "track", widget.track);
+      widget.font = get_string(v, "font");
+      widget.text = get_string(v, "text");
+      widget.metric = get_string(v, "metric");
+      widget.decimals = get_int(v, "decimals", widget.decimals);
+      widget.divisor = get_double(v, "divisor", widget.divisor);
+      widget.min = get_double(v, "min", widget.min);
+      widget.max = get_double(v, "max", widget.max);
+      widget.align_right = get_string(v, "align") == "right";
+
+      bool sized = widget.width > 0 && widget.height > 0;
+      bool valid = false;
+      switch (widget.type) {
+        case WidgetType::Rect:
+          valid = sized;
+          break;
+        case WidgetType::Text:
+          valid = !widget.text.empty();
+          break;
+        case WidgetType::Value:
+          valid = !widget.metric.empty() && widget.divisor != 0 &&
+                  widget.decimals >= 0 && widget.decimals <= 6;
+          break;
+        case WidgetType::Bar:
+          valid = sized && !widget.metric.empty() && widget.max > widget.min;
+          break;
+      }
+      if (valid) {
+        layout.widgets.push_back(widget);
+      }
+    }
   }
 
+  return layout;
+}
+
+std::string ConfigManager::serialize_config(const Config& config) {
   picojson::object obj;
   obj["port"] = picojson::value(config.port);
   obj["brightness"] = picojson::value(static_cast<double>(config.brightness));
   obj["keepalive_interval"] =
       picojson::value(static_cast<double>(config.keepalive_interval));
+  obj["state_write_delay_ms"] =
+      picojson::value(static_cast<double>(config.state_write_delay_ms));
+  obj["fade_in_ms"] = picojson::value(static_cast<double>(config.fade_in_ms));
+  obj["sample_interval_ms"] =
+      picojson::value(static_cast<double>(config.sample_interval_ms));
+
+  if (!config.brightness_schedule.empty()) {
+    picojson::array schedule;
+    for (const auto& point : config.brightness_schedule) {
+      char at[16];
+      std::snprintf(at, sizeof(at), "%02d:%02d", point.minute / 60,
+                    point.minute % 60);
+      picojson::object p;
+      p["at"] = picojson::value(std::string(at));
+      p["value"] = picojson::value(static_cast<double>(point.value));
+      p["ramp"] = picojson::value(static_cast<double>(point.ramp_seconds));
+      schedule.push_back(picojson::value(p));
+    }
+    obj["brightness_schedule"] = picojson::value(schedule);
+  }
+  if (!config.net_interfaces.empty()) {
+    obj["net_interfaces"] = to_json_array(config.net_interfaces);
+  }
+  if (!config.disk_devices.empty()) {
+    obj["disk_devices"] = to_json_array(config.disk_devices);
+  }
+  if (!config.clock_face.empty()) {
+    obj["clock_face"] = picojson::value(config.clock_face);
+    obj["clock_span"] =
+        picojson::value(static_cast<double>(config.clock_span));
+  }
+  if (config.cpu_budget_ms > 0) {
+    obj["cpu_budget_ms"] =
+        picojson::value(static_cast<double>(config.cpu_budget_ms));
+  }
+  if (config.rss_budget_mb > 0) {
+    obj["rss_budget_mb"] =
+        picojson::value(static_cast<double>(config.rss_budget_mb));
+  }
+  if (!config.derived_metrics.empty()) {
+    picojson::array derived;
+    for (const auto& spec : config.derived_metrics) {
+      picojson::object d;
+      d["name"] = picojson::value(spec.name);
+      d["source"] = picojson::value(spec.source);
+      d["op"] = picojson::value(
+          std::string(DERIVED_OP_NAMES[static_cast<int>(spec.op)]));
+      switch (spec.op) {
+        case DerivedOp::Ewma:
+          d["alpha"] = picojson::value(spec.alpha);
+          break;
+        case DerivedOp::Percentile:
+          d["percentile"] = picojson::value(spec.percentile);
+          [[fallthrough]];
+        case DerivedOp::Min:
+        case DerivedOp::Max:
+          d["window"] = picojson::value(static_cast<double>(spec.window));
+          break;
+        case DerivedOp::Rate:
+          break;
+      }
+      if (spec.round > 0) {
+        d["round"] = picojson::value(spec.round);
+      }
+      derived.push_back(picojson::value(d));
+    }
+    obj["derived_metrics"] = picojson::value(derived);
+  }
+  if (!config.alerts.empty()) {
+    picojson::array alerts;
+    for (const auto& rule : config.alerts) {
+      picojson::object a;
+      a["name"] = picojson::value(rule.name);
+      a["metric"] = picojson::value(rule.metric);
+      a[rule.above ? "above" : "below"] = picojson::value(rule.threshold);
+      a["clear"] = picojson::value(rule.clear);
+      a["for"] = picojson::value(static_cast<double>(rule.hold_seconds));
+      if (!rule.media.empty()) {
+        a["media"] = picojson::value(rule.media);
+      }
+      if (!rule.ratio.empty()) {
+        a["ratio"] = picojson::value(rule.ratio);
+      }
+      if (rule.brightness >= 0) {
+        a["brightness"] =
+            picojson::value(static_cast<double>(rule.brightness));
+      }
+      alerts.push_back(picojson::value(a));
+    }
+    obj["alerts"] = picojson::value(alerts);
+  }
+
+  return picojson::value(obj).serialize() + "\n";
+}
+
+bool ConfigManager::save_config(const Config& config) {
+  std::error_code ec;
+  fs::create_directories(get_config_dir(), ec);
 
-  file << picojson::value(obj).serialize() << "\n";
-  return file.good();
+  return write_file_atomic(get_config_path(), serialize_config(config));
+}
+
+bool ConfigManager::set_clock_face(const std::string& prefix, int span) {
+  std::string path = get_config_path();
+  picojson::value json{picojson::object()};
+  if (fs::exists(path)) {
+    auto parsed = read_json(path);
+    if (!parsed || !parsed->is<picojson::object>()) {
+      return false;
+    }
+    json = *parsed;
+  }
+
+  auto& obj = json.get<picojson::object>();
+  obj["clock_face"] = picojson::value(prefix);
+  obj["clock_span"] = picojson::value(static_cast<double>(span));
+
+  std::error_code ec;
+  fs::create_directories(get_config_dir(), ec);
+  return write_file_atomic(path, json.serialize() + "\n");
 }
 
 std::optional<DisplayState> ConfigManager::load_state() {
@@ -134,19 +560,11 @@ std::optional<DisplayState> ConfigManager::load_state() {
     return std::nullopt;
   }
 
-  std::ifstream file(path);
-  if (!file) {
-    return std::nullopt;
-  }
-
-  std::ostringstream ss;
-  ss << file.rdbuf();
-
-  picojson::value json;
-  std::string err = picojson::parse(json, ss.str());
-  if (!err.empty()) {
+  auto parsed = read_json(path);
+  if (!parsed) {
     return std::nullopt;
   }
+  const picojson::value& json = *parsed;
 
   DisplayState state;
 
@@ -167,16 +585,7 @@ std::optional<DisplayState> ConfigManager::load_state() {
   return state;
 }
 
-bool ConfigManager::save_state(const DisplayState& state) {
-  std::string dir = get_state_dir();
-  fs::create_directories(dir);
-
-  std::string path = get_state_path();
-  std::ofstream file(path);
-  if (!file) {
-    return false;
-  }
-
+std::string ConfigManager::serialize_state(const DisplayState& state) {
   picojson::array media_arr;
   for (const auto& m : state.media) {
     media_arr.push_back(picojson::value(m));
@@ -189,8 +598,60 @@ bool ConfigManager::save_state(const DisplayState& state) {
   obj["play_mode"] = picojson::value(state.play_mode);
   obj["brightness"] = picojson::value(static_cast<double>(state.brightness));
 
-  file << picojson::value(obj).serialize() << "\n";
-  return file.good();
+  return picojson::value(obj).serialize() + "\n";
+}
+
+bool ConfigManager::save_state(const DisplayState& state) {
+  std::error_code ec;
+  fs::create_directories(get_state_dir(), ec);
+
+  return write_file_atomic(get_state_path(), serialize_state(state));
+}
+
+bool ConfigManager::write_file_atomic(const std::string& path,
+                                      const std::string& content) {
+  std::string dir = fs::path(path).parent_path().string();
+  if (dir.empty()) {
+    dir = ".";
+  }
+
+  std::string tmp = path + ".tmp.XXXXXX";
+  int fd = mkostemp(tmp.data(), O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  // mkstemp creates 0600; these files are not secret
+  fchmod(fd, 0644);
+
+  const char* p = content.data();
+  size_t left = content.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    p += n;
+    left -= static_cast<size_t>(n);
+  }
+
+  bool ok = left == 0 && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  // Persist the directory entry too, otherwise the rename can be lost
+  int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+
+  return true;
 }
 
 }  // namespace reed
@@ -0,0 +1,305 @@
+#include "reed/control.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+bool make_address(const std::string& path, sockaddr_un& addr) {
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+// Non-blocking fds: wait for room rather than spin, but never let a stuck
+// peer hold us for longer than timeout_ms
+bool write_all(int fd, const std::string& data, int timeout_ms) {
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+    if (n > 0) {
+      done += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd pfd{fd, POLLOUT, 0};
+      if (poll(&pfd, 1, timeout_ms) > 0) {
+        continue;
+      }
+    }
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+ControlServer::ControlServer(EventLoop& loop, Handler handler,
+                             ServedFn on_served)
+    : loop_(loop),
+      handler_(std::move(handler)),
+      on_served_(std::move(on_served)) {}
+
+ControlServer::~ControlServer() {
+  close();
+}
+
+bool ControlServer::listen(const std::string& path) {
+  close();
+
+  sockaddr_un addr;
+  if (!make_address(path, addr)) {
+    return false;
+  }
+
+  std::error_code ec;
+  fs::path dir = fs::path(path).parent_path();
+  if (!dir.empty()) {
+    fs::create_directories(dir, ec);
+    fs::permissions(dir, fs::perms::owner_all, ec);
+  }
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    return false;
+  }
+
+  // A socket left behind by a daemon that died; the status page pid check
+  // and the port lock already rule out a second live daemon
+  unlink(path.c_str());
+  auto* sa = reinterpret_cast<sockaddr*>(&addr);
+  if (bind(listen_fd_, sa, sizeof(addr)) != 0 ||
+      chmod(path.c_str(), 0600) != 0 || ::listen(listen_fd_, 8) != 0 ||
+      !loop_.add(listen_fd_, [this]() { on_accept(); })) {
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(path.c_str());
+    return false;
+  }
+
+  path_ = path;
+  return true;
+}
+
+void ControlServer::close() {
+  while (!clients_.empty()) {
+    drop_client(clients_.begin()->first);
+  }
+  if (listen_fd_ >= 0) {
+    loop_.remove(listen_fd_);
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(path_.c_str());
+  }
+  path_.clear();
+}
+
+void ControlServer::on_accept() {
+  int fd;
+  while ((fd = accept4(listen_fd_, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    if (!loop_.add(fd, [this, fd]() { on_client(fd); })) {
+      ::close(fd);
+      continue;
+    }
+    clients_[fd].clear();
+  }
+}
+
+void ControlServer::on_client(int fd) {
+  auto it = clients_.find(fd);
+  if (it == clients_.end()) {
+    return;
+  }
+
+  char buf[1024];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (n <= 0) {
+    drop_client(fd);
+    return;
+  }
+
+  std::string& input = it->second;
+  input.append(buf, n);
+
+  size_t eol;
+  while ((eol = input.find('\n')) != std::string::npos) {
+    std::string line = input.substr(0, eol);
+    input.erase(0, eol + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    auto args = Session::split(line);
+    CommandResult result;
+    if (args.empty()) {
+      result.output = "Empty command";
+    } else {
+      result = handler_(args);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    ++requests_;
+    if (!result.ok) {
+      ++failures_;
+    }
+    max_latency_ = std::max(max_latency_, elapsed);
+
+    std::string reply = (result.ok ? "OK " : "ERR ") +
+                        std::to_string(result.output.size()) + "\n" +
+                        result.output;
+    bool sent = write_all(fd, reply, 1000);
+    if (on_served_) {
+      on_served_();
+    }
+    if (!sent) {
+      drop_client(fd);
+      return;
+    }
+  }
+
+  if (input.size() > MAX_LINE) {
+    drop_client(fd);
+  }
+}
+
+void ControlServer::drop_client(int fd) {
+  loop_.remove(fd);
+  ::close(fd);
+  clients_.erase(fd);
+}
+
+ControlReply ControlClient::request(const std::string& path,
+                                    const std::vector<std::string>& args,
+                                    int timeout_ms) {
+  ControlReply outcome;
+  auto line = join(args);
+  sockaddr_un addr;
+  if (!line || !make_address(path, addr)) {
+    return outcome;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return outcome;
+  }
+
+  // Connecting to a local socket never returns EINPROGRESS; a full backlog
+  // gives EAGAIN, which we treat like no daemon. The server only runs a
+  // line once its newline arrives, and that is written last, so a write
+  // that fails part way has not started anything.
+  auto start = std::chrono::steady_clock::now();
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      !write_all(fd, *line + "\n", timeout_ms)) {
+    close(fd);
+    return outcome;
+  }
+  outcome.outcome = ControlOutcome::NoReply;
+
+  std::string reply;
+  size_t header_end = std::string::npos;
+  size_t expected = 0;
+  while (true) {
+    if (header_end == std::string::npos) {
+      header_end = reply.find('\n');
+      if (header_end != std::string::npos) {
+        size_t space = reply.find(' ');
+        if (space == std::string::npos || space > header_end) {
+          break;
+        }
+        expected = std::strtoul(reply.c_str() + space + 1, nullptr, 10);
+      }
+    }
+    if (header_end != std::string::npos &&
+        reply.size() >= header_end + 1 + expected) {
+      break;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    pollfd pfd{fd, POLLIN, 0};
+    if (elapsed >= timeout_ms ||
+        poll(&pfd, 1, timeout_ms - static_cast<int>(elapsed)) <= 0) {
+      break;
+    }
+
+    char buf[1024];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    reply.append(buf, n);
+  }
+  close(fd);
+
+  if (header_end == std::string::npos ||
+      reply.size() < header_end + 1 + expected) {
+    return outcome;
+  }
+
+  CommandResult& result = outcome.result;
+  result.ok = reply.compare(0, 3, "OK ") == 0;
+  result.output = reply.substr(header_end + 1, expected);
+  result.serial = true;
+  result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  outcome.outcome = ControlOutcome::Replied;
+  return outcome;
+}
+
+std::optional<std::string> ControlClient::join(
+    const std::vector<std::string>& args) {
+  std::string line;
+  for (const auto& arg : args) {
+    // The server reads one command per line
+    if (arg.find('\n') != std::string::npos) {
+      return std::nullopt;
+    }
+    if (!line.empty()) {
+      line += ' ';
+    }
+    bool plain = !arg.empty() &&
+                 arg.find_first_of(" \t\r'\"#") == std::string::npos;
+    if (plain) {
+      line += arg;
+      continue;
+    }
+    // split() joins adjacent quoted runs into one word, so single quotes
+    // go in double quotes and everything else in single quotes
+    line += '\'';
+    for (char c : arg) {
+      if (c == '\'') {
+        line += "'\"'\"'";
+      } else {
+        line += c;
+      }
+    }
+    line += '\'';
+  }
+  return line;
+}
+
+}  // namespace reed
@@ -0,0 +1,940 @@
+#include "reed/daemon.hpp"
+
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "reed/clock_face.hpp"
+#include "reed/time_of_day.hpp"
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+int64_t unix_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+ScreenConfig to_screen_config(const DisplayState& state) {
+  ScreenConfig config;
+  config.media = state.media;
+  config.ratio = state.ratio;
+  config.screen_mode = state.screen_mode;
+  config.play_mode = state.play_mode;
+  return config;
+}
+
+bool same_screen(const DisplayState& a, const DisplayState& b) {
+  return a.media == b.media && a.ratio == b.ratio &&
+         a.screen_mode == b.screen_mode && a.play_mode == b.play_mode;
+}
+
+bool same_schedule(const std::vector<BrightnessPoint>& a,
+                   const std::vector<BrightnessPoint>& b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const BrightnessPoint& x, const BrightnessPoint& y) {
+                      return x.minute == y.minute && x.value == y.value &&
+                             x.ramp_seconds == y.ramp_seconds;
+                    });
+}
+
+bool same_derived(const std::vector<DerivedMetricSpec>& a,
+                  const std::vector<DerivedMetricSpec>& b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const DerivedMetricSpec& x, const DerivedMetricSpec& y) {
+                      return x.name == y.name && x.source == y.source &&
+                             x.op == y.op && x.alpha == y.alpha &&
+                             x.percentile == y.percentile &&
+                             x.window == y.window && x.round == y.round;
+                    });
+}
+
+// Same fake-tree override as `reed-tpse sensors`
+std::string sensor_root() {
+  const char* root = std::getenv("REED_SENSOR_ROOT");
+  return root ? root : "";
+}
+
+}  // namespace
+
+Daemon::Daemon(const std::string& port, bool verbose)
+    : port_(port),
+      verbose_(verbose),
+      device_(port, verbose),
+      playlist_(
+          loop_,
+          [this](const PlaylistItem& item, const std::string& remote_name) {
+            on_playlist_switch(item, remote_name);
+          },
+          verbose),
+      brightness_(loop_,
+                  [this](int value, bool final) {
+                    return send_brightness(value, final);
+                  }),
+      control_(
+          loop_,
+          [this](const std::vector<std::string>& args) {
+            return on_control(args);
+          },
+          [this]() { publish_status(); }),
+      state_writer_(loop_, ConfigManager::get_state_path(),
+                    std::chrono::milliseconds(1000)) {}
+
+Daemon::~Daemon() {
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+  }
+  if (signal_fd_ >= 0) {
+    close(signal_fd_);
+  }
+}
+
+int Daemon::run() {
+  // Before any thread starts, so the counters cover all of them
+  profiler_.open();
+
+  auto state = ConfigManager::load_state();
+  if (!state || state->media.empty()) {
+    std::cerr
+        << "No display state saved. Run 'reed-tpse display <file>' first.\n";
+    return 1;
+  }
+
+  auto config = ConfigManager::load_config();
+  if (config) {
+    config_ = *config;
+  }
+  saved_ = *state;
+  state_writer_.set_delay(
+      std::chrono::milliseconds(config_.state_write_delay_ms));
+
+  if (!loop_.is_valid() || !setup_signals()) {
+    std::cerr << "Failed to set up event loop\n";
+    return 1;
+  }
+
+  // A CLI command may be mid-exchange on the port (e.g. at boot, from a
+  // cron job); wait for it longer than an interactive command would
+  if (!device_.connect(std::chrono::seconds(10))) {
+    std::cerr << "Failed to connect to " << port_
+              << (device_.port_busy() ? ": in use by another process" : "")
+              << "\n";
+    return 1;
+  }
+
+  device_.handshake();
+
+  status_.pid = getpid();
+  status_.started_at_ms = unix_ms();
+  status_.port_lock_wait_us =
+      static_cast<uint32_t>(device_.lock_wait().count());
+  copy_status_string(status_.port, port_);
+
+  // A clock face, if configured, is shown from the first screen command
+  update_clock();
+  apply_screen(*state);
+
+  // Fade in from dark, to the schedule's current point if there is one
+  std::chrono::milliseconds fade(config_.fade_in_ms);
+  if (fade.count() > 0) {
+    brightness_.ramp_to(0, std::chrono::milliseconds(0));
+  }
+  if (!config_.brightness_schedule.empty()) {
+    brightness_.set_schedule(config_.brightness_schedule, fade);
+  } else {
+    brightness_.ramp_to(state->brightness, fade);
+  }
+
+  if (!status_page_.create(ConfigManager::get_status_path())) {
+    std::cerr << "Warning: could not create status page at "
+              << ConfigManager::get_status_path() << "\n";
+  }
+  publish_status();
+
+  if (!setup_watches()) {
+    std::cerr << "Warning: inotify unavailable, config changes need a "
+                 "restart\n";
+  }
+
+  if (!control_.listen(ConfigManager::get_control_path())) {
+    std::cerr << "Warning: could not create control socket at "
+              << ConfigManager::get_control_path()
+              << "; CLI commands will wait for the port\n";
+  }
+
+  keepalive_timer_ = loop_.add_timer(
+      std::chrono::seconds(config_.keepalive_interval), [this]() {
+        keepalive();
+      });
+  if (keepalive_timer_ < 0) {
+    std::cerr << "Failed to create keepalive timer\n";
+    return 1;
+  }
+
+  start_sampling();
+
+  profile_self();
+  profile_timer_ = loop_.add_timer(std::chrono::minutes(1),
+                                   [this]() { profile_self(); });
+
+  std::cout << "Display restored. Running keepalive...\n";
+
+  auto playlist = ConfigManager::load_playlist();
+  if (playlist && !playlist->items.empty()) {
+    std::cout << "Starting playlist (" << playlist->items.size()
+              << " items)\n";
+    playlist_.start(*playlist);
+  }
+
+  loop_.run();
+  history_.flush();
+  return 0;
+}
+
+bool Daemon::setup_signals() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if (sigprocmask(SIG_BLOCK, &mask, nullptr) != 0) {
+    return false;
+  }
+
+  signal_fd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_fd_ < 0) {
+    return false;
+  }
+
+  return loop_.add(signal_fd_, [this]() { on_signal(); });
+}
+
+bool Daemon::setup_watches() {
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    return false;
+  }
+
+  // Watch directories rather than files: editors (and atomic writers)
+  // replace the file, which would silently orphan a per-file watch
+  constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE;
+
+  std::error_code ec;
+  fs::create_directories(ConfigManager::get_config_dir(), ec);
+  fs::create_directories(ConfigManager::get_state_dir(), ec);
+
+  config_wd_ = inotify_add_watch(
+      inotify_fd_, ConfigManager::get_config_dir().c_str(), mask);
+  state_wd_ = inotify_add_watch(inotify_fd_,
+                                ConfigManager::get_state_dir().c_str(), mask);
+
+  if (config_wd_ < 0 && state_wd_ < 0) {
+    return false;
+  }
+
+  return loop_.add(inotify_fd_, [this]() { on_inotify(); });
+}
+
+void Daemon::apply_screen(const DisplayState& state) {
+  applied_.media = state.media;
+  applied_.ratio = state.ratio;
+  applied_.screen_mode = state.screen_mode;
+  applied_.play_mode = state.play_mode;
+
+  // While an alert holds the screen, only remember what to go back to
+  bool held = alert_screen_ >= 0;
+  ScreenConfig screen = base_screen();
+  if (!held && !device_.set_screen_config(screen)) {
+    ++status_.command_failures;
+  }
+  if (!held) {
+    copy_status_string(
+        status_.media,
+        screen.media.empty() ? std::string() : screen.media.front());
+  }
+  if (alerts_.count() > 0 || !clock_media_.empty()) {
+    prepare_frames();
+  }
+}
+
+ScreenConfig Daemon::base_screen() const {
+  ScreenConfig screen = to_screen_config(applied_);
+  if (!clock_media_.empty()) {
+    screen.media = {clock_media_};
+  }
+  return screen;
+}
+
+void Daemon::post_screen(const std::string& frame) {
+  if (!device_.post("waterBlockScreenId", frame)) {
+    ++status_.command_failures;
+    return;
+  }
+  // The device may keep showing a cached config after one send; the usual
+  // second send, with its reply, follows shortly
+  if (confirm_timer_ < 0) {
+    confirm_timer_ = loop_.add_timer(
+        std::chrono::milliseconds(500), [this]() { confirm_screen(); },
+        false);
+  } else {
+    loop_.rearm_timer(confirm_timer_, std::chrono::milliseconds(500), false);
+  }
+}
+
+void Daemon::confirm_screen() {
+  const std::string& frame =
+      alert_screen_ >= 0 ? alert_frames_[alert_screen_] : base_frame_;
+  if (!device_.send_command("POST", "waterBlockScreenId", frame)) {
+    ++status_.command_failures;
+    publish_status();
+  }
+}
+
+void Daemon::update_clock() {
+  std::string media;
+  if (!config_.clock_face.empty()) {
+    auto now = std::chrono::system_clock::now();
+    int minute = minute_of_day(now);
+    media = clock_face_name(config_.clock_face, minute % config_.clock_span);
+
+    if (clock_alarm_ < 0) {
+      clock_alarm_ = loop_.add_alarm([this]() { update_clock(); });
+    }
+    loop_.set_alarm(clock_alarm_, next_occurrence((minute + 1) % 1440, now));
+  } else if (clock_alarm_ >= 0) {
+    loop_.remove_timer(clock_alarm_);
+    clock_alarm_ = -1;
+  }
+
+  if (media == clock_media_) {
+    return;  // Woken by a clock step within the same minute
+  }
+  clock_media_ = media;
+  prepare_frames();
+  // Before the first apply_screen() there is nothing to replace yet
+  if (alert_screen_ < 0 && !applied_.media.empty()) {
+    post_screen(base_frame_);
+    ScreenConfig screen = base_screen();
+    copy_status_string(
+        status_.media,
+        screen.media.empty() ? std::string() : screen.media.front());
+    publish_status();
+  }
+  if (verbose_ && !media.empty()) {
+    std::cout << "  clock face " << media << "\n";
+  }
+}
+
+bool Daemon::send_brightness(int value, bool final) {
+  // Held by an alert: applied when it ends
+  if (alert_brightness_ >= 0) {
+    applied_.brightness = value;
+    return true;
+  }
+
+  auto response = device_.set_brightness(value, final);
+  if (final && !response) {
+    ++status_.command_failures;
+    publish_status();
+    return false;
+  }
+
+  applied_.brightness = value;
+  status_.brightness = value;
+  if (final) {
+    publish_status();
+  }
+  return true;
+}
+
+void Daemon::keepalive() {
+  // Runs forever, so it must not allocate: Device::keepalive reuses its
+  // buffers and everything below works on fixed-size members
+  auto start = std::chrono::steady_clock::now();
+  bool ok = device_.keepalive();
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  if (ok) {
+    ++status_.keepalives_ok;
+    status_.last_keepalive_ms = unix_ms();
+    rtt_.add(static_cast<uint32_t>(elapsed.count()));
+  } else {
+    ++status_.keepalive_failures;
+  }
+
+  if (verbose_) {
+    std::cout << "  keepalive " << (ok ? "sent" : "failed") << "\n";
+  }
+
+  publish_status();
+}
+
+void Daemon::start_sampling() {
+  if (config_.sample_interval_ms <= 0 || sample_timer_ >= 0) {
+    return;
+  }
+  if (!host_) {
+    host_ = std::make_unique<HostMetrics>(config_, sensor_root());
+  }
+  if (!history_.is_open() &&
+      !history_.open(ConfigManager::get_history_path())) {
+    std::cerr << "Warning: could not open "
+              << ConfigManager::get_history_path()
+              << "; sensor history will not survive a restart\n";
+    history_.open();
+  }
+  last_sample_ = std::chrono::steady_clock::now();
+  sample_timer_ = loop_.add_timer(
+      std::chrono::milliseconds(config_.sample_interval_ms),
+      [this]() { sample(); });
+}
+
+void Daemon::sample() {
+  auto now = std::chrono::steady_clock::now();
+  double dt = std::chrono::duration<double>(now - last_sample_).count();
+  last_sample_ = now;
+
+  host_->sample();
+
+  if (history_generation_ != host_->generation()) {
+    history_generation_ = host_->generation();
+    compile_derived();
+  }
+
+  // Only what changed goes on to the consumers of derived metrics
+  const auto& changed = derived_.update(host_->values(), dt);
+  if (verbose_) {
+    for (size_t i : changed) {
+      std::cout << "  " << derived_.name(i) << " = " << derived_.value(i)
+                << "\n";
+    }
+  }
+
+  for (size_t i : alerts_.update(derived_.values())) {
+    std::cout << "Alert " << alerts_.rule(i).name
+              << (alerts_.active(i) ? " fired" : " ended") << " ("
+              << alerts_.rule(i).metric << " = " << alerts_.value(i)
+              << ")\n";
+  }
+  if (alerts_.screen_rule() != alert_screen_ ||
+      alerts_.brightness_rule() != alert_brightness_) {
+    switch_alerts(now);
+  }
+
+  int64_t now_s = unix_ms() / 1000;
+  size_t inputs = host_->count();
+  for (size_t i = 0; i < inputs; ++i) {
+    history_.add(history_ids_[i], now_s, host_->value(i));
+  }
+  for (size_t i = 0; i < derived_.count(); ++i) {
+    history_.add(history_ids_[inputs + i], now_s, derived_.value(i));
+  }
+}
+
+void Daemon::compile_derived() {
+  for (const std::string& error : derived_.compile(
+           config_.derived_metrics, host_->names(),
+           config_.sample_interval_ms)) {
+    std::cerr << "Ignoring derived metric " << error << "\n";
+  }
+
+  history_ids_.clear();
+  for (const std::string& name : host_->names()) {
+    history_ids_.push_back(history_.find(name, true));
+  }
+  for (size_t i = 0; i < derived_.count(); ++i) {
+    history_ids_.push_back(history_.find(derived_.name(i), true));
+  }
+
+  compile_alerts();
+}
+
+void Daemon::compile_alerts() {
+  // Alerts see the same flat list derived_ does: sensors, then derived
+  std::vector<std::string> names = host_->names();
+  for (size_t i = 0; i < derived_.count(); ++i) {
+    names.push_back(derived_.name(i));
+  }
+  for (const std::string& error :
+       alerts_.compile(config_.alerts, names, config_.sample_interval_ms)) {
+    std::cerr << "Ignoring alert " << error << "\n";
+  }
+
+  // Rule indices may have moved; resend whatever is in effect
+  if (alert_screen_ >= 0) {
+    alert_screen_ = -2;
+  }
+  if (alert_brightness_ >= 0) {
+    alert_brightness_ = -2;
+  }
+  prepare_frames();
+}
+
+void Daemon::prepare_frames() {
+  ScreenConfig screen = base_screen();
+  base_frame_ = Device::encode_screen_config(screen);
+
+  alert_frames_.assign(alerts_.count(), std::string());
+  for (size_t i = 0; i < alerts_.count(); ++i) {
+    const AlertRule& rule = alerts_.rule(i);
+    if (rule.media.empty()) {
+      continue;
+    }
+    ScreenConfig alert = screen;
+    alert.media = {rule.media};
+    if (!rule.ratio.empty()) {
+      alert.ratio = rule.ratio;
+    }
+    alert_frames_[i] = Device::encode_screen_config(alert);
+  }
+}
+
+void Daemon::switch_alerts(std::chrono::steady_clock::time_point sampled) {
+  int screen = alerts_.screen_rule();
+  if (screen != alert_screen_) {
+    const std::string& frame =
+        screen >= 0 ? alert_frames_[screen] : base_frame_;
+    post_screen(frame);
+    alert_screen_ = screen;
+    ScreenConfig base = base_screen();
+    copy_status_string(status_.media,
+                       screen >= 0 ? alerts_.rule(screen).media
+                       : base.media.empty() ? std::string()
+                                            : base.media.front());
+  }
+
+  int brightness = alerts_.brightness_rule();
+  if (brightness != alert_brightness_) {
+    int value = brightness >= 0 ? alerts_.rule(brightness).brightness
+                                : applied_.brightness;
+    char body[32];
+    int n = std::snprintf(body, sizeof(body), "{\"value\":%d}", value);
+    if (device_.post("brightness", std::string_view(body, n))) {
+      status_.brightness = value;
+    } else {
+      ++status_.command_failures;
+    }
+    alert_brightness_ = brightness;
+  }
+
+  // From the sample that decided it to the frame being on the wire
+  auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - sampled);
+  ++status_.alert_switches;
+  status_.alert_latency_us = static_cast<uint32_t>(latency.count());
+  status_.alert_latency_max_us =
+      std::max(status_.alert_latency_max_us, status_.alert_latency_us);
+  int owner = screen >= 0 ? screen : brightness;
+  copy_status_string(status_.alert,
+                     owner >= 0 ? alerts_.rule(owner).name : std::string());
+  if (verbose_) {
+    std::cout << "  alert switch written " << latency.count()
+              << " us after the sample\n";
+  }
+  publish_status();
+}
+
+void Daemon::on_signal() {
+  signalfd_siginfo info;
+  while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+    if (info.ssi_signo == SIGINT || info.ssi_signo == SIGTERM) {
+      loop_.stop();
+    }
+  }
+}
+
+void Daemon::on_inotify() {
+  alignas(inotify_event) char buf[4096];
+  bool config_changed = false;
+  bool state_changed = false;
+  bool playlist_changed = false;
+
+  ssize_t n;
+  while ((n = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+    for (char* p = buf; p < buf + n;) {
+      const auto* ev = reinterpret_cast<const inotify_event*>(p);
+      // Deleting config or state keeps what is applied; deleting the
+      // playlist stops it
+      bool deleted = ev->mask & IN_DELETE;
+      if (ev->len > 0) {
+        if (ev->wd == config_wd_ && !deleted &&
+            std::strcmp(ev->name, "config.json") == 0) {
+          config_changed = true;
+        }
+        if (ev->wd == config_wd_ &&
+            std::strcmp(ev->name, "playlist.json") == 0) {
+          playlist_changed = true;
+        }
+        if (ev->wd == state_wd_ && !deleted &&
+            std::strcmp(ev->name, "display.json") == 0) {
+          state_changed = true;
+        }
+      }
+      p += sizeof(inotify_event) + ev->len;
+    }
+  }
+
+  // Events for one save arrive in a burst; reload each file once per batch
+  if (config_changed) reload_config();
+  if (state_changed) reload_state();
+  if (playlist_changed) reload_playlist();
+}
+
+void Daemon::reload_config() {
+  auto config = ConfigManager::load_config();
+  if (!config) {
+    std::cerr << "Ignoring unparseable " << ConfigManager::get_config_path()
+              << "\n";
+    return;
+  }
+
+  if (config->keepalive_interval != config_.keepalive_interval &&
+      config->keepalive_interval > 0) {
+    loop_.rearm_timer(keepalive_timer_,
+                      std::chrono::seconds(config->keepalive_interval));
+    std::cout << "Keepalive interval: " << config->keepalive_interval
+              << "s\n";
+  }
+
+  if (!same_schedule(config->brightness_schedule,
+                     config_.brightness_schedule)) {
+    std::cout << "Brightness schedule reloaded ("
+              << config->brightness_schedule.size() << " points)\n";
+    brightness_.set_schedule(config->brightness_schedule,
+                             std::chrono::milliseconds(config->fade_in_ms));
+
+    // Without a schedule, brightness belongs to display.json again
+    auto state = ConfigManager::load_state();
+    if (config->brightness_schedule.empty() && state) {
+      brightness_.ramp_to(state->brightness,
+                          std::chrono::milliseconds(config->fade_in_ms));
+    }
+  }
+
+  state_writer_.set_delay(
+      std::chrono::milliseconds(config->state_write_delay_ms));
+
+  if (config->sample_interval_ms != config_.sample_interval_ms ||
+      !same_derived(config->derived_metrics, config_.derived_metrics)) {
+    history_generation_ = 0;  // Recompile on the next sample
+  }
+  if (host_ && (config->net_interfaces != config_.net_interfaces ||
+                config->disk_devices != config_.disk_devices)) {
+    // Metric names and indices change with the lists; the next sample
+    // recompiles history ids, derived metrics and alerts against them
+    std::cout << "Network and disk lists reloaded\n";
+    host_ = std::make_unique<HostMetrics>(*config, sensor_root());
+    history_generation_ = 0;
+  }
+  if (config->sample_interval_ms != config_.sample_interval_ms) {
+    if (config->sample_interval_ms <= 0 && sample_timer_ >= 0) {
+      loop_.remove_timer(sample_timer_);
+      sample_timer_ = -1;
+    } else if (sample_timer_ >= 0) {
+      loop_.rearm_timer(sample_timer_, std::chrono::milliseconds(
+                                           config->sample_interval_ms));
+    }
+  }
+
+  if (!config->port.empty() && config->port != port_) {
+    std::cout << "Port change to " << config->port
+              << " takes effect after restart\n";
+  }
+
+  bool clock_changed = config->clock_face != config_.clock_face ||
+                       config->clock_span != config_.clock_span;
+  config_ = *config;
+  if (clock_changed) {
+    update_clock();
+  }
+  if (host_ && history_generation_ != 0) {
+    compile_alerts();
+  }
+  start_sampling();
+}
+
+void Daemon::reload_state() {
+  auto state = ConfigManager::load_state();
+  if (!state || state->media.empty()) {
+    std::cerr << "Ignoring unparseable " << ConfigManager::get_state_path()
+              << "\n";
+    return;
+  }
+  // Our own save of a routed command lands here too, and matches saved_
+  if (!state_writer_.pending()) {
+    saved_ = *state;
+  }
+
+  // Only resend what differs from what the panel already shows. While a
+  // playlist runs it owns the screen, and a brightness schedule owns
+  // brightness.
+  if (!playlist_.active() && !same_screen(*state, applied_)) {
+    apply_screen(*state);
+    publish_status();
+    std::cout << "Display reloaded: " << status_.media << "\n";
+  }
+  if (!brightness_.has_schedule() &&
+      state->brightness != brightness_.target()) {
+    brightness_.ramp_to(state->brightness, std::chrono::milliseconds(0));
+    std::cout << "Brightness reloaded: " << state->brightness << "\n";
+  }
+}
+
+void Daemon::reload_playlist() {
+  auto playlist = ConfigManager::load_playlist();
+  if (playlist && !playlist->items.empty()) {
+    std::cout << "Playlist reloaded (" << playlist->items.size()
+              << " items)\n";
+    playlist_.start(*playlist);
+    return;
+  }
+
+  if (!playlist_.active()) {
+    return;
+  }
+
+  // Playlist removed or emptied: fall back to the saved display
+  playlist_.stop();
+  std::cout << "Playlist stopped\n";
+  auto state = ConfigManager::load_state();
+  if (state && !state->media.empty()) {
+    apply_screen(*state);
+    publish_status();
+  }
+}
+
+void Daemon::on_playlist_switch(const PlaylistItem& item,
+                                const std::string& remote_name) {
+  DisplayState next = applied_;
+  next.media = {remote_name};
+  if (!item.ratio.empty()) {
+    next.ratio = item.ratio;
+  }
+
+  apply_screen(next);
+  publish_status();
+}
+
+void Daemon::profile_self() {
+  SelfUsage usage = profiler_.read();
+  cpu_window_.add(usage.cpu_us);
+
+  status_.self_cpu_us = usage.cpu_us;
+  status_.self_cpu_hour_us = cpu_window_.per_hour_us();
+  status_.self_run_delay_us = usage.run_delay_us;
+  status_.self_context_switches = usage.context_switches;
+  status_.self_page_faults = usage.page_faults;
+  status_.self_rss_kb = static_cast<uint32_t>(usage.rss_kb);
+  status_.self_rss_peak_kb = static_cast<uint32_t>(usage.rss_peak_kb);
+  status_.self_perf = profiler_.uses_perf();
+
+  // Start-up (handshake, first screen) is not steady state: the CPU
+  // budget is checked once the window has a few minutes in it
+  uint8_t over = 0;
+  if (config_.cpu_budget_ms > 0 && cpu_window_.minutes() >= 5 &&
+      status_.self_cpu_hour_us > config_.cpu_budget_ms * int64_t{1000}) {
+    over |= OVER_CPU_BUDGET;
+  }
+  if (config_.rss_budget_mb > 0 &&
+      usage.rss_kb > static_cast<uint64_t>(config_.rss_budget_mb) * 1024) {
+    over |= OVER_RSS_BUDGET;
+  }
+
+  // Reported when crossed, not every minute it stays over
+  uint8_t crossed = over & ~status_.over_budget;
+  if (crossed & OVER_CPU_BUDGET) {
+    std::cerr << "Warning: daemon CPU at " << status_.self_cpu_hour_us / 1000
+              << " ms per hour (last " << cpu_window_.minutes()
+              << " min), over the " << config_.cpu_budget_ms
+              << " ms budget\n";
+  }
+  if (crossed & OVER_RSS_BUDGET) {
+    std::cerr << "Warning: daemon resident memory " << usage.rss_kb / 1024
+              << " MB is over the " << config_.rss_budget_mb
+              << " MB budget\n";
+  }
+  if (status_.over_budget & ~over) {
+    std::cout << "Daemon back within its budget\n";
+  }
+  status_.over_budget = over;
+
+  publish_status();
+}
+
+void Daemon::publish_status() {
+  status_.playlist_switches = playlist_.switches();
+  status_.playlist_jitter_max_us = playlist_.max_jitter_us();
+  status_.rtt_p50_us = rtt_.percentile(50);
+  status_.rtt_p90_us = rtt_.percentile(90);
+  status_.rtt_p99_us = rtt_.percentile(99);
+  status_.rtt_max_us = rtt_.percentile(100);
+  status_.control_requests = control_.requests();
+  status_.control_failures = control_.failures();
+  status_.control_max_us =
+      static_cast<uint32_t>(control_.max_latency().count());
+  status_.rx_capacity_bytes = static_cast<uint32_t>(device_.rx_capacity());
+  status_.rx_peak_bytes = static_cast<uint32_t>(device_.rx_peak());
+  status_.rx_stale_frames = device_.rx_stale_frames();
+  status_.pump_rpm = device_.pump_rpm();
+  status_.self_wakeups = loop_.wakeups();
+  status_page_.publish(status_);
+}
+
+CommandResult Daemon::on_control(const std::vector<std::string>& args) {
+  const std::string& cmd = args[0];
+  std::vector<std::string> rest(args.begin() + 1, args.end());
+
+  CommandResult result;
+  if (cmd == "info") {
+    result = control_info();
+  } else if (cmd == "brightness") {
+    result = control_brightness(rest);
+  } else if (cmd == "display") {
+    result = control_display(rest);
+  } else {
+    result.output = "Not handled by the daemon: " + cmd;
+  }
+
+  if (verbose_) {
+    std::cout << "  control: " << cmd << (result.ok ? "" : " (failed)")
+              << "\n";
+  }
+  return result;
+}
+
+CommandResult Daemon::control_info() {
+  CommandResult result;
+  auto info = device_.handshake();
+  if (!info) {
+    result.output = "Failed to get device info";
+    return result;
+  }
+
+  status_.last_keepalive_ms = unix_ms();
+  result.ok = true;
+  result.output = "Device Information:\n"
+                  "  Product: " + info->product_id + "\n"
+                  "  OS: " + info->os + "\n"
+                  "  Serial: " + info->serial + "\n"
+                  "  App Version: " + info->app_version + "\n"
+                  "  Firmware: " + info->firmware + "\n"
+                  "  Hardware: " + info->hardware;
+  if (!info->attributes.empty()) {
+    result.output += "\n  Attributes: ";
+    for (size_t i = 0; i < info->attributes.size(); ++i) {
+      if (i > 0) result.output += ", ";
+      result.output += info->attributes[i];
+    }
+  }
+  if (info->pump_rpm >= 0) {
+    result.output += "\n  Pump: " + std::to_string(info->pump_rpm) + " RPM";
+  }
+  return result;
+}
+
+CommandResult Daemon::control_brightness(
+    const std::vector<std::string>& args) {
+  CommandResult result;
+  int fade_ms = 0;
+  int value = -1;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] == "--fade" && i + 1 < args.size()) {
+      fade_ms = std::atoi(args[++i].c_str());
+    } else {
+      value = std::atoi(args[i].c_str());
+    }
+  }
+  if (value < 0 || value > 100) {
+    result.output = "Brightness must be 0-100";
+    return result;
+  }
+
+  brightness_.ramp_to(value, std::chrono::milliseconds(fade_ms));
+  if (fade_ms <= 0 && brightness_.current() != value) {
+    result.output = "No response to brightness " + std::to_string(value);
+    return result;
+  }
+
+  saved_.brightness = value;
+  save_state();
+
+  result.ok = true;
+  result.output =
+      (fade_ms > 0 ? "Brightness fading to " : "Brightness set to ") +
+      std::to_string(value);
+  if (brightness_.has_schedule()) {
+    result.output += " (the brightness schedule resumes at its next point)";
+  }
+  return result;
+}
+
+CommandResult Daemon::control_display(const std::vector<std::string>& args) {
+  CommandResult result;
+  DisplayState state = saved_;
+  int brightness = -1;
+  state.media.clear();
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] == "--ratio" && i + 1 < args.size()) {
+      state.ratio = args[++i];
+    } else if (args[i] == "--brightness" && i + 1 < args.size()) {
+      brightness = std::atoi(args[++i].c_str());
+    } else {
+      state.media.push_back(args[i]);
+    }
+  }
+  if (state.media.empty()) {
+    result.output = "Usage: display <file...>";
+    return result;
+  }
+  if (brightness > 100) {
+    result.output = "Brightness must be 0-100";
+    return result;
+  }
+
+  uint64_t failures = status_.command_failures;
+  apply_screen(state);
+  if (status_.command_failures != failures) {
+    result.output = "No response to screen config";
+    return result;
+  }
+  if (brightness >= 0) {
+    brightness_.ramp_to(brightness, std::chrono::milliseconds(0));
+    state.brightness = brightness;
+  }
+
+  saved_ = state;
+  save_state();
+
+  result.ok = true;
+  result.output = "Display set to: ";
+  for (size_t i = 0; i < state.media.size(); ++i) {
+    if (i > 0) result.output += ", ";
+    result.output += state.media[i];
+  }
+  if (brightness >= 0) {
+    result.output += "\nBrightness: " + std::to_string(brightness);
+  }
+  if (playlist_.active()) {
+    result.output += "\nThe playlist takes over again at its next slot.";
+  }
+  return result;
+}
+
+void Daemon::save_state() {
+  state_writer_.update(ConfigManager::serialize_state(saved_));
+}
+
+}  // namespace reed
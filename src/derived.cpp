@@ -0,0 +1,212 @@
+#include "reed/derived.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+
+namespace reed {
+
+namespace {
+
+// NaN-aware equality: a metric that stays unavailable has not changed
+bool same(double a, double b) {
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+double quantize(double value, double step) {
+  return step > 0 && !std::isnan(value) ? std::round(value / step) * step
+                                        : value;
+}
+
+}  // namespace
+
+std::vector<std::string> DerivedMetrics::compile(
+    const std::vector<DerivedMetricSpec>& specs,
+    const std::vector<std::string>& inputs, int interval_ms) {
+  std::vector<std::string> errors;
+  nodes_.clear();
+  inputs_ = inputs.size();
+
+  std::unordered_map<std::string, size_t> slots;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    slots.emplace(inputs[i], i);
+  }
+  std::unordered_map<std::string, size_t> declared;
+  enum Mark : uint8_t { NEW, VISITING, DONE, DROPPED };
+  std::vector<Mark> marks(specs.size(), NEW);
+  for (size_t i = 0; i < specs.size(); ++i) {
+    if (slots.count(specs[i].name) ||
+        !declared.emplace(specs[i].name, i).second) {
+      errors.push_back(specs[i].name + ": name already in use");
+      marks[i] = DROPPED;
+    }
+  }
+
+  // Depth-first over source links, so every node lands after its source
+  std::function<bool(size_t)> resolve = [&](size_t i) {
+    if (marks[i] != NEW) {
+      return marks[i] == DONE;
+    }
+    const DerivedMetricSpec& spec = specs[i];
+    marks[i] = VISITING;
+
+    std::string error;
+    if (!slots.count(spec.source)) {
+      auto dep = declared.find(spec.source);
+      if (dep == declared.end()) {
+        error = "unknown source " + spec.source;
+      } else if (marks[dep->second] == VISITING) {
+        error = "dependency cycle";
+      } else if (!resolve(dep->second)) {
+        error = "source " + spec.source + " was dropped";
+      }
+    }
+    if (!error.empty()) {
+      errors.push_back(spec.name + ": " + error);
+      marks[i] = DROPPED;
+      return false;
+    }
+
+    Node node;
+    node.name = spec.name;
+    node.op = spec.op;
+    node.source = slots.at(spec.source);
+    node.alpha = spec.alpha;
+    node.percentile = spec.percentile;
+    node.round = spec.round;
+    if (spec.op == DerivedOp::Percentile || spec.op == DerivedOp::Min ||
+        spec.op == DerivedOp::Max) {
+      int64_t samples = static_cast<int64_t>(spec.window) * 1000 /
+                        std::max(1, interval_ms);
+      node.ring.assign(static_cast<size_t>(std::max<int64_t>(1, samples)), 0);
+      node.sorted.reserve(node.ring.size());
+    }
+    slots.emplace(spec.name, inputs_ + nodes_.size());
+    nodes_.push_back(std::move(node));
+    marks[i] = DONE;
+    return true;
+  };
+  for (size_t i = 0; i < specs.size(); ++i) {
+    resolve(i);
+  }
+
+  values_.assign(inputs_ + nodes_.size(), NAN);
+  dirty_.assign(values_.size(), 1);
+  changed_list_.clear();
+  changed_list_.reserve(nodes_.size());
+  return errors;
+}
+
+void DerivedMetrics::push_window(Node& node, double input) {
+  size_t capacity = node.ring.size();
+  if (node.ring_size == capacity) {
+    double oldest = node.ring[node.ring_next];
+    node.sorted.erase(
+        std::lower_bound(node.sorted.begin(), node.sorted.end(), oldest));
+  } else {
+    ++node.ring_size;
+  }
+  node.ring[node.ring_next] = input;
+  node.ring_next = (node.ring_next + 1) % capacity;
+  node.sorted.insert(
+      std::upper_bound(node.sorted.begin(), node.sorted.end(), input), input);
+
+  // A full window of one value stays the same when that value repeats
+  node.settled = node.ring_size == capacity &&
+                 node.sorted.front() == input && node.sorted.back() == input;
+}
+
+double DerivedMetrics::evaluate(Node& node, double input, double dt_seconds) {
+  switch (node.op) {
+    case DerivedOp::Ewma:
+      if (std::isnan(input)) {
+        node.settled = true;
+        return node.primed ? node.state : NAN;
+      }
+      if (!node.primed) {
+        node.state = input;
+        node.primed = true;
+      } else {
+        node.state += node.alpha * (input - node.state);
+      }
+      // Snap once within float noise; the input repeating then is a no-op
+      if (std::fabs(input - node.state) <=
+          1e-6 * std::max(1.0, std::fabs(input))) {
+        node.state = input;
+      }
+      node.settled = node.state == input;
+      return node.state;
+
+    case DerivedOp::Rate: {
+      if (std::isnan(input)) {
+        node.primed = false;
+        node.settled = true;
+        return NAN;
+      }
+      double rate = node.primed && dt_seconds > 0
+                        ? (input - node.state) / dt_seconds
+                        : NAN;
+      node.state = input;
+      node.primed = true;
+      node.settled = rate == 0;
+      return rate;
+    }
+
+    case DerivedOp::Percentile:
+    case DerivedOp::Min:
+    case DerivedOp::Max: {
+      if (!std::isnan(input)) {
+        push_window(node, input);
+      } else {
+        node.settled = true;
+      }
+      if (node.sorted.empty()) {
+        return NAN;
+      }
+      if (node.op == DerivedOp::Min) {
+        return node.sorted.front();
+      }
+      if (node.op == DerivedOp::Max) {
+        return node.sorted.back();
+      }
+      // Nearest rank
+      size_t n = node.sorted.size();
+      size_t rank = static_cast<size_t>(std::ceil(node.percentile / 100 * n));
+      return node.sorted[std::clamp<size_t>(rank, 1, n) - 1];
+    }
+  }
+  return NAN;
+}
+
+const std::vector<size_t>& DerivedMetrics::update(const double* inputs,
+                                                  double dt_seconds) {
+  changed_list_.clear();
+  evaluated_ = 0;
+
+  for (size_t i = 0; i < inputs_; ++i) {
+    dirty_[i] = !same(values_[i], inputs[i]);
+    values_[i] = inputs[i];
+  }
+
+  for (size_t n = 0; n < nodes_.size(); ++n) {
+    Node& node = nodes_[n];
+    size_t slot = inputs_ + n;
+    dirty_[slot] = 0;
+    if (!dirty_[node.source] && node.settled) {
+      continue;
+    }
+    ++evaluated_;
+
+    double value =
+        quantize(evaluate(node, values_[node.source], dt_seconds), node.round);
+    if (!same(value, values_[slot])) {
+      values_[slot] = value;
+      dirty_[slot] = 1;
+      changed_list_.push_back(n);
+    }
+  }
+  return changed_list_;
+}
+
+}  // namespace reed
@@ -2,17 +2,22 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <cstring>
 #include <filesystem>
-#include <iomanip>
 #include <iostream>
 #include <thread>
 
+#include "reed/log.hpp"
+#include "reed/timings.hpp"
+
 namespace reed {
 
 namespace {
@@ -45,6 +50,7 @@ const picojson::value& get_value(const picojson::value& v,
 
 std::optional<std::string> Device::find_device(bool verbose) {
   namespace fs = std::filesystem;
+  ScopedTimer timer("find_device");
 
   std::vector<std::string> candidates;
 
@@ -76,10 +82,12 @@ std::optional<std::string> Device::find_device(bool verbose) {
       std::cout << "  Trying " << port << "... ";
     }
 
+    // A port someone else holds is in use, most likely by our own daemon;
+    // don't wait for it while scanning
     Device dev(port, false);
-    if (!dev.connect()) {
+    if (!dev.connect(std::chrono::milliseconds(0))) {
       if (verbose) {
-        std::cout << "failed to open\n";
+        std::cout << (dev.port_busy() ? "busy\n" : "failed to open\n");
       }
       continue;
     }
@@ -101,22 +109,83 @@ std::optional<std::string> Device::find_device(bool verbose) {
 }
 
 Device::Device(const std::string& port, bool verbose)
-    : port_(port), verbose_(verbose) {}
+    : port_(port), verbose_(verbose) {
+  // Sized for the largest frame we send (screen config) or expect back, so
+  // the steady state never reallocates them
+  tx_.reserve(BUFFER_RESERVE);
+  scratch_.reserve(BUFFER_RESERVE);
+}
 
 Device::~Device() {
   disconnect();
 }
 
-bool Device::connect() {
-  fd_ = open(port_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
-  if (fd_ < 0) {
+bool Device::open_exclusive(std::chrono::milliseconds lock_wait) {
+  constexpr auto retry_interval = std::chrono::milliseconds(25);
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + lock_wait;
+  port_busy_ = false;
+  lock_retries_ = 0;
+
+  // A blocking flock cannot be used: while the holder has TIOCEXCL set,
+  // open() itself fails for non-root, so there is no fd to block on
+  while (true) {
+    // EBUSY: another process set TIOCEXCL. EWOULDBLOCK: it holds the flock
+    // (root ignores TIOCEXCL, so the flock is what actually serialises).
+    fd_ = open(port_.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    int err = fd_ < 0 ? errno : 0;
+    if (fd_ >= 0) {
+      if (flock(fd_, LOCK_EX | LOCK_NB) == 0) {
+        ioctl(fd_, TIOCEXCL);
+        break;
+      }
+      err = errno;
+      close(fd_);
+      fd_ = -1;
+    }
+
+    if (err != EBUSY && err != EWOULDBLOCK) {
+      if (verbose_) {
+        std::cerr << "Failed to open " << port_ << ": " << strerror(err)
+                  << "\n";
+      }
+      return false;
+    }
+
+    ++lock_retries_;
+    if (std::chrono::steady_clock::now() + retry_interval > deadline) {
+      port_busy_ = true;
+      if (verbose_) {
+        std::cerr << port_ << " is in use by another process\n";
+      }
+      return false;
+    }
+    std::this_thread::sleep_for(retry_interval);
+  }
+
+  lock_wait_ = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  if (verbose_ && lock_retries_ > 0) {
+    std::cout << "Waited " << lock_wait_.count() / 1000 << " ms for "
+              << port_ << "\n";
+  }
+  return true;
+}
+
+bool Device::connect(std::chrono::milliseconds lock_wait) {
+  ScopedTimer timer("connect");
+  if (!rx_.is_valid()) {
     if (verbose_) {
-      std::cerr << "Failed to open " << port_ << ": " << strerror(errno)
-                << "\n";
+      std::cerr << "Failed to allocate receive buffer\n";
     }
     return false;
   }
 
+  if (!open_exclusive(lock_wait)) {
+    return false;
+  }
+
   struct termios tty;
   memset(&tty, 0, sizeof(tty));
 
@@ -158,7 +227,10 @@ bool Device::connect() {
     return false;
   }
 
+  // Safe only now that the port is ours: anything still buffered belongs
+  // to a previous owner, not to someone else's in-flight exchange
   tcflush(fd_, TCIOFLUSH);
+  rx_.clear();
 
   if (verbose_) {
     std::cout << "Connected to " << port_ << "\n";
@@ -169,116 +241,214 @@ bool Device::connect() {
 
 void Device::disconnect() {
   if (fd_ >= 0) {
+    ioctl(fd_, TIOCNXCL);
     close(fd_);
     fd_ = -1;
   }
 }
 
-std::vector<uint8_t> Device::read_response(int timeout_ms) {
-  std::vector<uint8_t> response;
+size_t Device::fill() {
+  if (rx_.free_space() == 0) {
+    // A "frame" longer than the whole buffer is line noise; start over
+    rx_overflow_bytes_ += rx_.size();
+    rx_.clear();
+  }
+
+  // Read everything that is already there in one call, rather than in
+  // small fixed chunks
+  int available = 0;
+  size_t want = rx_.free_space();
+  if (ioctl(fd_, FIONREAD, &available) == 0 && available > 0) {
+    want = std::min(want, static_cast<size_t>(available));
+  }
+
+  ssize_t n = read(fd_, rx_.write_ptr(), want);
+  if (n <= 0) {
+    return 0;
+  }
+  ++rx_reads_;
+  rx_.commit(static_cast<size_t>(n));
+  return static_cast<size_t>(n);
+}
+
+bool Device::next_frame(const uint8_t*& frame, size_t& size) {
+  while (rx_.size() > 0) {
+    const uint8_t* data = rx_.data();
+    size_t n = rx_.size();
+
+    const auto* start =
+        static_cast<const uint8_t*>(std::memchr(data, FRAME_MARKER, n));
+    if (!start) {
+      rx_discarded_bytes_ += n;
+      rx_.clear();
+      return false;
+    }
+    if (start != data) {
+      rx_discarded_bytes_ += start - data;
+      rx_.consume(start - data);
+      continue;
+    }
 
+    const auto* end =
+        static_cast<const uint8_t*>(std::memchr(data + 1, FRAME_MARKER, n - 1));
+    if (!end) {
+      return false;  // Incomplete; keep it for the next read
+    }
+
+    // Too short to be a frame: we started reading mid-frame and took a
+    // closing marker for an opening one. Resync on the next marker.
+    size_t length = end - data + 1;
+    if (length < 4) {
+      ++rx_discarded_bytes_;
+      rx_.consume(1);
+      continue;
+    }
+
+    ++rx_frames_;
+    frame = data;
+    size = length;
+    return true;
+  }
+  return false;
+}
+
+bool Device::read_response(const uint8_t*& frame, size_t& size,
+                           int timeout_ms) {
+  ScopedTimer timer("read_response");
   struct pollfd pfd;
   pfd.fd = fd_;
   pfd.events = POLLIN;
 
   auto start = std::chrono::steady_clock::now();
 
-  while (true) {
+  while (!next_frame(frame, size)) {
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
                        std::chrono::steady_clock::now() - start)
                        .count();
 
     if (elapsed >= timeout_ms) {
-      break;
+      return false;
     }
 
     int remaining = timeout_ms - static_cast<int>(elapsed);
     int ret = poll(&pfd, 1, remaining);
 
     if (ret > 0 && (pfd.revents & POLLIN)) {
-      uint8_t buf[256];
-      ssize_t n = read(fd_, buf, sizeof(buf));
-      if (n > 0) {
-        response.insert(response.end(), buf, buf + n);
-
-        // Check if we have a complete frame
-        if (response.size() >= 2 && response.front() == FRAME_MARKER &&
-            response.back() == FRAME_MARKER) {
-          break;
-        }
-      }
+      fill();
     } else if (ret < 0 && errno != EINTR) {
-      break;
+      return false;
     }
   }
 
-  return response;
+  return true;
 }
 
-std::optional<Response> Device::send_command(const std::string& request_state,
-                                             const std::string& cmd_type,
-                                             const std::string& content,
-                                             bool wait_response) {
+bool Device::write_frame(std::string_view request_state,
+                         std::string_view cmd_type, std::string_view content) {
+  ++seq_number_;
+  build_frame_into(tx_, request_state, cmd_type, content, "1", seq_number_);
+
+  char seq[12];
+  auto seq_end = std::to_chars(seq, seq + sizeof(seq), seq_number_).ptr;
+  const LogField cmd_field{"CMD", cmd_type};
+  Log::hex(LogLevel::Debug, "Sending", tx_.data(), tx_.size(),
+           {cmd_field, {"SEQ", std::string_view(seq, seq_end - seq)}});
+
+  ssize_t written = write(fd_, tx_.data(), tx_.size());
+  if (written != static_cast<ssize_t>(tx_.size())) {
+    Log::write(LogLevel::Warning, "Write failed",
+               {{"PORT", port_}, cmd_field, {"ERROR", strerror(errno)}});
+    return false;
+  }
+
+  tcdrain(fd_);
+  return true;
+}
+
+std::optional<FrameView> Device::exchange(std::string_view request_state,
+                                          std::string_view cmd_type,
+                                          std::string_view content,
+                                          bool wait_response) {
   if (fd_ < 0) {
     return std::nullopt;
   }
+  ScopedTimer timer("send_command", cmd_type);
 
-  ++seq_number_;
-  auto frame = build_frame(request_state, cmd_type, content, "1", seq_number_);
-
-  if (verbose_) {
-    std::cout << "Sending: " << cmd_type << "\n";
-    std::cout << "Frame hex: ";
-    for (uint8_t b : frame) {
-      std::cout << std::hex << std::uppercase << std::setfill('0')
-                << std::setw(2) << static_cast<int>(b);
+  // Replies to earlier fire-and-forget commands would otherwise be taken
+  // as the reply to this one
+  if (wait_response) {
+    while (fill() > 0) {
+    }
+    const uint8_t* stale;
+    size_t stale_size;
+    while (next_frame(stale, stale_size)) {
+      rx_.consume(stale_size);
+      ++rx_stale_frames_;
     }
-    std::cout << std::dec << "\n";
   }
 
-  ssize_t written = write(fd_, frame.data(), frame.size());
-  if (written != static_cast<ssize_t>(frame.size())) {
-    if (verbose_) {
-      std::cerr << "Write failed\n";
-    }
+  if (!write_frame(request_state, cmd_type, content) || !wait_response) {
     return std::nullopt;
   }
 
-  tcdrain(fd_);
+  char seq[12];
+  auto seq_end = std::to_chars(seq, seq + sizeof(seq), seq_number_).ptr;
+  const LogField cmd_field{"CMD", cmd_type};
+  const LogField seq_field{"SEQ", std::string_view(seq, seq_end - seq)};
+
+  {
+    ScopedTimer sleep("reply_delay");
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
 
-  if (!wait_response) {
+  const uint8_t* frame;
+  size_t frame_size;
+  if (!read_response(frame, frame_size, 1000)) {
+    Log::write(LogLevel::Warning, "No response received",
+               {{"PORT", port_}, cmd_field, seq_field});
     return std::nullopt;
   }
 
-  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  // Parsing unescapes into scratch_, after which the frame can go
+  auto parsed = parse_frame(frame, frame_size, scratch_);
+  Log::hex(LogLevel::Debug, parsed ? "Received" : "Unparseable reply", frame,
+           frame_size,
+           {cmd_field, seq_field,
+            {"STATUS", parsed ? parsed->status : std::string_view()}});
+  rx_.consume(frame_size);
 
-  auto response = read_response(1000);
+  return parsed;
+}
 
-  if (response.empty()) {
-    if (verbose_) {
-      std::cout << "No response received\n";
-    }
+bool Device::post(std::string_view cmd_type, std::string_view content) {
+  return fd_ >= 0 && write_frame("POST", cmd_type, content);
+}
+
+std::optional<Response> Device::send_command(const std::string& request_state,
+                                             const std::string& cmd_type,
+                                             const std::string& content,
+                                             bool wait_response) {
+  auto view = exchange(request_state, cmd_type, content, wait_response);
+  if (!view) {
     return std::nullopt;
   }
 
-  if (verbose_) {
-    std::cout << "Response hex: ";
-    for (uint8_t b : response) {
-      std::cout << std::hex << std::uppercase << std::setfill('0')
-                << std::setw(2) << static_cast<int>(b);
-    }
-    std::cout << std::dec << "\n";
-  }
+  return to_response(*view);
+}
 
-  auto parsed = parse_response(response);
-  if (verbose_ && parsed) {
-    std::cout << "Parsed: " << parsed->raw << "\n";
+bool Device::keepalive() {
+  // Same exchange as handshake(), but the reply is only validated in
+  // place: no Response copy, no picojson DOM, no DeviceInfo strings
+  auto view = exchange("POST", "conn", "", true);
+  if (!view || view->body.empty() || !is_valid_json(view->body)) {
+    return false;
   }
-
-  return parsed;
+  pump_rpm_ = find_pump_rpm(view->body).value_or(-1);
+  return true;
 }
 
 std::optional<DeviceInfo> Device::handshake() {
+  ScopedTimer timer("handshake");
   auto response = send_command("POST", "conn", "");
 
   if (!response || !response->json) {
@@ -310,10 +480,13 @@ std::optional<DeviceInfo> Device::handshake() {
     }
   }
 
+  pump_rpm_ = find_pump_rpm(response->body).value_or(-1);
+  info.pump_rpm = pump_rpm_;
+
   return info;
 }
 
-std::optional<Response> Device::set_screen_config(const ScreenConfig& config) {
+std::string Device::encode_screen_config(const ScreenConfig& config) {
   // Build media array
   picojson::array media_arr;
   for (const auto& m : config.media) {
@@ -344,19 +517,28 @@ std::optional<Response> Device::set_screen_config(const ScreenConfig& config) {
   cfg["settings"] = picojson::value(settings);
   cfg["sysinfoDisplay"] = picojson::value(picojson::array());
 
-  std::string content = picojson::value(cfg).serialize();
+  return picojson::value(cfg).serialize();
+}
+
+std::optional<Response> Device::set_screen_config(const ScreenConfig& config) {
+  ScopedTimer timer("set_screen_config");
+  std::string content = encode_screen_config(config);
 
   // Send twice (workaround for cached config)
   send_command("POST", "waterBlockScreenId", content);
-  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  {
+    ScopedTimer sleep("resend_delay");
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
   return send_command("POST", "waterBlockScreenId", content);
 }
 
-std::optional<Response> Device::set_brightness(int value) {
+std::optional<Response> Device::set_brightness(int value,
+                                               bool wait_response) {
   picojson::object obj;
   obj["value"] = picojson::value(static_cast<double>(value));
   std::string content = picojson::value(obj).serialize();
-  return send_command("POST", "brightness", content);
+  return send_command("POST", "brightness", content, wait_response);
 }
 
 std::optional<Response> Device::delete_media(
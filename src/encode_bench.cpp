@@ -0,0 +1,339 @@
+#include "reed/encode_bench.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "reed/adb.hpp"
+#include "reed/shell.hpp"
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+// Scratch files for the ADB probe: small enough to be all overhead, and
+// large enough to be mostly transfer
+constexpr uint64_t PROBE_SMALL = 64 * 1024;
+constexpr uint64_t PROBE_LARGE = 4 * 1024 * 1024;
+constexpr const char* PROBE_NAME = "reed-bench-probe.bin";
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+struct Timed {
+  bool ok = false;
+  double wall_s = 0;
+  double cpu_s = 0;
+  std::string errors;  // The command's stderr
+};
+
+// Runs a shell command and waits for it with wait4(), which hands back the
+// child's own CPU time; popen() would only give the exit status
+Timed run_timed(const std::string& command) {
+  Timed result;
+  // Close-on-exec: workers fork concurrently, and a write end leaking
+  // into another worker's ffmpeg would hold off our EOF until it exits.
+  // dup2() onto stderr clears the flag for our own child.
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    return result;
+  }
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return result;
+  }
+  if (pid == 0) {
+    int null = open("/dev/null", O_RDWR | O_CLOEXEC);
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    close(fds[0]);
+    execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+    _exit(127);
+  }
+  close(fds[1]);
+
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buffer, sizeof(buffer))) > 0 ||
+         (n < 0 && errno == EINTR)) {
+    if (n > 0) {
+      result.errors.append(buffer, n);
+    }
+  }
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage {};
+  while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {
+  }
+  result.wall_s = seconds_since(start);
+  result.cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                 usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  result.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return result;
+}
+
+// The number after the last `key` in ffmpeg's log, e.g. "All:" in
+// "SSIM Y:0.99 U:0.99 V:0.99 All:0.991 (20.4)"
+std::optional<double> last_value(const std::string& log,
+                                 const std::string& line_tag,
+                                 const std::string& key) {
+  size_t line = log.rfind(line_tag);
+  if (line == std::string::npos) {
+    return std::nullopt;
+  }
+  size_t at = log.find(key, line);
+  if (at == std::string::npos) {
+    return std::nullopt;
+  }
+  std::string text = log.substr(at + key.size(), 16);
+  if (text.compare(0, 3, "inf") == 0) {
+    return 100.0;
+  }
+  char* end = nullptr;
+  double value = std::strtod(text.c_str(), &end);
+  if (end == text.c_str()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+void encode_one(const std::string& input, const EncodeProfile& profile,
+                const std::string& output, EncodeRun& run) {
+  Timed encode = run_timed("ffmpeg -y -nostdin -hide_banner -i " +
+                           shell_quote(input) + " -an " +
+                           Media::encode_args(profile) + " -threads 1 " +
+                           shell_quote(output));
+  run.wall_s = encode.wall_s;
+  run.cpu_s = encode.cpu_s;
+  std::error_code ec;
+  uint64_t bytes = fs::file_size(output, ec);
+  if (!encode.ok || ec || bytes == 0) {
+    fs::remove(output, ec);
+    return;
+  }
+  run.bytes = bytes;
+
+  // Scored at the source size: a downscaled encode pays for the detail it
+  // dropped, as it will once the panel scales it back up
+  Timed score = run_timed(
+      "ffmpeg -nostdin -hide_banner -nostats -i " + shell_quote(output) +
+      " -i " + shell_quote(input) +
+      " -lavfi \"[0:v][1:v]scale2ref=flags=bicubic[enc][ref];"
+      "[enc]split[e1][e2];[ref]split[r1][r2];[e1][r1]ssim;[e2][r2]psnr\""
+      " -threads 1 -f null -");
+  fs::remove(output, ec);
+  auto ssim = last_value(score.errors, "SSIM ", "All:");
+  auto psnr = last_value(score.errors, "PSNR ", "average:");
+  if (!score.ok || !ssim || !psnr) {
+    return;
+  }
+  run.ssim = *ssim;
+  run.psnr = std::min(*psnr, 100.0);
+  run.ok = true;
+}
+
+bool write_probe(const std::string& path, uint64_t size) {
+  // Noise, so adb's transfer compression cannot shrink it
+  std::ofstream file(path, std::ios::binary);
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for (uint64_t i = 0; i < size && file; i += 8) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    file.write(reinterpret_cast<const char*>(&state), 8);
+  }
+  return static_cast<bool>(file);
+}
+
+std::optional<double> time_push(const std::string& path) {
+  auto start = std::chrono::steady_clock::now();
+  if (!Adb::push(path, PROBE_NAME)) {
+    return std::nullopt;
+  }
+  return seconds_since(start);
+}
+
+}  // namespace
+
+std::vector<EncodeProfile> default_encode_grid() {
+  std::vector<EncodeProfile> grid;
+  for (int max_height : {0, Media::PANEL_HEIGHT}) {
+    for (const char* preset : {"ultrafast", "veryfast", "medium", "slow"}) {
+      for (int crf : {20, 23, 26, 30}) {
+        EncodeProfile profile;
+        profile.preset = preset;
+        profile.crf = crf;
+        profile.max_height = max_height;
+        grid.push_back(profile);
+      }
+    }
+  }
+  return grid;
+}
+
+std::optional<AdbThroughput> measure_adb_throughput(const std::string& dir) {
+  if (!Adb::is_device_connected()) {
+    return std::nullopt;
+  }
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  std::string small = dir + "probe-small.bin";
+  std::string large = dir + "probe-large.bin";
+  if (!write_probe(small, PROBE_SMALL) || !write_probe(large, PROBE_LARGE)) {
+    return std::nullopt;
+  }
+
+  // The first push also warms up the adb server, so it is not counted
+  std::optional<double> small_s, large_s;
+  if (time_push(small)) {
+    small_s = time_push(small);
+    large_s = time_push(large);
+  }
+  Adb::remove(PROBE_NAME);
+  fs::remove(small, ec);
+  fs::remove(large, ec);
+  if (!small_s || !large_s || *large_s <= 0) {
+    return std::nullopt;
+  }
+
+  AdbThroughput throughput;
+  if (*large_s > *small_s) {
+    throughput.bytes_per_s =
+        (PROBE_LARGE - PROBE_SMALL) / (*large_s - *small_s);
+    throughput.overhead_s =
+        std::max(0.0, *small_s - PROBE_SMALL / throughput.bytes_per_s);
+  } else {
+    // Too noisy to separate the two; charge everything to the transfer
+    throughput.bytes_per_s = PROBE_LARGE / *large_s;
+  }
+  return throughput;
+}
+
+std::vector<EncodeRun> run_encode_bench(const std::vector<std::string>& inputs,
+                                        const EncodeBenchOptions& options) {
+  const std::vector<EncodeProfile> grid =
+      options.grid.empty() ? default_encode_grid() : options.grid;
+  std::error_code ec;
+  fs::create_directories(options.dir, ec);
+
+  std::vector<EncodeRun> runs;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    for (size_t p = 0; p < grid.size(); ++p) {
+      EncodeRun run;
+      run.profile = p;
+      run.input = inputs[i];
+      runs.push_back(run);
+    }
+  }
+
+  unsigned jobs = options.jobs > 0
+                      ? options.jobs
+                      : std::max(1u, std::thread::hardware_concurrency());
+  jobs = std::min<size_t>(jobs, std::max<size_t>(runs.size(), 1));
+
+  // Workers take the next run off a shared counter
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (unsigned j = 0; j < jobs; ++j) {
+    workers.emplace_back([&]() {
+      for (size_t r = next++; r < runs.size(); r = next++) {
+        std::string output =
+            options.dir + "run-" + std::to_string(r) + ".mp4";
+        encode_one(runs[r].input, grid[runs[r].profile], output, runs[r]);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  return runs;
+}
+
+std::vector<EncodeSummary> summarize_encode_bench(
+    const std::vector<EncodeRun>& runs,
+    const std::vector<EncodeProfile>& grid,
+    const std::optional<AdbThroughput>& throughput) {
+  std::vector<EncodeSummary> summaries(grid.size());
+  for (size_t p = 0; p < grid.size(); ++p) {
+    summaries[p].profile = grid[p];
+    if (throughput) {
+      summaries[p].upload_s = 0;
+    }
+  }
+  for (const EncodeRun& run : runs) {
+    if (!run.ok || run.profile >= summaries.size()) {
+      continue;
+    }
+    EncodeSummary& s = summaries[run.profile];
+    ++s.ok;
+    s.wall_s += run.wall_s;
+    s.cpu_s += run.cpu_s;
+    s.bytes += run.bytes;
+    s.ssim += run.ssim;
+    s.psnr += run.psnr;
+    if (throughput) {
+      s.upload_s += throughput->upload_s(run.bytes);
+    }
+  }
+  for (EncodeSummary& s : summaries) {
+    if (s.ok > 0) {
+      s.ssim /= s.ok;
+      s.psnr /= s.ok;
+    }
+  }
+  return summaries;
+}
+
+std::optional<size_t> recommend_encode_profile(
+    const std::vector<EncodeSummary>& summaries, size_t inputs,
+    double min_ssim) {
+  auto cost = [](const EncodeSummary& s) {
+    return s.wall_s + std::max(s.upload_s, 0.0);
+  };
+
+  std::optional<size_t> best;
+  for (size_t i = 0; i < summaries.size(); ++i) {
+    const EncodeSummary& s = summaries[i];
+    if (inputs == 0 || s.ok < inputs || s.ssim < min_ssim) {
+      continue;
+    }
+    if (!best || cost(s) < cost(summaries[*best]) ||
+        (cost(s) == cost(summaries[*best]) &&
+         s.bytes < summaries[*best].bytes)) {
+      best = i;
+    }
+  }
+  if (best) {
+    return best;
+  }
+
+  for (size_t i = 0; i < summaries.size(); ++i) {
+    if (summaries[i].ok > 0 &&
+        (!best || summaries[i].ssim > summaries[*best].ssim)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+}  // namespace reed
@@ -0,0 +1,210 @@
+#include "reed/event_loop.hpp"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+namespace reed {
+
+namespace {
+
+itimerspec make_timer_spec(std::chrono::milliseconds interval, bool repeat) {
+  itimerspec spec{};
+  auto ms = interval.count() > 0 ? interval.count() : 1;
+  spec.it_value.tv_sec = ms / 1000;
+  spec.it_value.tv_nsec = (ms % 1000) * 1000000;
+  if (repeat) {
+    spec.it_interval = spec.it_value;
+  }
+  return spec;
+}
+
+}  // namespace
+
+EventLoop::EventLoop() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+}
+
+EventLoop::~EventLoop() {
+  for (const auto& entry : timers_) {
+    close(entry.first);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+bool EventLoop::add(int fd, Callback cb) {
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    return false;
+  }
+  // A fd number closed and reused within one dispatch must not be dropped
+  removed_.erase(std::remove(removed_.begin(), removed_.end(), fd),
+                 removed_.end());
+  handlers_[fd] = std::move(cb);
+  return true;
+}
+
+void EventLoop::remove(int fd) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (dispatching_) {
+    // The handler may be the one running right now; erase after dispatch
+    removed_.push_back(fd);
+  } else {
+    handlers_.erase(fd);
+  }
+}
+
+int EventLoop::add_timer(std::chrono::milliseconds interval, Callback cb,
+                         bool repeat) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  itimerspec spec = make_timer_spec(interval, repeat);
+  if (timerfd_settime(fd, 0, &spec, nullptr) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  timers_[fd] = std::move(cb);
+  bool ok = add(fd, [this, fd]() {
+    // Drain the expiration count so the fd stops polling readable
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) > 0) {
+      auto it = timers_.find(fd);
+      if (it != timers_.end()) {
+        it->second();
+      }
+    }
+  });
+
+  if (!ok) {
+    timers_.erase(fd);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+bool EventLoop::rearm_timer(int id, std::chrono::milliseconds interval,
+                            bool repeat) {
+  if (timers_.count(id) == 0) {
+    return false;
+  }
+  itimerspec spec = make_timer_spec(interval, repeat);
+  return timerfd_settime(id, 0, &spec, nullptr) == 0;
+}
+
+int EventLoop::add_alarm(Callback cb) {
+  int fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  timers_[fd] = std::move(cb);
+  bool ok = add(fd, [this, fd]() {
+    uint64_t expirations;
+    // ECANCELED: clock was set while armed with TFD_TIMER_CANCEL_ON_SET
+    if (read(fd, &expirations, sizeof(expirations)) > 0 || errno == ECANCELED) {
+      auto it = timers_.find(fd);
+      if (it != timers_.end()) {
+        it->second();
+      }
+    }
+  });
+
+  if (!ok) {
+    timers_.erase(fd);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+bool EventLoop::set_alarm(int id, std::chrono::system_clock::time_point when) {
+  if (timers_.count(id) == 0) {
+    return false;
+  }
+
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                when.time_since_epoch())
+                .count();
+  itimerspec spec{};
+  spec.it_value.tv_sec = ns / 1000000000;
+  spec.it_value.tv_nsec = ns % 1000000000;
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+    spec.it_value.tv_nsec = 1;  // all-zero would disarm
+  }
+
+  return timerfd_settime(id, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                         &spec, nullptr) == 0;
+}
+
+void EventLoop::remove_timer(int id) {
+  if (timers_.count(id) == 0) {
+    return;
+  }
+  remove(id);
+  if (dispatching_) {
+    removed_timers_.push_back(id);
+  } else {
+    timers_.erase(id);
+    close(id);
+  }
+}
+
+void EventLoop::run_once(int timeout_ms) {
+  epoll_event events[16];
+  int n = epoll_wait(epoll_fd_, events, 16, timeout_ms);
+  ++wakeups_;
+  if (n < 0) {
+    if (errno != EINTR) {
+      running_ = false;
+    }
+    return;
+  }
+
+  dispatching_ = true;
+  for (int i = 0; i < n; ++i) {
+    int fd = events[i].data.fd;
+    // An earlier callback in this batch may have removed it
+    if (std::find(removed_.begin(), removed_.end(), fd) != removed_.end()) {
+      continue;
+    }
+    auto it = handlers_.find(fd);
+    if (it != handlers_.end()) {
+      it->second();
+    }
+  }
+  dispatching_ = false;
+
+  for (int fd : removed_) {
+    handlers_.erase(fd);
+  }
+  removed_.clear();
+  for (int fd : removed_timers_) {
+    timers_.erase(fd);
+    close(fd);
+  }
+  removed_timers_.clear();
+}
+
+void EventLoop::run() {
+  running_ = true;
+  while (running_) {
+    run_once(-1);
+  }
+}
+
+}  // namespace reed
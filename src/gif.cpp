@@ -0,0 +1,350 @@
+#include "reed/gif.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace reed {
+
+namespace {
+
+constexpr int MAX_CODES = 4096;
+
+uint16_t read_u16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+// Packs R, G, B, A so they land in memory in that order
+uint32_t rgba(uint8_t r, uint8_t g, uint8_t b) {
+  uint32_t pixel;
+  uint8_t bytes[4] = {r, g, b, 255};
+  std::memcpy(&pixel, bytes, 4);
+  return pixel;
+}
+
+}  // namespace
+
+bool GifDecoder::open(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return fail("cannot open " + path);
+  }
+  data_.assign(std::istreambuf_iterator<char>(file),
+               std::istreambuf_iterator<char>());
+  pos_ = 0;
+
+  if (data_.size() < 13 || (std::memcmp(data_.data(), "GIF87a", 6) != 0 &&
+                            std::memcmp(data_.data(), "GIF89a", 6) != 0)) {
+    return fail("not a GIF");
+  }
+  width_ = read_u16(&data_[6]);
+  height_ = read_u16(&data_[8]);
+  uint8_t packed = data_[10];
+  pos_ = 13;
+  if (width_ == 0 || height_ == 0) {
+    return fail("empty logical screen");
+  }
+  if (static_cast<size_t>(width_) * height_ > MAX_PIXELS) {
+    return fail("logical screen too large");
+  }
+
+  has_global_palette_ = packed & 0x80;
+  if (has_global_palette_ &&
+      !read_palette(global_palette_, 2 << (packed & 0x07))) {
+    return false;
+  }
+
+  canvas_.assign(static_cast<size_t>(width_) * height_, 0);
+  dispose_ = 0;
+  error_.clear();
+  return true;
+}
+
+bool GifDecoder::next() {
+  int delay_cs = 0;
+  int transparent = -1;
+  int disposal = 0;
+
+  while (pos_ < data_.size()) {
+    uint8_t block = data_[pos_++];
+
+    if (block == 0x3B) {  // Trailer
+      return false;
+    }
+
+    if (block == 0x21) {  // Extension
+      if (pos_ >= data_.size()) {
+        return fail("truncated extension");
+      }
+      uint8_t label = data_[pos_++];
+      if (label == 0xF9 && pos_ + 5 <= data_.size() && data_[pos_] >= 4) {
+        // Graphic control: disposal, delay and transparency of the next
+        // image
+        uint8_t packed = data_[pos_ + 1];
+        disposal = (packed >> 2) & 0x07;
+        delay_cs = read_u16(&data_[pos_ + 2]);
+        transparent = (packed & 0x01) ? data_[pos_ + 4] : -1;
+      }
+      if (!skip_sub_blocks()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (block != 0x2C) {
+      return fail("unknown block");
+    }
+
+    // Image descriptor
+    if (pos_ + 9 > data_.size()) {
+      return fail("truncated image descriptor");
+    }
+    int left = read_u16(&data_[pos_]);
+    int top = read_u16(&data_[pos_ + 2]);
+    int w = read_u16(&data_[pos_ + 4]);
+    int h = read_u16(&data_[pos_ + 6]);
+    uint8_t packed = data_[pos_ + 8];
+    pos_ += 9;
+
+    uint32_t local_palette[256];
+    const uint32_t* palette = global_palette_;
+    if (packed & 0x80) {
+      if (!read_palette(local_palette, 2 << (packed & 0x07))) {
+        return false;
+      }
+      palette = local_palette;
+    } else if (!has_global_palette_) {
+      return fail("image without a palette");
+    }
+
+    if (pos_ >= data_.size()) {
+      return fail("truncated image data");
+    }
+    int min_code_size = data_[pos_++];
+
+    // Interlaced images store rows 0, 8, 16.. then 4, 12.. then 2, 6..
+    // then the odd rows
+    std::vector<int> rows(h);
+    if (packed & 0x40) {
+      int r = 0;
+      for (int start : {0, 4, 2, 1}) {
+        int step = start == 0 ? 8 : start * 2;
+        for (int y = start; y < h; y += step) {
+          rows[r++] = y;
+        }
+      }
+    } else {
+      for (int y = 0; y < h; ++y) {
+        rows[y] = y;
+      }
+    }
+
+    // Only the part on the logical screen is kept; a frame may claim up
+    // to 65535 x 65535
+    int x0 = std::min(left, width_);
+    int y0 = std::min(top, height_);
+    int visible_w = std::min(left + w, width_) - x0;
+    int visible_h = std::min(top + h, height_) - y0;
+    if (!decode_lzw(min_code_size, w, rows, visible_w, visible_h)) {
+      return false;
+    }
+
+    dispose();
+    if (disposal == 3) {
+      saved_ = canvas_;
+    }
+
+    // Palette expansion: one 32-bit table lookup per pixel. The
+    // transparent case is a select rather than a branch, so both loops
+    // stay simple enough for the compiler to vectorize.
+    for (int y = 0; y < visible_h; ++y) {
+      const uint8_t* src = &indices_[static_cast<size_t>(y) * visible_w];
+      uint32_t* dst = &canvas_[static_cast<size_t>(y0 + y) * width_ + x0];
+      if (transparent < 0) {
+        for (int x = 0; x < visible_w; ++x) {
+          dst[x] = palette[src[x]];
+        }
+      } else {
+        auto keep = static_cast<uint8_t>(transparent);
+        for (int x = 0; x < visible_w; ++x) {
+          dst[x] = src[x] == keep ? dst[x] : palette[src[x]];
+        }
+      }
+    }
+
+    dispose_ = disposal;
+    dispose_x_ = x0;
+    dispose_y_ = y0;
+    dispose_w_ = visible_w;
+    dispose_h_ = visible_h;
+
+    // Browsers show 0 and 1 centisecond frames for 100 ms
+    delay_ms_ = (delay_cs < 2 ? 10 : delay_cs) * 10;
+    return true;
+  }
+  return false;  // No trailer; treat the end of data as one
+}
+
+bool GifDecoder::fail(const std::string& message) {
+  error_ = message;
+  return false;
+}
+
+bool GifDecoder::read_palette(uint32_t* palette, int entries) {
+  if (pos_ + entries * 3 > data_.size()) {
+    return fail("truncated palette");
+  }
+  for (int i = 0; i < 256; ++i) {
+    palette[i] = 0;
+  }
+  for (int i = 0; i < entries; ++i, pos_ += 3) {
+    palette[i] = rgba(data_[pos_], data_[pos_ + 1], data_[pos_ + 2]);
+  }
+  return true;
+}
+
+bool GifDecoder::skip_sub_blocks() {
+  while (pos_ < data_.size()) {
+    uint8_t size = data_[pos_++];
+    if (size == 0) {
+      return true;
+    }
+    pos_ += size;
+  }
+  return fail("truncated sub-blocks");
+}
+
+// Decodes a w-wide image whose stream row r is image row rows[r], keeping
+// the top-left visible_w x visible_h of it in indices_
+bool GifDecoder::decode_lzw(int min_code_size, int w,
+                            const std::vector<int>& rows, int visible_w,
+                            int visible_h) {
+  if (min_code_size < 1 || min_code_size > 8) {
+    return fail("bad LZW code size");
+  }
+  indices_.assign(static_cast<size_t>(visible_w) * visible_h, 0);
+  size_t pixels = static_cast<size_t>(w) * rows.size();
+  int col = 0;
+  size_t row = 0;
+
+  uint16_t prefix[MAX_CODES];
+  uint8_t suffix[MAX_CODES];
+  uint8_t stack[MAX_CODES + 1];
+  int clear = 1 << min_code_size;
+  int end = clear + 1;
+  for (int i = 0; i < clear; ++i) {
+    prefix[i] = 0;
+    suffix[i] = static_cast<uint8_t>(i);
+  }
+
+  int code_size = min_code_size + 1;
+  int next = end + 1;
+  int prev = -1;
+  uint8_t first = 0;
+  size_t out = 0;
+
+  uint32_t bits = 0;
+  int bit_count = 0;
+  size_t block_left = 0;
+  bool done = false;
+
+  while (!done) {
+    // Pull bytes across the sub-block boundaries until a code is complete
+    while (bit_count < code_size) {
+      if (block_left == 0) {
+        if (pos_ >= data_.size()) {
+          return fail("truncated image data");
+        }
+        block_left = data_[pos_++];
+        if (block_left == 0) {
+          return true;  // Data ended without an end code
+        }
+      }
+      if (pos_ >= data_.size()) {
+        return fail("truncated image data");
+      }
+      bits |= static_cast<uint32_t>(data_[pos_++]) << bit_count;
+      bit_count += 8;
+      --block_left;
+    }
+    int code = static_cast<int>(bits & ((1u << code_size) - 1));
+    bits >>= code_size;
+    bit_count -= code_size;
+
+    if (code == clear) {
+      code_size = min_code_size + 1;
+      next = end + 1;
+      prev = -1;
+      continue;
+    }
+    if (code == end) {
+      done = true;
+      continue;
+    }
+
+    int in = code;
+    int depth = 0;
+    if (prev < 0) {
+      if (code >= clear) {
+        return fail("bad LZW code");
+      }
+    } else if (code > next || (code == next && next >= MAX_CODES)) {
+      return fail("bad LZW code");
+    } else if (code == next) {
+      // The string being defined: the previous one plus its first byte
+      stack[depth++] = first;
+      code = prev;
+    }
+    while (code >= clear) {
+      stack[depth++] = suffix[code];
+      code = prefix[code];
+    }
+    first = static_cast<uint8_t>(code);
+    stack[depth++] = first;
+
+    while (depth > 0 && out < pixels) {
+      uint8_t index = stack[--depth];
+      if (col < visible_w && rows[row] < visible_h) {
+        indices_[static_cast<size_t>(rows[row]) * visible_w + col] = index;
+      }
+      ++out;
+      if (++col == w) {
+        col = 0;
+        ++row;
+      }
+    }
+
+    if (prev >= 0 && next < MAX_CODES) {
+      prefix[next] = static_cast<uint16_t>(prev);
+      suffix[next] = first;
+      ++next;
+      if (next == (1 << code_size) && code_size < 12) {
+        ++code_size;
+      }
+    }
+    prev = in;
+  }
+
+  // Skip whatever follows the end code in this image's data
+  while (block_left > 0 && pos_ < data_.size()) {
+    ++pos_;
+    --block_left;
+  }
+  return skip_sub_blocks();
+}
+
+void GifDecoder::dispose() {
+  if (dispose_ == 2) {
+    // Restore to background: browsers clear to transparent
+    for (int y = dispose_y_; y < dispose_y_ + dispose_h_; ++y) {
+      std::fill_n(&canvas_[static_cast<size_t>(y) * width_ + dispose_x_],
+                  dispose_w_, 0);
+    }
+  } else if (dispose_ == 3 && saved_.size() == canvas_.size()) {
+    canvas_.swap(saved_);
+  }
+  dispose_ = 0;
+}
+
+}  // namespace reed
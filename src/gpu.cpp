@@ -0,0 +1,287 @@
+#include "reed/gpu.hpp"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+
+#include "reed/sysfs.hpp"
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+bool is_card(const std::string& name) {
+  return name.size() > 4 && name.compare(0, 4, "card") == 0 &&
+         std::all_of(name.begin() + 4, name.end(),
+                     [](char c) { return std::isdigit(c); });
+}
+
+double read_scaled(const SysfsFile& file, double scale) {
+  auto value = file.read_int();
+  return value ? static_cast<double>(*value) * scale : NAN;
+}
+
+class SysfsGpuBackend : public GpuBackend {
+ public:
+  struct Card {
+    std::string name;
+    SysfsFile busy;       // percent
+    SysfsFile vram_used;  // bytes
+    SysfsFile temp;       // millidegrees C
+    SysfsFile clock;
+    double clock_scale = 1.0;  // to MHz
+    double vram_total_mb = NAN;
+  };
+
+  explicit SysfsGpuBackend(std::vector<Card> cards)
+      : cards_(std::move(cards)) {}
+
+  const char* backend_name() const override { return "sysfs"; }
+  size_t count() const override { return cards_.size(); }
+  const std::string& device_name(size_t index) const override {
+    return cards_[index].name;
+  }
+
+  void read(GpuSample* out) override {
+    for (size_t i = 0; i < cards_.size(); ++i) {
+      const Card& card = cards_[i];
+      GpuSample& s = out[i];
+      s.busy_percent = read_scaled(card.busy, 1.0);
+      s.vram_used_mb = read_scaled(card.vram_used, 1.0 / (1024 * 1024));
+      s.vram_total_mb = card.vram_total_mb;
+      s.temperature_c = read_scaled(card.temp, 0.001);
+      s.clock_mhz = read_scaled(card.clock, card.clock_scale);
+    }
+  }
+
+ private:
+  std::vector<Card> cards_;
+};
+
+// NVML's C API, declared here so no NVIDIA header is needed to build
+using nvmlReturn_t = int;
+using nvmlDevice_t = struct nvmlDevice_st*;
+struct nvmlUtilization_t {
+  unsigned int gpu;
+  unsigned int memory;
+};
+struct nvmlMemory_t {
+  unsigned long long total;
+  unsigned long long free;
+  unsigned long long used;
+};
+constexpr nvmlReturn_t NVML_SUCCESS = 0;
+constexpr int NVML_TEMPERATURE_GPU = 0;
+constexpr int NVML_CLOCK_GRAPHICS = 0;
+
+class NvmlGpuBackend : public GpuBackend {
+ public:
+  ~NvmlGpuBackend() override {
+    if (initialized_) {
+      shutdown_();
+    }
+    if (handle_) {
+      dlclose(handle_);
+    }
+  }
+
+  bool load(const std::string& library) {
+    handle_ = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle_) {
+      return false;
+    }
+
+    bool resolved = resolve(init_, "nvmlInit_v2") &&
+                    resolve(shutdown_, "nvmlShutdown") &&
+                    resolve(get_count_, "nvmlDeviceGetCount_v2") &&
+                    resolve(get_handle_, "nvmlDeviceGetHandleByIndex_v2") &&
+                    resolve(get_name_, "nvmlDeviceGetName") &&
+                    resolve(get_utilization_,
+                            "nvmlDeviceGetUtilizationRates") &&
+                    resolve(get_memory_, "nvmlDeviceGetMemoryInfo") &&
+                    resolve(get_temperature_, "nvmlDeviceGetTemperature") &&
+                    resolve(get_clock_, "nvmlDeviceGetClockInfo");
+    if (!resolved || init_() != NVML_SUCCESS) {
+      return false;
+    }
+    initialized_ = true;
+
+    unsigned int count = 0;
+    if (get_count_(&count) != NVML_SUCCESS) {
+      return false;
+    }
+    for (unsigned int i = 0; i < count; ++i) {
+      nvmlDevice_t device;
+      if (get_handle_(i, &device) != NVML_SUCCESS) {
+        continue;
+      }
+      char name[96] = {};
+      if (get_name_(device, name, sizeof(name)) != NVML_SUCCESS) {
+        std::snprintf(name, sizeof(name), "nvidia%u", i);
+      }
+      devices_.push_back(device);
+      names_.push_back(name);
+    }
+    return !devices_.empty();
+  }
+
+  const char* backend_name() const override { return "nvml"; }
+  size_t count() const override { return devices_.size(); }
+  const std::string& device_name(size_t index) const override {
+    return names_[index];
+  }
+
+  void read(GpuSample* out) override {
+    for (size_t i = 0; i < devices_.size(); ++i) {
+      nvmlDevice_t device = devices_[i];
+      GpuSample& s = out[i];
+      s = GpuSample{};
+
+      nvmlUtilization_t utilization;
+      if (get_utilization_(device, &utilization) == NVML_SUCCESS) {
+        s.busy_percent = utilization.gpu;
+      }
+      nvmlMemory_t memory;
+      if (get_memory_(device, &memory) == NVML_SUCCESS) {
+        s.vram_used_mb = memory.used / (1024.0 * 1024.0);
+        s.vram_total_mb = memory.total / (1024.0 * 1024.0);
+      }
+      unsigned int value;
+      if (get_temperature_(device, NVML_TEMPERATURE_GPU, &value) ==
+          NVML_SUCCESS) {
+        s.temperature_c = value;
+      }
+      if (get_clock_(device, NVML_CLOCK_GRAPHICS, &value) == NVML_SUCCESS) {
+        s.clock_mhz = value;
+      }
+    }
+  }
+
+ private:
+  void* handle_ = nullptr;
+  bool initialized_ = false;
+  std::vector<nvmlDevice_t> devices_;
+  std::vector<std::string> names_;
+
+  nvmlReturn_t (*init_)() = nullptr;
+  nvmlReturn_t (*shutdown_)() = nullptr;
+  nvmlReturn_t (*get_count_)(unsigned int*) = nullptr;
+  nvmlReturn_t (*get_handle_)(unsigned int, nvmlDevice_t*) = nullptr;
+  nvmlReturn_t (*get_name_)(nvmlDevice_t, char*, unsigned int) = nullptr;
+  nvmlReturn_t (*get_utilization_)(nvmlDevice_t,
+                                   nvmlUtilization_t*) = nullptr;
+  nvmlReturn_t (*get_memory_)(nvmlDevice_t, nvmlMemory_t*) = nullptr;
+  nvmlReturn_t (*get_temperature_)(nvmlDevice_t, int, unsigned int*) =
+      nullptr;
+  nvmlReturn_t (*get_clock_)(nvmlDevice_t, int, unsigned int*) = nullptr;
+
+  template <typename Fn>
+  bool resolve(Fn& fn, const char* symbol) {
+    fn = reinterpret_cast<Fn>(dlsym(handle_, symbol));
+    return fn != nullptr;
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<GpuBackend> open_sysfs_gpus(const std::string& root) {
+  std::vector<SysfsGpuBackend::Card> cards;
+  std::error_code ec;
+  fs::path drm = fs::path(root + "/sys/class/drm");
+
+  std::vector<fs::path> paths;
+  for (const auto& entry : fs::directory_iterator(drm, ec)) {
+    if (is_card(entry.path().filename().string())) {
+      paths.push_back(entry.path());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+
+  for (const auto& path : paths) {
+    fs::path device = path / "device";
+    std::string driver =
+        fs::read_symlink(device / "driver", ec).filename().string();
+
+    // NVIDIA's driver exposes none of this; NVML covers those cards
+    if (driver == "nvidia") {
+      continue;
+    }
+
+    SysfsGpuBackend::Card card;
+    card.name = path.filename().string() +
+                (driver.empty() ? "" : " (" + driver + ")");
+    card.busy.open(device / "gpu_busy_percent");
+    card.vram_used.open(device / "mem_info_vram_used");
+
+    SysfsFile vram_total(device / "mem_info_vram_total");
+    if (auto total = vram_total.read_int()) {
+      card.vram_total_mb = *total / (1024.0 * 1024.0);
+    }
+
+    // Temperature, and on amdgpu the shader clock, come from the card's
+    // hwmon; i915 and xe report the clock on the card itself
+    for (const auto& hwmon : fs::directory_iterator(device / "hwmon", ec)) {
+      card.temp.open(hwmon.path() / "temp1_input");
+      if (card.clock.open(hwmon.path() / "freq1_input")) {
+        card.clock_scale = 1e-6;  // Hz
+      }
+      break;
+    }
+    if (!card.clock.is_open()) {
+      card.clock_scale = 1.0;
+      if (!card.clock.open(path / "gt_act_freq_mhz")) {
+        card.clock.open(path / "gt" / "gt0" / "rps_act_freq_mhz");
+      }
+    }
+
+    if (card.busy.is_open() || card.vram_used.is_open() ||
+        card.temp.is_open() || card.clock.is_open()) {
+      cards.push_back(std::move(card));
+    }
+  }
+
+  if (cards.empty()) {
+    return nullptr;
+  }
+  return std::make_unique<SysfsGpuBackend>(std::move(cards));
+}
+
+std::unique_ptr<GpuBackend> open_nvml(const std::string& library) {
+  auto backend = std::make_unique<NvmlGpuBackend>();
+  if (!backend->load(library)) {
+    return nullptr;
+  }
+  return backend;
+}
+
+GpuMonitor::GpuMonitor(const std::string& sysfs_root,
+                       const std::string& nvml_library) {
+  if (auto sysfs = open_sysfs_gpus(sysfs_root)) {
+    backends_.push_back(std::move(sysfs));
+  }
+  if (auto nvml = open_nvml(nvml_library)) {
+    backends_.push_back(std::move(nvml));
+  }
+
+  for (const auto& backend : backends_) {
+    for (size_t i = 0; i < backend->count(); ++i) {
+      names_.push_back(backend->device_name(i));
+    }
+  }
+  samples_.resize(names_.size());
+}
+
+void GpuMonitor::update() {
+  GpuSample* out = samples_.data();
+  for (const auto& backend : backends_) {
+    backend->read(out);
+    out += backend->count();
+  }
+}
+
+}  // namespace reed
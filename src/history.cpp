@@ -0,0 +1,326 @@
+#include "reed/history.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace reed {
+
+namespace {
+
+constexpr size_t ALIGN = 64;  // Cache line; keeps every array aligned
+
+constexpr size_t align_up(size_t n) {
+  return (n + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+// Bucket k of a ring holding `points` buckets, newest `newest`, is stored
+// if newest - points < k <= newest
+struct Window {
+  int64_t first;  // Inclusive
+  int64_t last;   // Inclusive; empty if last < first
+};
+
+Window window(int64_t newest, int points, int64_t end, size_t wanted) {
+  int64_t first = end - static_cast<int64_t>(wanted) + 1;
+  first = std::max(first, newest - points + 1);
+  return {first, std::min(end, newest)};
+}
+
+}  // namespace
+
+struct History::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t count;
+  uint32_t tier_seconds[HISTORY_TIER_COUNT];
+  uint32_t tier_points[HISTORY_TIER_COUNT];
+};
+
+History::~History() {
+  close();
+}
+
+size_t History::metric_size() {
+  size_t size = 0;
+  for (const auto& t : HISTORY_TIERS) {
+    size += ALIGN;  // bucket number
+    size += 3 * align_up(t.points * sizeof(float));
+    size += align_up(t.points * sizeof(uint32_t));
+  }
+  return size;
+}
+
+size_t History::layout_size(size_t capacity) {
+  return align_up(sizeof(Header)) + align_up(capacity * NAME_SIZE) +
+         capacity * metric_size();
+}
+
+History::Header* History::header() const {
+  return reinterpret_cast<Header*>(base_);
+}
+
+History::Tier History::tier(int metric, size_t t) const {
+  uint8_t* p = base_ + align_up(sizeof(Header)) +
+               align_up(header()->capacity * NAME_SIZE) +
+               metric * metric_size();
+  for (size_t i = 0; i < t; ++i) {
+    int points = HISTORY_TIERS[i].points;
+    p += ALIGN + 3 * align_up(points * sizeof(float)) +
+         align_up(points * sizeof(uint32_t));
+  }
+
+  size_t floats = align_up(HISTORY_TIERS[t].points * sizeof(float));
+  Tier tier;
+  tier.bucket = reinterpret_cast<int64_t*>(p);
+  tier.min = reinterpret_cast<float*>(p + ALIGN);
+  tier.max = reinterpret_cast<float*>(p + ALIGN + floats);
+  tier.sum = reinterpret_cast<float*>(p + ALIGN + 2 * floats);
+  tier.count = reinterpret_cast<uint32_t*>(p + ALIGN + 3 * floats);
+  return tier;
+}
+
+bool History::open(const std::string& path, size_t capacity,
+                   bool read_only) {
+  close();
+  read_only_ = read_only;
+
+  if (path.empty()) {
+    size_ = layout_size(capacity);
+    void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    base_ = static_cast<uint8_t*>(p);
+    reset(capacity);
+    return true;
+  }
+
+  int fd = ::open(path.c_str(),
+                  read_only ? O_RDONLY | O_CLOEXEC
+                            : O_RDWR | O_CREAT | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  Header existing{};
+  bool valid = fstat(fd, &st) == 0 &&
+               static_cast<size_t>(st.st_size) >= sizeof(Header) &&
+               pread(fd, &existing, sizeof(existing), 0) ==
+                   static_cast<ssize_t>(sizeof(existing)) &&
+               existing.magic == HISTORY_MAGIC &&
+               existing.version == HISTORY_VERSION;
+  for (size_t t = 0; valid && t < HISTORY_TIER_COUNT; ++t) {
+    valid = existing.tier_seconds[t] ==
+                static_cast<uint32_t>(HISTORY_TIERS[t].seconds) &&
+            existing.tier_points[t] ==
+                static_cast<uint32_t>(HISTORY_TIERS[t].points);
+  }
+  if (read_only) {
+    capacity = existing.capacity;
+  }
+  valid = valid && existing.capacity == capacity &&
+          static_cast<size_t>(st.st_size) == layout_size(capacity);
+
+  if (!valid && (read_only || ftruncate(fd, 0) != 0 ||
+                 ftruncate(fd, layout_size(capacity)) != 0)) {
+    ::close(fd);
+    return false;
+  }
+
+  size_ = layout_size(capacity);
+  void* p = mmap(nullptr, size_, read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<uint8_t*>(p);
+  if (!valid) {
+    reset(capacity);
+  }
+  return true;
+}
+
+void History::reset(size_t capacity) {
+  Header* h = header();
+  h->magic = HISTORY_MAGIC;
+  h->version = HISTORY_VERSION;
+  h->capacity = static_cast<uint32_t>(capacity);
+  h->count = 0;
+  for (size_t t = 0; t < HISTORY_TIER_COUNT; ++t) {
+    h->tier_seconds[t] = HISTORY_TIERS[t].seconds;
+    h->tier_points[t] = HISTORY_TIERS[t].points;
+  }
+  for (size_t m = 0; m < capacity; ++m) {
+    for (size_t t = 0; t < HISTORY_TIER_COUNT; ++t) {
+      *tier(static_cast<int>(m), t).bucket = -1;
+    }
+  }
+}
+
+void History::close() {
+  if (base_) {
+    munmap(base_, size_);
+    base_ = nullptr;
+    size_ = 0;
+  }
+}
+
+void History::flush() {
+  if (base_ && !read_only_) {
+    msync(base_, size_, MS_ASYNC);
+  }
+}
+
+size_t History::capacity() const {
+  return base_ ? header()->capacity : 0;
+}
+
+size_t History::count() const {
+  return base_ ? header()->count : 0;
+}
+
+std::string_view History::name(size_t metric) const {
+  const char* names =
+      reinterpret_cast<const char*>(base_ + align_up(sizeof(Header)));
+  const char* name = names + metric * NAME_SIZE;
+  return std::string_view(name, strnlen(name, NAME_SIZE));
+}
+
+int History::find(std::string_view name, bool create) {
+  if (!base_) {
+    return -1;
+  }
+  name = name.substr(0, NAME_SIZE - 1);
+  Header* h = header();
+  for (uint32_t i = 0; i < h->count; ++i) {
+    if (this->name(i) == name) {
+      return static_cast<int>(i);
+    }
+  }
+  if (!create || read_only_ || h->count >= h->capacity) {
+    return -1;
+  }
+
+  char* slot = reinterpret_cast<char*>(base_ + align_up(sizeof(Header))) +
+               h->count * NAME_SIZE;
+  std::memset(slot, 0, NAME_SIZE);
+  name.copy(slot, name.size());
+  return static_cast<int>(h->count++);
+}
+
+void History::add(int metric, int64_t now, double value) {
+  if (!base_ || read_only_ || metric < 0 ||
+      metric >= static_cast<int>(count()) || std::isnan(value)) {
+    return;
+  }
+  float v = static_cast<float>(value);
+
+  for (size_t t = 0; t < HISTORY_TIER_COUNT; ++t) {
+    Tier tr = tier(metric, t);
+    int points = HISTORY_TIERS[t].points;
+    int64_t b = now / HISTORY_TIERS[t].seconds;
+    int64_t newest = *tr.bucket;
+
+    if (b > newest) {
+      // Empty every bucket skipped since the last sample (or the whole
+      // ring after a long stop), then make b the newest
+      int64_t from = std::max(newest + 1, b - points + 1);
+      if (newest < 0) {
+        from = b - points + 1;
+      }
+      for (int64_t k = from; k <= b; ++k) {
+        size_t i = static_cast<size_t>(k % points);
+        tr.min[i] = INF;
+        tr.max[i] = -INF;
+        tr.sum[i] = 0;
+        tr.count[i] = 0;
+      }
+      *tr.bucket = b;
+    } else if (b <= newest - points) {
+      continue;  // Older than the ring (clock stepped back)
+    }
+
+    size_t i = static_cast<size_t>(b % points);
+    tr.min[i] = std::min(tr.min[i], v);
+    tr.max[i] = std::max(tr.max[i], v);
+    tr.sum[i] += v;
+    ++tr.count[i];
+  }
+}
+
+HistorySummary History::summarize(int metric, size_t tier_index,
+                                  size_t points, int64_t now) const {
+  HistorySummary summary{NAN, NAN, NAN, 0};
+  if (!base_ || metric < 0 || metric >= static_cast<int>(count()) ||
+      tier_index >= HISTORY_TIER_COUNT) {
+    return summary;
+  }
+  Tier tr = tier(metric, tier_index);
+  int ring = HISTORY_TIERS[tier_index].points;
+  Window w = window(*tr.bucket, ring, now / HISTORY_TIERS[tier_index].seconds,
+                    points);
+  if (*tr.bucket < 0 || w.last < w.first) {
+    return summary;
+  }
+
+  // At most two contiguous stretches of the ring; branch-free loops
+  float lo = INF;
+  float hi = -INF;
+  float sum = 0;
+  uint32_t count = 0;
+  size_t begin = static_cast<size_t>(w.first % ring);
+  size_t n = static_cast<size_t>(w.last - w.first + 1);
+  while (n > 0) {
+    size_t end = std::min(begin + n, static_cast<size_t>(ring));
+    for (size_t i = begin; i < end; ++i) {
+      lo = std::min(lo, tr.min[i]);
+      hi = std::max(hi, tr.max[i]);
+      sum += tr.sum[i];
+      count += tr.count[i];
+    }
+    n -= end - begin;
+    begin = 0;
+  }
+
+  if (count > 0) {
+    summary = {lo, hi, sum / count, count};
+  }
+  return summary;
+}
+
+size_t History::averages(int metric, size_t tier_index, int64_t now,
+                         float* out, size_t points) const {
+  if (!base_ || metric < 0 || metric >= static_cast<int>(count()) ||
+      tier_index >= HISTORY_TIER_COUNT) {
+    return 0;
+  }
+  Tier tr = tier(metric, tier_index);
+  int ring = HISTORY_TIERS[tier_index].points;
+  points = std::min(points, static_cast<size_t>(ring));
+  int64_t end = now / HISTORY_TIERS[tier_index].seconds;
+  Window w = window(*tr.bucket, ring, end, points);
+
+  for (size_t j = 0; j < points; ++j) {
+    int64_t k = end - static_cast<int64_t>(points) + 1 + j;
+    size_t i = static_cast<size_t>(((k % ring) + ring) % ring);
+    bool stored = *tr.bucket >= 0 && k >= w.first && k <= w.last;
+    out[j] = stored && tr.count[i] > 0 ? tr.sum[i] / tr.count[i] : NAN;
+  }
+  return points;
+}
+
+}  // namespace reed
@@ -0,0 +1,87 @@
+#include "reed/host_metrics.hpp"
+
+#include <cmath>
+
+namespace reed {
+
+HostMetrics::HostMetrics(const Config& config, const std::string& root)
+    : gpus_(root),
+      net_(config.net_interfaces, root),
+      disks_(config.disk_devices, root),
+      fans_(root) {
+  std::string cpu_temp = find_cpu_temp_input(root);
+  if (!cpu_temp.empty()) {
+    cpu_temp_.open(cpu_temp);
+  }
+  build_names();
+
+  // Baseline for the rate counters
+  net_.sample();
+  disks_.sample();
+}
+
+void HostMetrics::build_names() {
+  names_.clear();
+  if (cpu_temp_.is_open()) {
+    names_.push_back("cpu.temp");
+  }
+  for (size_t i = 0; i < gpus_.count(); ++i) {
+    std::string prefix = "gpu" + std::to_string(i) + ".";
+    for (const char* field : {"busy", "temp", "clock", "vram"}) {
+      names_.push_back(prefix + field);
+    }
+  }
+  for (size_t i = 0; i < net_.count(); ++i) {
+    names_.push_back("net." + net_.name(i) + ".rx");
+    names_.push_back("net." + net_.name(i) + ".tx");
+  }
+  for (size_t i = 0; i < disks_.count(); ++i) {
+    for (const char* field : {".read", ".write", ".busy"}) {
+      names_.push_back("disk." + disks_.name(i) + field);
+    }
+  }
+  for (size_t i = 0; i < fans_.count(); ++i) {
+    names_.push_back("fan." + fans_.name(i));
+  }
+
+  values_.assign(names_.size(), NAN);
+  fan_discoveries_ = fans_.discoveries();
+  ++generation_;
+}
+
+void HostMetrics::sample() {
+  gpus_.update();
+  net_.sample();
+  disks_.sample();
+  fans_.update();
+  if (fans_.discoveries() != fan_discoveries_) {
+    build_names();
+  }
+
+  // Same order as build_names()
+  double* v = values_.data();
+  if (cpu_temp_.is_open()) {
+    auto millidegrees = cpu_temp_.read_int();
+    *v++ = millidegrees ? *millidegrees / 1000.0 : NAN;
+  }
+  for (const GpuSample& s : gpus_.samples()) {
+    *v++ = s.busy_percent;
+    *v++ = s.temperature_c;
+    *v++ = s.clock_mhz;
+    *v++ = s.vram_used_mb;
+  }
+  for (size_t i = 0; i < net_.count(); ++i) {
+    *v++ = net_.rx_bytes_per_sec(i);
+    *v++ = net_.tx_bytes_per_sec(i);
+  }
+  for (size_t i = 0; i < disks_.count(); ++i) {
+    *v++ = disks_.read_bytes_per_sec(i);
+    *v++ = disks_.write_bytes_per_sec(i);
+    *v++ = disks_.busy_percent(i);
+  }
+  for (size_t i = 0; i < fans_.count(); ++i) {
+    *v++ = fans_.rpm(i) >= 0 ? fans_.rpm(i) : NAN;
+  }
+}
+
+}  // namespace reed
@@ -0,0 +1,181 @@
+#include "reed/hwmon.hpp"
+
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+FanMonitor::FanMonitor(const std::string& root) : root_(root) {
+  // Kernel uevents tell us when a chip comes or goes (USB AIO coolers,
+  // modules loaded late); sysfs itself offers no change notification
+  uevent_fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      NETLINK_KOBJECT_UEVENT);
+  if (uevent_fd_ >= 0) {
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;  // Kernel broadcasts
+    if (bind(uevent_fd_, reinterpret_cast<sockaddr*>(&addr),
+             sizeof(addr)) != 0) {
+      close(uevent_fd_);
+      uevent_fd_ = -1;
+    }
+  }
+  discover();
+}
+
+FanMonitor::~FanMonitor() {
+  if (uevent_fd_ >= 0) {
+    close(uevent_fd_);
+  }
+}
+
+void FanMonitor::discover() {
+  ++discoveries_;
+  rescan_ = false;
+
+  struct Chip {
+    std::string name;
+    std::string device;  // Tells apart chips with the same name
+    fs::path path;
+  };
+  std::vector<Chip> chips;
+  std::map<std::string, int> name_counts;
+
+  std::error_code ec;
+  for (const auto& entry :
+       fs::directory_iterator(root_ + "/sys/class/hwmon", ec)) {
+    auto name = SysfsFile::read_string((entry.path() / "name").string());
+    if (!name) {
+      continue;
+    }
+    std::string device =
+        fs::read_symlink(entry.path() / "device", ec).filename().string();
+    chips.push_back({*name, device, entry.path()});
+    ++name_counts[*name];
+  }
+
+  std::vector<Fan> fans;
+  for (const auto& chip : chips) {
+    std::string prefix = chip.name;
+    if (name_counts[chip.name] > 1 && !chip.device.empty()) {
+      prefix += "@" + chip.device;
+    }
+
+    for (const auto& file : fs::directory_iterator(chip.path, ec)) {
+      std::string filename = file.path().filename().string();
+      if (filename.compare(0, 3, "fan") != 0 ||
+          filename.size() <= 9 ||
+          filename.compare(filename.size() - 6, 6, "_input") != 0) {
+        continue;
+      }
+      std::string fan = filename.substr(0, filename.size() - 6);
+      auto label = SysfsFile::read_string(
+          (chip.path / (fan + "_label")).string());
+
+      Fan f;
+      f.name = prefix + "/" + (label && !label->empty() ? *label : fan);
+      if (f.input.open(file.path().string())) {
+        fans.push_back(std::move(f));
+      }
+    }
+  }
+
+  std::sort(fans.begin(), fans.end(), [](const Fan& a, const Fan& b) {
+    return a.name < b.name;
+  });
+  fans_ = std::move(fans);
+  rpms_.assign(fans_.size(), -1);
+}
+
+bool FanMonitor::hotplug_pending() {
+  if (uevent_fd_ < 0) {
+    return false;
+  }
+
+  // "add@/devices/...\0ACTION=add\0...SUBSYSTEM=hwmon\0..."
+  static constexpr char SUBSYSTEM[] = "SUBSYSTEM=hwmon";
+  char buf[4096];
+  bool hwmon = false;
+  ssize_t n;
+  while ((n = recv(uevent_fd_, buf, sizeof(buf) - 1, MSG_DONTWAIT)) > 0) {
+    buf[n] = '\0';
+    for (ssize_t i = 0; i < n && !hwmon; i += std::strlen(buf + i) + 1) {
+      hwmon = std::strncmp(buf + i, SUBSYSTEM, sizeof(SUBSYSTEM)) == 0;
+    }
+  }
+  return hwmon;
+}
+
+void FanMonitor::update() {
+  if (hotplug_pending() || rescan_) {
+    discover();
+  }
+
+  for (size_t i = 0; i < fans_.size(); ++i) {
+    int error = 0;
+    auto value = fans_[i].input.read_int(&error);
+    rpms_[i] = value ? static_cast<int>(*value) : -1;
+    if (error == ENODEV) {
+      // Chip gone without us seeing the uevent
+      rescan_ = true;
+    }
+  }
+}
+
+std::string find_cpu_temp_input(const std::string& root) {
+  static constexpr const char* CHIPS[] = {"coretemp", "k10temp", "zenpower",
+                                          "cpu_thermal"};
+  static constexpr const char* LABELS[] = {"Package id 0", "Tdie", "Tctl"};
+
+  std::error_code ec;
+  for (const char* chip : CHIPS) {
+    for (const auto& entry :
+         fs::directory_iterator(root + "/sys/class/hwmon", ec)) {
+      auto name = SysfsFile::read_string((entry.path() / "name").string());
+      if (!name || *name != chip) {
+        continue;
+      }
+
+      std::string best;
+      size_t best_rank = std::size(LABELS);
+      for (const auto& file : fs::directory_iterator(entry.path(), ec)) {
+        std::string filename = file.path().filename().string();
+        if (filename.compare(0, 4, "temp") != 0 ||
+            filename.size() <= 10 ||
+            filename.compare(filename.size() - 6, 6, "_label") != 0) {
+          continue;
+        }
+        auto label = SysfsFile::read_string(file.path().string());
+        auto rank = label ? std::find(std::begin(LABELS), std::end(LABELS),
+                                      *label) -
+                                std::begin(LABELS)
+                          : std::size(LABELS);
+        if (static_cast<size_t>(rank) < best_rank) {
+          best_rank = rank;
+          best = (entry.path() /
+                  (filename.substr(0, filename.size() - 6) + "_input"))
+                     .string();
+        }
+      }
+      if (best.empty() && fs::exists(entry.path() / "temp1_input", ec)) {
+        best = (entry.path() / "temp1_input").string();
+      }
+      if (!best.empty()) {
+        return best;
+      }
+    }
+  }
+  return "";
+}
+
+}  // namespace reed
@@ -0,0 +1,258 @@
+#include "reed/io_stats.hpp"
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+// Room for counters on the last wanted line to grow a few digits
+constexpr size_t READ_SLACK = 256;
+constexpr size_t INITIAL_BUFFER = 4096;
+// Largest believable increase across a 32-bit wrap. Anything more is a
+// reset from a value that happened to sit below 2^32.
+constexpr uint64_t MAX_WRAPPED_DELTA = uint64_t{1} << 30;
+
+int64_t monotonic_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool is_separator(char c) {
+  return c == ' ' || c == ':' || c == '\t';
+}
+
+// Names under dir that have a "device" link, i.e. are backed by hardware
+std::vector<std::string> hardware_entries(const std::string& dir) {
+  std::vector<std::string> names;
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(dir, ec)) {
+    if (fs::exists(entry.path() / "device", ec)) {
+      names.push_back(entry.path().filename().string());
+    }
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+}  // namespace
+
+uint64_t counter_delta(uint64_t previous, uint64_t current) {
+  if (current >= previous) {
+    return current - previous;
+  }
+  if (previous > UINT32_MAX || current > UINT32_MAX) {
+    return 0;
+  }
+  uint64_t wrapped = (uint64_t{1} << 32) - previous + current;
+  return wrapped < MAX_WRAPPED_DELTA ? wrapped : 0;
+}
+
+ProcTable::ProcTable(const std::string& path, int key_column,
+                     std::vector<std::string> keys)
+    : file_(path),
+      key_column_(key_column),
+      keys_(std::move(keys)),
+      offsets_(keys_.size(), -1),
+      buf_(INITIAL_BUFFER) {}
+
+bool ProcTable::read() {
+  if (want_ > 0) {
+    if (buf_.size() < want_ + 1) {
+      buf_.resize(want_ + 1);
+    }
+    long n = file_.read(buf_.data(), want_ + 1);
+    if (n < 0) {
+      return false;
+    }
+    size_ = static_cast<size_t>(n);
+    if (check_offsets()) {
+      return true;
+    }
+  }
+
+  if (!read_whole()) {
+    return false;
+  }
+  reindex();
+  return true;
+}
+
+bool ProcTable::read_whole() {
+  while (true) {
+    long n = file_.read(buf_.data(), buf_.size());
+    if (n < 0) {
+      return false;
+    }
+    if (static_cast<size_t>(n) + 1 < buf_.size()) {
+      size_ = static_cast<size_t>(n);
+      return true;
+    }
+    buf_.resize(buf_.size() * 2);
+  }
+}
+
+bool ProcTable::check_offsets() const {
+  const char* data = buf_.data();
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    const std::string& key = keys_[i];
+    if (offsets_[i] < 0) {
+      return false;  // Look for it again in case it has appeared
+    }
+    size_t start = static_cast<size_t>(offsets_[i]);
+    size_t end = start + key.size();
+    if (end >= size_ || std::memcmp(data + start, key.data(), key.size()) ||
+        !is_separator(data[end]) ||
+        (start > 0 && !is_separator(data[start - 1]) &&
+         data[start - 1] != '\n') ||
+        !std::memchr(data + end, '\n', size_ - end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ProcTable::reindex() {
+  ++reindexes_;
+  std::fill(offsets_.begin(), offsets_.end(), -1);
+
+  const char* data = buf_.data();
+  size_t last_end = 0;
+  size_t pos = 0;
+  while (pos < size_) {
+    const char* eol =
+        static_cast<const char*>(std::memchr(data + pos, '\n', size_ - pos));
+    size_t line_end = eol ? static_cast<size_t>(eol - data) : size_;
+
+    // Find the key column
+    size_t p = pos;
+    for (int column = 0; p < line_end; ++column) {
+      while (p < line_end && is_separator(data[p])) ++p;
+      size_t token = p;
+      while (p < line_end && !is_separator(data[p])) ++p;
+      if (column < key_column_) {
+        continue;
+      }
+      for (size_t i = 0; i < keys_.size(); ++i) {
+        if (offsets_[i] < 0 && keys_[i].size() == p - token &&
+            std::memcmp(data + token, keys_[i].data(), p - token) == 0) {
+          offsets_[i] = static_cast<long>(token);
+          last_end = std::max(last_end, line_end);
+          break;
+        }
+      }
+      break;
+    }
+    pos = line_end + 1;
+  }
+
+  bool all_found = std::find(offsets_.begin(), offsets_.end(), -1) ==
+                   offsets_.end();
+  want_ = all_found ? last_end + READ_SLACK : 0;
+}
+
+size_t ProcTable::values(size_t i, uint64_t* out, size_t max) const {
+  if (offsets_[i] < 0) {
+    return 0;
+  }
+  const char* p = buf_.data() + offsets_[i] + keys_[i].size();
+  const char* end = buf_.data() + size_;
+  size_t count = 0;
+  while (count < max) {
+    while (p < end && is_separator(*p)) ++p;
+    if (p == end || *p < '0' || *p > '9') {
+      break;
+    }
+    uint64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      value = value * 10 + static_cast<uint64_t>(*p++ - '0');
+    }
+    out[count++] = value;
+  }
+  return count;
+}
+
+NetSampler::NetSampler(std::vector<std::string> interfaces,
+                       const std::string& root)
+    : table_(root + "/proc/net/dev", 0,
+             interfaces.empty() ? hardware_entries(root + "/sys/class/net")
+                                : std::move(interfaces)),
+      last_(table_.keys().size()),
+      rates_(table_.keys().size()) {}
+
+bool NetSampler::sample() {
+  if (!table_.read()) {
+    return false;
+  }
+  int64_t now = monotonic_ns();
+  double seconds = last_ns_ > 0 ? (now - last_ns_) / 1e9 : 0;
+  last_ns_ = now;
+
+  // rx: bytes packets errs drop fifo frame compressed multicast; tx: bytes
+  uint64_t v[9];
+  for (size_t i = 0; i < count(); ++i) {
+    if (table_.values(i, v, 9) < 9) {
+      last_[i] = Counters{};
+      rates_[i] = Rates{};
+      continue;
+    }
+    Counters current{v[0], v[8], true};
+    if (last_[i].valid && seconds > 0) {
+      rates_[i].rx = counter_delta(last_[i].rx, current.rx) / seconds;
+      rates_[i].tx = counter_delta(last_[i].tx, current.tx) / seconds;
+    }
+    last_[i] = current;
+  }
+  return true;
+}
+
+DiskSampler::DiskSampler(std::vector<std::string> devices,
+                         const std::string& root)
+    : table_(root + "/proc/diskstats", 2,
+             devices.empty() ? hardware_entries(root + "/sys/block")
+                             : std::move(devices)),
+      last_(table_.keys().size()),
+      rates_(table_.keys().size()) {}
+
+bool DiskSampler::sample() {
+  if (!table_.read()) {
+    return false;
+  }
+  int64_t now = monotonic_ns();
+  double seconds = last_ns_ > 0 ? (now - last_ns_) / 1e9 : 0;
+  last_ns_ = now;
+
+  // reads merged sectors ms writes merged sectors ms in_flight io_ms
+  constexpr uint64_t SECTOR = 512;
+  uint64_t v[10];
+  for (size_t i = 0; i < count(); ++i) {
+    if (table_.values(i, v, 10) < 10) {
+      last_[i] = Counters{};
+      rates_[i] = Rates{};
+      continue;
+    }
+    Counters current{v[2], v[6], v[9], true};
+    if (last_[i].valid && seconds > 0) {
+      const Counters& last = last_[i];
+      rates_[i].read =
+          counter_delta(last.sectors_read, current.sectors_read) * SECTOR /
+          seconds;
+      rates_[i].write =
+          counter_delta(last.sectors_written, current.sectors_written) *
+          SECTOR / seconds;
+      rates_[i].busy = std::min(
+          100.0, counter_delta(last.io_ms, current.io_ms) / (seconds * 10));
+    }
+    last_[i] = current;
+  }
+  return true;
+}
+
+}  // namespace reed
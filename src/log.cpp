@@ -0,0 +1,448 @@
+#include "reed/log.hpp"
+
+#include <linux/futex.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace reed {
+
+namespace {
+
+constexpr const char* JOURNAL_SOCKET = "/run/systemd/journal/socket";
+
+struct Record {
+  int64_t time_ns;
+  uint8_t level;
+  uint16_t message_size;
+  uint16_t size;  // message followed by "KEY=value\n" fields
+  char text[Log::SLOT_SIZE - 16];
+};
+static_assert(sizeof(Record) == Log::SLOT_SIZE, "one record per slot");
+
+// Two digits per byte in one lookup
+struct HexTable {
+  char digits[256][2];
+  constexpr HexTable() : digits() {
+    constexpr char hex[] = "0123456789ABCDEF";
+    for (int i = 0; i < 256; ++i) {
+      digits[i][0] = hex[i >> 4];
+      digits[i][1] = hex[i & 0xF];
+    }
+  }
+};
+constexpr HexTable HEX;
+
+class RecordWriter {
+ public:
+  explicit RecordWriter(Record& record) : record_(record) {}
+
+  void append(std::string_view s) {
+    size_t n = std::min(s.size(), room());
+    std::memcpy(record_.text + record_.size, s.data(), n);
+    record_.size += static_cast<uint16_t>(n);
+  }
+
+  void append_hex(const uint8_t* data, size_t size) {
+    // Keep room for the closing newline
+    size_t n = std::min(size, room() > 0 ? (room() - 1) / 2 : 0);
+    char* out = record_.text + record_.size;
+    for (size_t i = 0; i < n; ++i) {
+      std::memcpy(out + i * 2, HEX.digits[data[i]], 2);
+    }
+    record_.size += static_cast<uint16_t>(n * 2);
+  }
+
+  void field(const LogField& f) {
+    append(f.key);
+    append("=");
+    append(f.value);
+    append("\n");
+  }
+
+ private:
+  Record& record_;
+  size_t room() const { return sizeof(record_.text) - record_.size; }
+};
+
+void fill_record(Record& record, LogLevel level, std::string_view message,
+                 std::initializer_list<LogField> fields, const uint8_t* data,
+                 size_t size) {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  record.time_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  record.level = static_cast<uint8_t>(level);
+  record.size = 0;
+
+  RecordWriter writer(record);
+  writer.append(message);
+  record.message_size = record.size;
+  for (const auto& f : fields) {
+    writer.field(f);
+  }
+  if (data) {
+    writer.append("HEX=");
+    writer.append_hex(data, size);
+    writer.append("\n");
+  }
+}
+
+// Sleep while word still holds expected; any change or wake ends it
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected) {
+  static_assert(sizeof(word) == sizeof(uint32_t), "futex word is 32 bits");
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE,
+          expected, nullptr, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t>& word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+          INT_MAX, nullptr, nullptr, 0);
+}
+
+uint64_t hash_message(const Record& record) {
+  uint64_t h = 14695981039346656037ull;  // FNV-1a
+  for (uint16_t i = 0; i < record.message_size; ++i) {
+    h = (h ^ static_cast<uint8_t>(record.text[i])) * 1099511628211ull;
+  }
+  return h;
+}
+
+class LogState {
+ public:
+  std::atomic<int> level{static_cast<int>(LogLevel::Warning)};
+  std::atomic<std::thread::id> owner{};
+  std::atomic<uint64_t> head{0};  // Next slot the writer reads
+  std::atomic<uint64_t> tail{0};  // Next slot the producer fills
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> suppressed{0};
+  std::array<Record, Log::SLOTS> ring;
+
+  ~LogState() {
+    if (writer_.joinable()) {
+      stop_ = true;
+      queued_.fetch_add(1);
+      futex_wake(queued_);
+      writer_.join();
+    }
+    if (journal_fd_ >= 0) {
+      close(journal_fd_);
+    }
+  }
+
+  // Producer thread only
+  void ensure_writer() {
+    if (!started_.load(std::memory_order_relaxed)) {
+      writer_ = std::thread([this]() { run(); });
+      started_.store(true, std::memory_order_release);
+    }
+  }
+
+  bool writer_running() const {
+    return started_.load(std::memory_order_acquire);
+  }
+
+  // Producer, after publishing tail. The system call is only made when
+  // the writer has gone to sleep on an empty ring.
+  void notify() {
+    queued_.fetch_add(1);
+    if (writer_idle_.load()) {
+      futex_wake(queued_);
+    }
+  }
+
+  // Until the writer's head passes tail
+  void wait_written(uint64_t tail_seen) {
+    flushers_.fetch_add(1);
+    while (true) {
+      uint32_t seq = written_.load();
+      if (head.load(std::memory_order_acquire) >= tail_seen) {
+        break;
+      }
+      futex_wait(written_, seq);
+    }
+    flushers_.fetch_sub(1);
+  }
+
+  // Rate limiting and output, shared by the writer thread and threads
+  // that log synchronously
+  void emit(const Record& record) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    uint64_t suppressed_before = 0;
+    if (record.level >= static_cast<uint8_t>(LogLevel::Warning) &&
+        !allow(record, suppressed_before)) {
+      suppressed.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    if (!journal_checked_) {
+      journal_checked_ = true;
+      open_journal();
+    }
+    if (journal_fd_ >= 0 && send_journal(record, suppressed_before)) {
+      return;
+    }
+    write_text(record, suppressed_before);
+  }
+
+ private:
+  struct RateEntry {
+    uint64_t hash = 0;
+    int64_t window_start_ms = 0;
+    int count = 0;
+    uint64_t suppressed = 0;
+  };
+
+  std::thread writer_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> started_{false};
+
+  // Futex words: bumped after each tail store and each head store
+  std::atomic<uint32_t> queued_{0};
+  std::atomic<uint32_t> written_{0};
+  std::atomic<bool> writer_idle_{false};
+  std::atomic<int> flushers_{0};
+
+  std::mutex output_mutex_;
+  bool journal_checked_ = false;
+  int journal_fd_ = -1;
+  std::array<RateEntry, 32> rates_{};
+
+  void run() {
+    while (true) {
+      uint32_t seq = queued_.load();
+      uint64_t h = head.load(std::memory_order_relaxed);
+      uint64_t t = tail.load(std::memory_order_acquire);
+      if (h == t) {
+        if (stop_) {
+          return;
+        }
+        // Announce the sleep, then look again: a producer either sees
+        // the flag and wakes us, or its bump makes the wait return
+        writer_idle_.store(true);
+        if (tail.load() == h && !stop_) {
+          futex_wait(queued_, seq);
+        }
+        writer_idle_.store(false);
+        continue;
+      }
+      for (; h != t; ++h) {
+        emit(ring[h % Log::SLOTS]);
+      }
+      head.store(h, std::memory_order_release);
+      written_.fetch_add(1);
+      if (flushers_.load() > 0) {
+        futex_wake(written_);
+      }
+    }
+  }
+
+  bool allow(const Record& record, uint64_t& suppressed_before) {
+    uint64_t hash = hash_message(record);
+    int64_t now_ms = record.time_ns / 1000000;
+
+    RateEntry* entry = nullptr;
+    RateEntry* oldest = &rates_[0];
+    for (auto& e : rates_) {
+      if (e.hash == hash && e.count > 0) {
+        entry = &e;
+        break;
+      }
+      if (e.window_start_ms < oldest->window_start_ms) {
+        oldest = &e;
+      }
+    }
+    if (!entry) {
+      entry = oldest;
+      *entry = RateEntry{hash, now_ms, 0, 0};
+    }
+
+    if (now_ms - entry->window_start_ms >= Log::RATE_WINDOW_MS) {
+      entry->window_start_ms = now_ms;
+      entry->count = 0;
+    }
+    if (entry->count >= Log::BURST) {
+      ++entry->suppressed;
+      return false;
+    }
+    ++entry->count;
+    suppressed_before = entry->suppressed;
+    entry->suppressed = 0;
+    return true;
+  }
+
+  void open_journal() {
+    // Only when systemd connected our stderr to the journal; from a
+    // terminal, plain text on stderr is what the user expects
+    if (!std::getenv("JOURNAL_STREAM")) {
+      return;
+    }
+    journal_fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (journal_fd_ < 0) {
+      return;
+    }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, JOURNAL_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(journal_fd_, reinterpret_cast<sockaddr*>(&addr),
+                sizeof(addr)) != 0) {
+      close(journal_fd_);
+      journal_fd_ = -1;
+    }
+  }
+
+  bool send_journal(const Record& record, uint64_t suppressed_before) {
+    static constexpr char priorities[] = {'7', '6', '4', '3'};
+    Record out;
+    out.size = 0;
+    RecordWriter writer(out);
+    writer.append("MESSAGE=");
+    writer.append(std::string_view(record.text, record.message_size));
+    writer.append("\nPRIORITY=");
+    writer.append(std::string_view(&priorities[record.level & 3], 1));
+    writer.append("\nSYSLOG_IDENTIFIER=reed-tpse\n");
+    if (suppressed_before > 0) {
+      char count[24];
+      int n = std::snprintf(count, sizeof(count), "%llu",
+                            static_cast<unsigned long long>(suppressed_before));
+      writer.append("REED_SUPPRESSED=");
+      writer.append(std::string_view(count, n));
+      writer.append("\n");
+    }
+
+    // Fields are already KEY=value lines; namespace them
+    std::string_view fields(record.text + record.message_size,
+                            record.size - record.message_size);
+    while (!fields.empty()) {
+      size_t eol = fields.find('\n');
+      writer.append("REED_");
+      writer.append(fields.substr(0, eol + 1));
+      fields = eol == std::string_view::npos ? std::string_view()
+                                             : fields.substr(eol + 1);
+    }
+
+    return send(journal_fd_, out.text, out.size, MSG_NOSIGNAL) >= 0;
+  }
+
+  void write_text(const Record& record, uint64_t suppressed_before) {
+    static constexpr const char* names[] = {"debug", "info", "warning",
+                                            "error"};
+    char line[sizeof(Record) + 128];
+    time_t seconds = static_cast<time_t>(record.time_ns / 1000000000);
+    tm local;
+    localtime_r(&seconds, &local);
+    size_t n = std::strftime(line, sizeof(line), "%H:%M:%S", &local);
+    n += std::snprintf(line + n, sizeof(line) - n, ".%03d %s: %.*s",
+                       static_cast<int>(record.time_ns / 1000000 % 1000),
+                       names[record.level & 3],
+                       static_cast<int>(record.message_size), record.text);
+
+    // KEY=value lines become " KEY=value" on the same line
+    for (uint16_t i = record.message_size;
+         i < record.size && n + 2 < sizeof(line); ++i) {
+      if (i == record.message_size || record.text[i - 1] == '\n') {
+        line[n++] = ' ';
+      }
+      if (record.text[i] != '\n') {
+        line[n++] = record.text[i];
+      }
+    }
+    if (suppressed_before > 0 && n < sizeof(line)) {
+      n += std::snprintf(line + n, sizeof(line) - n,
+                         " (%llu similar suppressed)",
+                         static_cast<unsigned long long>(suppressed_before));
+    }
+    n = std::min(n, sizeof(line) - 1);
+    line[n++] = '\n';
+    ssize_t ignored = ::write(STDERR_FILENO, line, n);
+    (void)ignored;
+  }
+};
+
+LogState& state() {
+  static LogState s;
+  return s;
+}
+
+void submit(LogLevel level, std::string_view message,
+            std::initializer_list<LogField> fields, const uint8_t* data,
+            size_t size) {
+  LogState& s = state();
+
+  std::thread::id self = std::this_thread::get_id();
+  std::thread::id owner = s.owner.load(std::memory_order_relaxed);
+  if (owner != self) {
+    std::thread::id none;
+    if (owner != none || !s.owner.compare_exchange_strong(none, self)) {
+      // Not the producer: format and write on this thread
+      Record record;
+      fill_record(record, level, message, fields, data, size);
+      s.emit(record);
+      return;
+    }
+  }
+
+  uint64_t t = s.tail.load(std::memory_order_relaxed);
+  if (t - s.head.load(std::memory_order_acquire) >= Log::SLOTS) {
+    s.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  fill_record(s.ring[t % Log::SLOTS], level, message, fields, data, size);
+  s.tail.store(t + 1, std::memory_order_release);
+  s.ensure_writer();
+  s.notify();
+}
+
+}  // namespace
+
+void Log::set_level(LogLevel level) {
+  state().level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool Log::enabled(LogLevel level) {
+  return static_cast<int>(level) >=
+         state().level.load(std::memory_order_relaxed);
+}
+
+void Log::write(LogLevel level, std::string_view message,
+                std::initializer_list<LogField> fields) {
+  if (enabled(level)) {
+    submit(level, message, fields, nullptr, 0);
+  }
+}
+
+void Log::hex(LogLevel level, std::string_view message, const uint8_t* data,
+              size_t size, std::initializer_list<LogField> fields) {
+  if (enabled(level)) {
+    submit(level, message, fields, data, size);
+  }
+}
+
+void Log::flush() {
+  LogState& s = state();
+  if (!s.writer_running()) {
+    return;
+  }
+  s.wait_written(s.tail.load(std::memory_order_acquire));
+}
+
+uint64_t Log::dropped() {
+  return state().dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t Log::suppressed() {
+  return state().suppressed.load(std::memory_order_relaxed);
+}
+
+}  // namespace reed
@@ -1,13 +1,245 @@
 #include "reed/media.hpp"
 
+#include <stdlib.h>
+
 #include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <utility>
+
+#include "reed/adb.hpp"
+#include "reed/config.hpp"
+#include "reed/gif.hpp"
+#include "reed/shell.hpp"
+#include "reed/timings.hpp"
 
 namespace fs = std::filesystem;
 
 namespace reed {
 
+namespace {
+
+// FNV-1a over the whole file
+std::optional<uint64_t> hash_file(const std::string& path, uint64_t& size) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return std::nullopt;
+  }
+  uint64_t h = 14695981039346656037ull;
+  size = 0;
+  std::vector<char> buffer(1 << 20);
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    std::streamsize n = file.gcount();
+    for (std::streamsize i = 0; i < n; ++i) {
+      h = (h ^ static_cast<uint8_t>(buffer[i])) * 1099511628211ull;
+    }
+    size += n;
+  }
+  return h;
+}
+
+std::string hex64(uint64_t value) {
+  char text[17];
+  std::snprintf(text, sizeof(text), "%016llx",
+                static_cast<unsigned long long>(value));
+  return text;
+}
+
+// First line of a small bookkeeping file; empty if there is none
+std::string read_record(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// What a JPEG's header says: size, and whether any segment beyond the
+// JFIF/Adobe ones carries metadata (EXIF, XMP, ICC, IPTC, comments)
+struct JpegInfo {
+  int width = 0;
+  int height = 0;
+  bool metadata = false;
+};
+
+std::optional<JpegInfo> read_jpeg_info(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  uint8_t soi[2];
+  if (!file.read(reinterpret_cast<char*>(soi), 2) || soi[0] != 0xFF ||
+      soi[1] != 0xD8) {
+    return std::nullopt;
+  }
+
+  JpegInfo info;
+  uint8_t marker[4];
+  while (file.read(reinterpret_cast<char*>(marker), 4)) {
+    if (marker[0] != 0xFF) {
+      return std::nullopt;
+    }
+    uint8_t type = marker[1];
+    size_t length = (marker[2] << 8) | marker[3];
+    if (length < 2) {
+      return std::nullopt;
+    }
+    bool sof = type >= 0xC0 && type <= 0xCF && type != 0xC4 &&
+               type != 0xC8 && type != 0xCC;
+    if (sof) {
+      uint8_t dims[5];  // Precision, height, width
+      if (length < 7 || !file.read(reinterpret_cast<char*>(dims), 5)) {
+        return std::nullopt;
+      }
+      info.height = (dims[1] << 8) | dims[2];
+      info.width = (dims[3] << 8) | dims[4];
+      return info;  // Metadata segments come before the frame
+    }
+    if ((type >= 0xE1 && type <= 0xEF && type != 0xEE) || type == 0xFE) {
+      info.metadata = true;
+    }
+    file.seekg(static_cast<std::streamoff>(length - 2), std::ios::cur);
+  }
+  return std::nullopt;
+}
+
+// Consecutive GIF frames whose channels all differ by no more than this
+// count as the same frame (dither noise, palette rounding)
+constexpr int NEAR_DUPLICATE = 2;
+
+uint64_t hash_pixels(const std::vector<uint32_t>& pixels) {
+  uint64_t h = 14695981039346656037ull;  // FNV-1a, a word at a time
+  for (uint32_t p : pixels) {
+    h = (h ^ p) * 1099511628211ull;
+  }
+  return h;
+}
+
+bool near_duplicate(const std::vector<uint32_t>& a,
+                    const std::vector<uint32_t>& b) {
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i] == b[i]) {
+      continue;
+    }
+    uint8_t pa[4];
+    uint8_t pb[4];
+    std::memcpy(pa, &a[i], 4);
+    std::memcpy(pb, &b[i], 4);
+    for (int c = 0; c < 4; ++c) {
+      if (std::abs(pa[c] - pb[c]) > NEAR_DUPLICATE) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool write_ppm(const std::string& path, int width, int height,
+               const std::vector<uint32_t>& pixels) {
+  std::ofstream file(path, std::ios::binary);
+  file << "P6\n" << width << " " << height << "\n255\n";
+  std::vector<char> row(static_cast<size_t>(width) * 3);
+  for (int y = 0; y < height; ++y) {
+    const uint32_t* src = &pixels[static_cast<size_t>(y) * width];
+    for (int x = 0; x < width; ++x) {
+      std::memcpy(&row[x * 3], &src[x], 3);  // R, G, B; alpha dropped
+    }
+    file.write(row.data(), row.size());
+  }
+  return static_cast<bool>(file);
+}
+
+// Decodes the GIF, writes each distinct frame once and lets ffmpeg encode
+// them from a concat list carrying every frame's duration
+bool encode_gif(const std::string& input, const std::string& output,
+                GifStats& stats) {
+  GifDecoder gif;
+  if (!gif.open(input)) {
+    return false;
+  }
+
+  // Unique per call: a playlist may convert two GIFs at once
+  std::error_code ec;
+  fs::create_directories(Media::TMP_DIR, ec);
+  std::string dir_template = std::string(Media::TMP_DIR) + "gif-XXXXXX";
+  if (!mkdtemp(dir_template.data())) {
+    return false;
+  }
+  std::string dir = dir_template + "/";
+
+  std::vector<std::pair<std::string, int>> frames;  // File, duration (ms)
+  std::vector<uint32_t> shown;
+  uint64_t shown_hash = 0;
+  bool ok = true;
+  {
+    ScopedTimer decode("gif_decode");
+    while (ok && gif.next()) {
+      ++stats.frames;
+      stats.duration_ms += gif.delay_ms();
+
+      const auto& canvas = gif.canvas();
+      uint64_t hash = hash_pixels(canvas);
+      if (!frames.empty() && ((hash == shown_hash && canvas == shown) ||
+                              near_duplicate(canvas, shown))) {
+        frames.back().second += gif.delay_ms();
+        continue;
+      }
+
+      char name[32];
+      std::snprintf(name, sizeof(name), "frame_%05zu.ppm", frames.size());
+      ok = write_ppm(dir + name, gif.width(), gif.height(), canvas);
+      frames.emplace_back(name, gif.delay_ms());
+      shown = canvas;
+      shown_hash = hash;
+    }
+  }
+
+  if (ok && gif.error().empty() && !frames.empty()) {
+    std::ofstream list(dir + "frames.ffconcat");
+    list << "ffconcat version 1.0\n";
+    for (const auto& [name, duration_ms] : frames) {
+      list << "file '" << name << "'\nduration " << duration_ms / 1000 << "."
+           << std::setw(3) << std::setfill('0') << duration_ms % 1000 << "\n";
+    }
+    // The concat demuxer only honours the last duration if the file is
+    // listed once more
+    list << "file '" << frames.back().first << "'\n";
+    list.close();
+
+    ScopedTimer timer("ffmpeg encode");
+    std::string cmd =
+        "ffmpeg -y -loglevel error -f concat -safe 0 -i " +
+        shell_quote(dir + "frames.ffconcat") +
+        " -vsync vfr " + Media::encode_args(EncodeProfile{}) + " " +
+        shell_quote(output) + " > /dev/null 2>&1 < /dev/null";
+    ok = list && std::system(cmd.c_str()) == 0 && fs::exists(output, ec);
+  } else {
+    ok = false;
+  }
+
+  fs::remove_all(dir, ec);
+  stats.unique = frames.size();
+  stats.native = ok;
+  return ok;
+}
+
+// PAM rather than PPM: it carries the alpha channel
+bool write_pam(FILE* pipe, int width, int height,
+               const std::vector<uint8_t>& rgba) {
+  if (rgba.size() != static_cast<size_t>(width) * height * 4) {
+    return false;
+  }
+  std::string header = "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " +
+                       std::to_string(height) +
+                       "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  return std::fwrite(header.data(), 1, header.size(), pipe) ==
+             header.size() &&
+         std::fwrite(rgba.data(), 1, rgba.size(), pipe) == rgba.size();
+}
+
+}  // namespace
+
 std::string Media::get_extension(const std::string& path) {
   auto ext = fs::path(path).extension().string();
   std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
@@ -43,43 +275,319 @@ MediaType Media::detect_type(const std::string& path) {
 }
 
 std::string Media::get_converted_name(const std::string& original) {
+  if (detect_type(original) == MediaType::Image) {
+    return get_basename(original) + ".jpg";
+  }
   return get_basename(original) + ".mp4";
 }
 
+bool Media::is_converted(const std::string& path) {
+  switch (detect_type(path)) {
+    case MediaType::Gif:
+      return true;
+    case MediaType::Image: {
+      // A bare name refers to an image already on the device
+      std::error_code ec;
+      return fs::is_regular_file(path, ec);
+    }
+    default:
+      return false;
+  }
+}
+
+int Media::panel_width(const std::string& ratio) {
+  return ratio == "1:1" ? PANEL_HEIGHT : PANEL_HEIGHT * 2;
+}
+
 bool Media::is_ffmpeg_available() {
+  ScopedTimer timer("ffmpeg -version");
   return std::system("ffmpeg -version > /dev/null 2>&1") == 0;
 }
 
+bool Media::write_png(const std::string& path, int width, int height,
+                      const std::vector<uint8_t>& rgba) {
+  if (rgba.size() != static_cast<size_t>(width) * height * 4) {
+    return false;
+  }
+  ScopedTimer timer("ffmpeg png");
+  std::string cmd =
+      "ffmpeg -y -loglevel error -f image2pipe -c:v pam -i - -frames:v 1 "
+      "-update 1 " + shell_quote(path);
+  FILE* pipe = popen(cmd.c_str(), "w");
+  if (!pipe) {
+    return false;
+  }
+  bool ok = write_pam(pipe, width, height, rgba);
+  return pclose(pipe) == 0 && ok;
+}
+
+bool Media::composite(const CompositeJob& job, const FrameSource& frames) {
+  if (job.width <= 0 || job.height <= 0 || job.overlay_width <= 0 ||
+      job.overlay_height <= 0 || job.overlay_fps <= 0) {
+    return false;
+  }
+  ScopedTimer timer("ffmpeg composite");
+  std::error_code ec;
+  fs::create_directories(fs::path(job.output).parent_path(), ec);
+
+  std::string cmd = "ffmpeg -y -loglevel error ";
+  if (detect_type(job.background) == MediaType::Image) {
+    cmd += "-loop 1 -t " + std::to_string(job.still_seconds) + " ";
+  }
+  cmd += "-i " + shell_quote(job.background) +
+         " -f image2pipe -c:v pam -framerate " +
+         std::to_string(job.overlay_fps) + " -i - ";
+
+  // Background: cover the panel, crop the excess. The overlay is scaled
+  // only when it was drawn at another size. overlay= holds the last frame
+  // until the background ends.
+  std::string size = std::to_string(job.width) + ":" +
+                     std::to_string(job.height);
+  std::string graph = "[0:v]scale=" + size +
+                      ":force_original_aspect_ratio=increase,crop=" + size +
+                      ",setsar=1[bg];";
+  std::string overlay = "[1:v]";
+  if (job.overlay_width != job.width || job.overlay_height != job.height) {
+    graph += "[1:v]scale=" + size + "[ov];";
+    overlay = "[ov]";
+  }
+  graph += "[bg]" + overlay + "overlay=eof_action=repeat,format=yuv420p[out]";
+  cmd += "-filter_complex " + shell_quote(graph) + " -map '[out]' -an " +
+         codec_args(job.encode) + " " + shell_quote(job.output);
+
+  FILE* pipe = popen(cmd.c_str(), "w");
+  if (!pipe) {
+    return false;
+  }
+  bool ok = true;
+  while (ok) {
+    const std::vector<uint8_t>* frame = frames();
+    if (!frame) {
+      break;
+    }
+    ok = write_pam(pipe, job.overlay_width, job.overlay_height, *frame);
+  }
+  return pclose(pipe) == 0 && ok && fs::exists(job.output, ec);
+}
+
 bool Media::convert_gif_to_mp4(const std::string& input,
-                               const std::string& output) {
+                               const std::string& output, GifStats* stats) {
+  ScopedTimer timer("convert_gif");
   fs::create_directories(TMP_DIR);
+  GifStats local;
+  GifStats& s = stats ? *stats : local;
+  s = GifStats{};
+  if (encode_gif(input, output, s)) {
+    return true;
+  }
+  s = GifStats{};
+
+  ScopedTimer fallback("ffmpeg convert");
+  std::string cmd = "ffmpeg -y -i " + shell_quote(input) + " " +
+                    encode_args(EncodeProfile{}) + " " + shell_quote(output) +
+                    " > /dev/null 2>&1 < /dev/null";
+
+  int ret = std::system(cmd.c_str());
+  return ret == 0 && fs::exists(output);
+}
+
+std::string Media::encode_args(const EncodeProfile& profile) {
+  std::string scale = "scale=trunc(iw/2)*2:trunc(ih/2)*2";
+  if (profile.max_height > 0) {
+    scale = "scale=-2:trunc(min(ih\\," + std::to_string(profile.max_height) +
+            ")/2)*2";
+  }
+  return "-vf " + shell_quote(scale) + " " + codec_args(profile);
+}
+
+std::string Media::codec_args(const EncodeProfile& profile) {
+  return "-c:v libx264 -preset " + shell_quote(profile.preset) + " -crf " +
+         std::to_string(profile.crf) +
+         " -pix_fmt yuv420p -movflags +faststart";
+}
+
+std::optional<PreparedImage> Media::prepare_image(const std::string& path,
+                                                  const std::string& ratio) {
+  ScopedTimer timer("prepare_image");
+  PreparedImage image;
+  std::optional<uint64_t> hash;
+  {
+    ScopedTimer hashing("hash");
+    hash = hash_file(path, image.source_bytes);
+  }
+  if (!hash) {
+    return std::nullopt;
+  }
+
+  int width = panel_width(ratio);
+  char name[64];
+  std::snprintf(name, sizeof(name), "%s_%dx%d.jpg", hex64(*hash).c_str(),
+                width, PANEL_HEIGHT);
+  std::string dir = std::string(TMP_DIR) + "images/";
+  image.path = dir + name;
 
-  // Build ffmpeg command
-  std::string cmd = "ffmpeg -y -i '";
+  std::error_code ec;
+  if (fs::exists(image.path, ec)) {
+    image.cached = true;
+    image.bytes = fs::file_size(image.path, ec);
+    return image;
+  }
+  fs::create_directories(dir, ec);
+
+  // Scale factor to just cover the panel, capped at 1 (\, keeps the commas
+  // inside the expression); everything but the pixels is dropped
+  std::string scale = "scale=w=trunc(iw*min(1\\,max(" +
+                      std::to_string(width) + "/iw\\," +
+                      std::to_string(PANEL_HEIGHT) +
+                      "/ih))):h=-1:flags=lanczos";
+  std::string partial = image.path + ".part.jpg";
+  std::string cmd = "ffmpeg -y -loglevel error -i " + shell_quote(path) +
+                    " -vf " + shell_quote(scale) +
+                    " -map_metadata -1 -frames:v 1 -update 1 -c:v mjpeg "
+                    "-q:v 3 -pix_fmt yuvj420p " +
+                    shell_quote(partial) + " < /dev/null";
+  bool encoded;
+  {
+    ScopedTimer encode("ffmpeg jpeg");
+    encoded = std::system(cmd.c_str()) == 0;
+  }
+  if (!encoded || !fs::exists(partial, ec)) {
+    fs::remove(partial, ec);
+    return std::nullopt;
+  }
 
-  for (char c : input) {
-    if (c == '\'') {
-      cmd += "'\\''";
-    } else {
-      cmd += c;
+  // A JPEG the scale would leave alone and that carries nothing to strip
+  // can beat the re-encode; then keep the smaller
+  std::string ext = get_extension(path);
+  if ((ext == ".jpg" || ext == ".jpeg") &&
+      fs::file_size(partial, ec) >= image.source_bytes) {
+    auto info = read_jpeg_info(path);
+    bool fits = info && (info->width <= width || info->height <= PANEL_HEIGHT);
+    if (fits && !info->metadata) {
+      fs::copy_file(path, partial, fs::copy_options::overwrite_existing, ec);
     }
   }
+  fs::rename(partial, image.path, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+  image.bytes = fs::file_size(image.path, ec);
+  return image;
+}
 
-  cmd += "' -movflags faststart -pix_fmt yuv420p ";
-  cmd += "-vf \"scale=trunc(iw/2)*2:trunc(ih/2)*2\" '";
+std::optional<std::string> Media::upload(const std::string& path,
+                                         const std::string& ratio,
+                                         UploadReport* report) {
+  ScopedTimer timer("upload");
+  std::error_code ec;
+  UploadReport local;
+  UploadReport& r = report ? *report : local;
+  r = UploadReport{};
+  r.type = detect_type(path);
+  r.local_path = path;
+  std::string remote_name = get_filename(path);
 
-  for (char c : output) {
-    if (c == '\'') {
-      cmd += "'\\''";
-    } else {
-      cmd += c;
+  if (r.type == MediaType::Image) {
+    auto image = prepare_image(path, ratio);
+    if (!image) {
+      return std::nullopt;
+    }
+    remote_name = get_converted_name(path);
+    r.local_path = image->path;
+    r.cached = image->cached;
+    r.image = *image;
+  } else if (r.type == MediaType::Gif) {
+    // Keyed by content, so another foo.gif (or an edited one) never
+    // reuses this one's conversion
+    uint64_t source_bytes = 0;
+    auto hash = hash_file(path, source_bytes);
+    if (!hash) {
+      return std::nullopt;
+    }
+    remote_name = get_converted_name(path);
+    std::string dir = std::string(TMP_DIR) + "gifs/";
+    r.local_path = dir + hex64(*hash) + ".mp4";
+    r.cached = fs::exists(r.local_path, ec);
+    if (!r.cached) {
+      fs::create_directories(dir, ec);
+      std::string partial = r.local_path + ".part.mp4";
+      if (!convert_gif_to_mp4(path, partial, &r.gif)) {
+        fs::remove(partial, ec);
+        return std::nullopt;
+      }
+      fs::rename(partial, r.local_path, ec);
+      if (ec) {
+        return std::nullopt;
+      }
     }
   }
 
-  cmd += "' > /dev/null 2>&1";
+  uint64_t local_size = 0;
+  auto local_hash = hash_file(r.local_path, local_size);
+  if (!local_hash) {
+    return std::nullopt;
+  }
 
-  int ret = std::system(cmd.c_str());
-  return ret == 0 && fs::exists(output);
+  // A matching size alone proves nothing (another file of the same name,
+  // an edit that kept the size); it must also be what we last pushed
+  std::string record = std::string(TMP_DIR) + "pushed/" + remote_name;
+  auto existing = Adb::remote_size(remote_name);
+  if (existing && *existing == local_size &&
+      read_record(record) == hex64(*local_hash)) {
+    return remote_name;
+  }
+
+  if (!Adb::push(r.local_path, remote_name)) {
+    return std::nullopt;
+  }
+
+  auto pushed = Adb::remote_size(remote_name);
+  if (!pushed || *pushed != local_size) {
+    return std::nullopt;
+  }
+  r.pushed = true;
+  fs::create_directories(std::string(TMP_DIR) + "pushed", ec);
+  ConfigManager::write_file_atomic(record, hex64(*local_hash));
+
+  return remote_name;
+}
+
+std::optional<size_t> Media::upload_bank(const std::vector<std::string>& paths,
+                                         const std::string& prefix) {
+  ScopedTimer timer("upload_bank");
+  auto existing = Adb::remote_sizes(prefix + "*");
+  if (!existing) {
+    return std::nullopt;
+  }
+
+  std::error_code ec;
+  std::vector<std::string> missing;
+  for (const auto& path : paths) {
+    auto it = existing->find(get_filename(path));
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) {
+      return std::nullopt;
+    }
+    if (it == existing->end() || it->second != size) {
+      missing.push_back(path);
+    }
+  }
+
+  if (!missing.empty() && !Adb::push_all(missing)) {
+    return std::nullopt;
+  }
+
+  auto pushed = Adb::remote_sizes(prefix + "*");
+  if (!pushed) {
+    return std::nullopt;
+  }
+  for (const auto& path : missing) {
+    auto it = pushed->find(get_filename(path));
+    if (it == pushed->end() || it->second != fs::file_size(path, ec)) {
+      return std::nullopt;
+    }
+  }
+  return missing.size();
 }
 
 }  // namespace reed
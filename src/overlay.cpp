@@ -0,0 +1,304 @@
+#include "reed/overlay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include "reed/font.hpp"
+
+namespace reed {
+
+namespace {
+
+constexpr int DEFAULT_SCALE = 2;
+constexpr int64_t NO_VALUE = std::numeric_limits<int64_t>::min();
+
+bool intersects(const Rect& a, const Rect& b) {
+  return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height &&
+         b.y < a.y + a.height;
+}
+
+Rect clip(Rect rect, int width, int height) {
+  int x1 = std::min(rect.x + rect.width, width);
+  int y1 = std::min(rect.y + rect.height, height);
+  rect.x = std::max(rect.x, 0);
+  rect.y = std::max(rect.y, 0);
+  rect.width = std::max(0, x1 - rect.x);
+  rect.height = std::max(0, y1 - rect.y);
+  return rect;
+}
+
+}  // namespace
+
+std::vector<std::string> OverlayRenderer::compile(
+    const OverlayLayout& layout, const std::vector<std::string>& metrics) {
+  std::vector<std::string> errors;
+
+  width_ = layout.width;
+  height_ = layout.height;
+
+  std::unordered_map<std::string, int> scales{{"default", DEFAULT_SCALE}};
+  for (const OverlayFont& font : layout.fonts) {
+    scales[font.name] = font.scale;
+  }
+  std::unordered_map<std::string, size_t> slots;
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    slots.emplace(metrics[i], i);
+  }
+
+  background_.assign(static_cast<size_t>(width_) * height_ * 4, 0);
+  fill(background_, {0, 0, width_, height_}, layout.background,
+       layout.transparent ? 0 : 255);
+  ops_.clear();
+  units_.clear();
+
+  for (size_t i = 0; i < layout.widgets.size(); ++i) {
+    const OverlayWidget& widget = layout.widgets[i];
+    std::string label = "widget " + std::to_string(i);
+
+    int scale = DEFAULT_SCALE;
+    if (widget.type == WidgetType::Text || widget.type == WidgetType::Value) {
+      auto font = scales.find(widget.font.empty() ? "default" : widget.font);
+      if (font == scales.end()) {
+        errors.push_back(label + ": unknown font " + widget.font);
+        continue;
+      }
+      scale = font->second;
+    }
+
+    // Widgets that never change go straight into the background
+    if (widget.type == WidgetType::Rect) {
+      fill(background_, {widget.x, widget.y, widget.width, widget.height},
+           widget.color);
+      continue;
+    }
+    if (widget.type == WidgetType::Text) {
+      std::vector<uint8_t> run = glyph_run(widget.text);
+      int x = widget.x;
+      if (widget.align_right) {
+        x -= glyph_run_width(run.size(), scale);
+      }
+      draw_run(background_, run.data(), run.size(), x, widget.y, scale,
+               widget.color);
+      continue;
+    }
+
+    auto slot = slots.find(widget.metric);
+    if (slot == slots.end()) {
+      errors.push_back(label + ": unknown metric " + widget.metric);
+      continue;
+    }
+
+    Op op;
+    op.type = widget.type;
+    op.slot = slot->second;
+    op.x = widget.x;
+    op.y = widget.y;
+    op.width = widget.width;
+    op.height = widget.height;
+    op.scale = scale;
+    op.align_right = widget.align_right;
+    op.color = widget.color;
+    op.track = widget.track;
+    op.decimals = widget.decimals;
+    op.divisor = widget.divisor;
+    op.min = widget.min;
+    op.max = widget.max;
+
+    // The unit is fixed, so its glyphs are looked up once here
+    std::vector<uint8_t> unit = glyph_run(widget.text);
+    unit.resize(std::min(unit.size(), MAX_RUN / 2));
+    op.unit_offset = units_.size();
+    op.unit_length = unit.size();
+    units_.insert(units_.end(), unit.begin(), unit.end());
+
+    ops_.push_back(op);
+  }
+
+  pixels_ = background_;
+  redraw_.assign(ops_.size(), 0);
+  restored_.clear();
+  restored_.reserve(ops_.size() * 2 + 1);
+  dirty_.clear();
+  dirty_.reserve(ops_.size() * 3 + 1);
+  fresh_ = true;
+  return errors;
+}
+
+const std::vector<Rect>& OverlayRenderer::update(const double* values) {
+  restored_.clear();
+  drawn_ = 0;
+  if (fresh_) {
+    restored_.push_back({0, 0, width_, height_});
+    fresh_ = false;
+  }
+
+  // Widgets showing a new value are laid out again, and the background
+  // goes back under both where they were and where they will be
+  for (size_t i = 0; i < ops_.size(); ++i) {
+    Op& op = ops_[i];
+    double value = values[op.slot];
+    int64_t shown = quantize(op, value);
+    if (op.valid && shown == op.shown) {
+      redraw_[i] = 0;
+      continue;
+    }
+    redraw_[i] = 1;
+    if (op.valid && op.box.width > 0) {
+      restored_.push_back(op.box);
+    }
+    op.shown = shown;
+    op.valid = true;
+    layout_value(op, value);
+    op.box = box_of(op);
+    if (op.box.width > 0) {
+      restored_.push_back(op.box);
+    }
+  }
+
+  for (const Rect& rect : restored_) {
+    restore(rect);
+  }
+
+  // Unchanged widgets overlapping a restored area are drawn again, in
+  // layout order, so the stacking matches a full redraw. One drawn again
+  // paints over whatever lies above it, so its box joins the areas later
+  // widgets are tested against.
+  dirty_.assign(restored_.begin(), restored_.end());
+  for (size_t i = 0; i < ops_.size(); ++i) {
+    if (!redraw_[i]) {
+      redraw_[i] = std::any_of(
+          dirty_.begin(), dirty_.end(),
+          [&](const Rect& rect) { return intersects(rect, ops_[i].box); });
+      if (redraw_[i]) {
+        dirty_.push_back(ops_[i].box);
+      }
+    }
+    if (redraw_[i]) {
+      draw(ops_[i]);
+      ++drawn_;
+    }
+  }
+  return restored_;
+}
+
+int64_t OverlayRenderer::quantize(const Op& op, double value) const {
+  if (std::isnan(value)) {
+    return NO_VALUE;
+  }
+  if (op.type == WidgetType::Bar) {
+    double fraction = std::clamp((value - op.min) / (op.max - op.min), 0.0,
+                                 1.0);
+    return std::llround(fraction * std::max(op.width, 0));
+  }
+  double scaled = value / op.divisor * std::pow(10.0, op.decimals);
+  return std::llround(std::clamp(scaled, -1e15, 1e15));
+}
+
+void OverlayRenderer::layout_value(Op& op, double value) {
+  if (op.type != WidgetType::Value) {
+    return;
+  }
+
+  char text[32];
+  if (std::isnan(value)) {
+    std::snprintf(text, sizeof(text), "--");
+  } else {
+    // Formatted from the quantized value, so what is drawn is exactly
+    // what the change check compared (and never "-0")
+    std::snprintf(text, sizeof(text), "%.*f", op.decimals,
+                  op.shown / std::pow(10.0, op.decimals));
+  }
+
+  size_t length = 0;
+  for (const char* c = text; *c && length < MAX_RUN; ++c) {
+    op.run[length++] = glyph_index(static_cast<uint32_t>(*c));
+  }
+  for (size_t i = 0; i < op.unit_length && length < MAX_RUN; ++i) {
+    op.run[length++] = units_[op.unit_offset + i];
+  }
+  op.run_length = length;
+}
+
+Rect OverlayRenderer::box_of(const Op& op) const {
+  if (op.type == WidgetType::Bar) {
+    return clip({op.x, op.y, op.width, op.height}, width_, height_);
+  }
+  int width = glyph_run_width(op.run_length, op.scale);
+  int x = op.align_right ? op.x - width : op.x;
+  return clip({x, op.y, width, GLYPH_HEIGHT * op.scale}, width_, height_);
+}
+
+void OverlayRenderer::draw(const Op& op) {
+  if (op.type == WidgetType::Bar) {
+    int filled = op.shown == NO_VALUE ? 0 : static_cast<int>(op.shown);
+    fill(pixels_, {op.x, op.y, op.width, op.height}, op.track);
+    fill(pixels_, {op.x, op.y, filled, op.height}, op.color);
+    return;
+  }
+  int x = op.x;
+  if (op.align_right) {
+    x -= glyph_run_width(op.run_length, op.scale);
+  }
+  draw_run(pixels_, op.run.data(), op.run_length, x, op.y, op.scale,
+           op.color);
+}
+
+void OverlayRenderer::restore(const Rect& rect) {
+  size_t stride = static_cast<size_t>(width_) * 4;
+  for (int y = rect.y; y < rect.y + rect.height; ++y) {
+    size_t offset = y * stride + static_cast<size_t>(rect.x) * 4;
+    std::memcpy(&pixels_[offset], &background_[offset],
+                static_cast<size_t>(rect.width) * 4);
+  }
+}
+
+void OverlayRenderer::fill(std::vector<uint8_t>& target, Rect rect,
+                           uint32_t color, uint8_t alpha) {
+  rect = clip(rect, width_, height_);
+  if (rect.width == 0 || rect.height == 0) {
+    return;
+  }
+  uint8_t rgba[4] = {static_cast<uint8_t>(color >> 16),
+                     static_cast<uint8_t>(color >> 8),
+                     static_cast<uint8_t>(color), alpha};
+  size_t stride = static_cast<size_t>(width_) * 4;
+  uint8_t* first = &target[rect.y * stride + static_cast<size_t>(rect.x) * 4];
+  for (int x = 0; x < rect.width; ++x) {
+    std::memcpy(first + x * 4, rgba, 4);
+  }
+  for (int y = 1; y < rect.height; ++y) {
+    std::memcpy(first + y * stride, first, static_cast<size_t>(rect.width) * 4);
+  }
+}
+
+void OverlayRenderer::draw_run(std::vector<uint8_t>& target,
+                               const uint8_t* run, size_t length, int x,
+                               int y, int scale, uint32_t color) {
+  for (size_t i = 0; i < length; ++i, x += GLYPH_ADVANCE * scale) {
+    const uint8_t* columns = glyph_columns(run[i]);
+    for (int col = 0; col < GLYPH_WIDTH; ++col) {
+      // One fill per vertical stretch of set dots
+      int row = 0;
+      while (row < GLYPH_HEIGHT) {
+        if (!(columns[col] & (1 << row))) {
+          ++row;
+          continue;
+        }
+        int end = row;
+        while (end < GLYPH_HEIGHT && (columns[col] & (1 << end))) {
+          ++end;
+        }
+        fill(target, {x + col * scale, y + row * scale, scale,
+                      (end - row) * scale},
+             color);
+        row = end;
+      }
+    }
+  }
+}
+
+}  // namespace reed
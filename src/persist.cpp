@@ -0,0 +1,64 @@
+#include "reed/persist.hpp"
+
+#include "reed/config.hpp"
+
+namespace reed {
+
+DebouncedWriter::DebouncedWriter(EventLoop& loop, std::string path,
+                                 std::chrono::milliseconds delay)
+    : loop_(loop), path_(std::move(path)), delay_(delay) {}
+
+DebouncedWriter::~DebouncedWriter() {
+  flush();
+  if (timer_ >= 0) {
+    loop_.remove_timer(timer_);
+  }
+}
+
+void DebouncedWriter::update(std::string content) {
+  ++updates_;
+  content_ = std::move(content);
+
+  if (pending_) {
+    return;
+  }
+  pending_ = true;
+
+  if (delay_.count() <= 0) {
+    flush();
+    return;
+  }
+
+  if (timer_ < 0) {
+    timer_ = loop_.add_timer(delay_, [this]() { flush(); }, false);
+    if (timer_ < 0) {
+      flush();
+    }
+  } else {
+    loop_.rearm_timer(timer_, delay_, false);
+  }
+}
+
+bool DebouncedWriter::flush() {
+  if (!pending_) {
+    return true;
+  }
+  pending_ = false;
+
+  // A burst that ends where it started costs nothing
+  if (content_ == written_) {
+    return true;
+  }
+
+  if (!ConfigManager::write_file_atomic(path_, content_)) {
+    ++failures_;
+    return false;
+  }
+
+  ++writes_;
+  bytes_written_ += content_.size();
+  written_ = content_;
+  return true;
+}
+
+}  // namespace reed
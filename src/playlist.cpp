@@ -0,0 +1,376 @@
+#include "reed/playlist.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "reed/adb.hpp"
+#include "reed/media.hpp"
+#include "reed/time_of_day.hpp"
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+using Clock = PlaylistScheduler::Clock;
+
+bool is_eligible(const PlaylistItem& item, Clock::time_point t) {
+  if (item.start_minute < 0 && item.end_minute < 0) {
+    return true;
+  }
+
+  int m = minute_of_day(t);
+  if (item.start_minute < 0) {
+    return m < item.end_minute;
+  }
+  if (item.end_minute < 0) {
+    return m >= item.start_minute;
+  }
+  if (item.start_minute <= item.end_minute) {
+    return m >= item.start_minute && m < item.end_minute;
+  }
+  return m >= item.start_minute || m < item.end_minute;  // Wraps midnight
+}
+
+Clock::time_point eligible_from(const PlaylistItem& item, Clock::time_point t) {
+  if (is_eligible(item, t)) {
+    return t;
+  }
+  return next_occurrence(item.start_minute >= 0 ? item.start_minute : 0, t);
+}
+
+Clock::time_point slot_end(const PlaylistItem& item, Clock::time_point start) {
+  Clock::time_point end = Clock::time_point::max();
+  if (item.duration > 0) {
+    end = start + std::chrono::seconds(item.duration);
+  }
+  if (item.end_minute >= 0) {
+    end = std::min(end, next_occurrence(item.end_minute, start));
+  }
+  return end;
+}
+
+std::string format_time(Clock::time_point t) {
+  std::time_t tt = Clock::to_time_t(t);
+  std::tm tm{};
+  localtime_r(&tt, &tm);
+  char buf[16];
+  std::strftime(buf, sizeof(buf), "%H:%M:%S", &tm);
+  return buf;
+}
+
+std::string expand_home(const std::string& path) {
+  const char* home = std::getenv("HOME");
+  if (path.rfind("~/", 0) == 0 && home && *home) {
+    return std::string(home) + path.substr(1);
+  }
+  return path;
+}
+
+}  // namespace
+
+struct PlaylistScheduler::Uploads {
+  int event_fd = -1;  // Written once per finished upload
+  std::mutex mutex;
+  std::vector<std::pair<uint64_t, std::optional<std::string>>> done;
+
+  ~Uploads() {
+    if (event_fd >= 0) {
+      close(event_fd);
+    }
+  }
+};
+
+PlaylistScheduler::PlaylistScheduler(EventLoop& loop, SwitchFn on_switch,
+                                     bool verbose)
+    : loop_(loop),
+      on_switch_(std::move(on_switch)),
+      verbose_(verbose),
+      uploads_(std::make_shared<Uploads>()) {
+  uploads_->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (uploads_->event_fd >= 0 &&
+      !loop_.add(uploads_->event_fd, [this]() { on_uploaded(); })) {
+    close(uploads_->event_fd);
+    uploads_->event_fd = -1;
+  }
+}
+
+PlaylistScheduler::~PlaylistScheduler() {
+  stop();
+  // A worker still running keeps the eventfd open until it is done
+  if (uploads_->event_fd >= 0) {
+    loop_.remove(uploads_->event_fd);
+  }
+}
+
+bool PlaylistScheduler::start(const Playlist& playlist) {
+  stop();
+
+  if (playlist.items.empty() || uploads_->event_fd < 0) {
+    return false;
+  }
+
+  alarm_ = loop_.add_alarm([this]() { on_alarm(); });
+  if (alarm_ < 0) {
+    return false;
+  }
+
+  playlist_ = playlist;
+
+  auto now = Clock::now();
+  for (size_t i = 0; i < playlist_.items.size(); ++i) {
+    if (is_eligible(playlist_.items[i], now)) {
+      // Switch first so this item's upload goes ahead of the next one's
+      current_ = i;
+      switch_to(i, Clock::time_point{}, std::chrono::microseconds(0));
+      schedule_after(slot_end(playlist_.items[i], now));
+      return true;
+    }
+  }
+
+  // Nothing is due yet; keep the current display until the first window
+  schedule_after(now);
+  return true;
+}
+
+void PlaylistScheduler::stop() {
+  if (alarm_ >= 0) {
+    loop_.remove_timer(alarm_);
+    alarm_ = -1;
+  }
+  // An upload in flight finishes on its own; its result is ignored
+  playlist_.items.clear();
+  current_ = NONE;
+  next_ = NONE;
+  upload_ticket_ = 0;
+  upload_index_ = NONE;
+  queued_index_ = NONE;
+  waiting_index_ = NONE;
+}
+
+void PlaylistScheduler::schedule_after(Clock::time_point slot_start) {
+  const auto& items = playlist_.items;
+  size_t first = current_ == NONE ? 0 : current_ + 1;
+
+  next_ = NONE;
+  next_start_ = Clock::time_point::max();
+
+  // Round-robin from the item after the current one; if none is eligible
+  // when this slot ends, wait for whichever window opens first
+  for (size_t k = 0; k < items.size(); ++k) {
+    size_t i = (first + k) % items.size();
+    auto t = eligible_from(items[i], slot_start);
+    if (t < next_start_) {
+      next_start_ = t;
+      next_ = i;
+      if (t == slot_start) {
+        break;
+      }
+    }
+  }
+
+  if (next_ == NONE) {
+    return;
+  }
+
+  loop_.set_alarm(alarm_, next_start_);
+  begin_preload(next_);
+
+  if (verbose_) {
+    std::cout << "Playlist: next " << items[next_].media << " at "
+              << format_time(next_start_) << "\n";
+  }
+}
+
+void PlaylistScheduler::on_alarm() {
+  if (next_ == NONE) {
+    return;
+  }
+
+  auto now = Clock::now();
+  if (now < next_start_) {
+    // Woken early by a wall-clock step; the deadline itself still stands
+    loop_.set_alarm(alarm_, next_start_);
+    return;
+  }
+
+  auto scheduled = next_start_;
+  size_t index = next_;
+  const auto& item = playlist_.items[index];
+  auto jitter = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - scheduled);
+
+  size_t previous = current_;
+  current_ = index;
+
+  // Arm the next deadline and start its upload before the switch itself,
+  // which blocks on the serial link for a while. Chain from the scheduled
+  // start, not from when we got around to it; after a large clock jump
+  // forward, restart the chain from now.
+  auto end = slot_end(item, scheduled);
+  if (end <= now) {
+    end = slot_end(item, now);
+  }
+  schedule_after(end);
+
+  if (index == previous) {
+    return;
+  }
+  switch_to(index, scheduled, jitter);
+}
+
+void PlaylistScheduler::begin_preload(size_t index) {
+  // Even a cached asset is verified again: it may have been deleted from
+  // the device since. One upload at a time; a later request replaces any
+  // still queued.
+  if (upload_ticket_ != 0) {
+    if (upload_index_ != index) {
+      queued_index_ = index;
+    }
+    return;
+  }
+  start_upload(index);
+}
+
+void PlaylistScheduler::start_upload(size_t index) {
+  upload_ticket_ = ++last_ticket_;
+  upload_index_ = index;
+  if (queued_index_ == index) {
+    queued_index_ = NONE;
+  }
+
+  std::thread([uploads = uploads_, ticket = upload_ticket_,
+               media = playlist_.items[index].media, verbose = verbose_]() {
+    auto remote = prepare_asset(media, verbose);
+    {
+      std::lock_guard<std::mutex> lock(uploads->mutex);
+      uploads->done.emplace_back(ticket, std::move(remote));
+    }
+    uint64_t one = 1;
+    ssize_t n = write(uploads->event_fd, &one, sizeof(one));
+    (void)n;
+  }).detach();
+}
+
+void PlaylistScheduler::on_uploaded() {
+  uint64_t count = 0;
+  ssize_t n = read(uploads_->event_fd, &count, sizeof(count));
+  (void)n;
+
+  std::vector<std::pair<uint64_t, std::optional<std::string>>> done;
+  {
+    std::lock_guard<std::mutex> lock(uploads_->mutex);
+    done.swap(uploads_->done);
+  }
+
+  for (auto& [ticket, remote] : done) {
+    if (ticket != upload_ticket_) {
+      continue;  // Started before a stop() or restart
+    }
+    size_t index = upload_index_;
+    upload_ticket_ = 0;
+    upload_index_ = NONE;
+
+    const std::string& media = playlist_.items[index].media;
+    if (remote) {
+      prepared_[media] = *remote;
+    } else {
+      prepared_.erase(media);
+    }
+    if (waiting_index_ == index) {
+      waiting_index_ = NONE;
+      show(index, remote, waiting_scheduled_, waiting_jitter_);
+    }
+  }
+
+  // A slot already due goes before the next one's preload
+  if (upload_ticket_ == 0 && active()) {
+    size_t index = waiting_index_ != NONE ? waiting_index_ : queued_index_;
+    if (index != NONE) {
+      start_upload(index);
+    }
+  }
+}
+
+void PlaylistScheduler::switch_to(size_t index, Clock::time_point scheduled,
+                                  std::chrono::microseconds jitter) {
+  waiting_index_ = NONE;
+
+  const std::string& media = playlist_.items[index].media;
+  bool uploading = upload_ticket_ != 0 && upload_index_ == index;
+  auto it = prepared_.find(media);
+  if (!uploading && it != prepared_.end()) {
+    show(index, it->second, scheduled, jitter);
+    return;
+  }
+
+  // Switch from on_uploaded() once the asset is there; one that failed
+  // to verify earlier gets another try
+  if (uploading && scheduled != Clock::time_point{}) {
+    std::cerr << "Playlist: " << media
+              << " not uploaded before its slot, waiting\n";
+  }
+  waiting_index_ = index;
+  waiting_scheduled_ = scheduled;
+  waiting_jitter_ = jitter;
+  if (upload_ticket_ == 0) {
+    start_upload(index);
+  }
+}
+
+void PlaylistScheduler::show(size_t index,
+                             const std::optional<std::string>& remote,
+                             Clock::time_point scheduled,
+                             std::chrono::microseconds jitter) {
+  const auto& item = playlist_.items[index];
+  if (!remote) {
+    std::cerr << "Playlist: skipping " << item.media
+              << ", asset unavailable on device\n";
+    return;
+  }
+
+  auto switch_start = std::chrono::steady_clock::now();
+  on_switch_(item, *remote);
+  ++switches_;
+  if (scheduled == Clock::time_point{}) {
+    return;  // Not a timed slot
+  }
+  auto switch_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - switch_start);
+
+  max_jitter_us_ = std::max<int64_t>(max_jitter_us_, jitter.count());
+  std::cout << "Playlist: " << item.media << " (scheduled "
+            << format_time(scheduled) << ", woke +" << jitter.count() / 1000.0
+            << " ms, switched in " << switch_ms.count() << " ms)\n";
+}
+
+std::optional<std::string> PlaylistScheduler::prepare_asset(
+    const std::string& media, bool verbose) {
+  std::string local = expand_home(media);
+
+  std::error_code ec;
+  if (!fs::is_regular_file(local, ec)) {
+    // Not a local file: it must already be on the device
+    if (!Adb::remote_size(media)) {
+      return std::nullopt;
+    }
+    return media;
+  }
+
+  if (verbose) {
+    std::cout << "Playlist: preparing " << local << "\n";
+  }
+  return Media::upload(local);
+}
+
+}  // namespace reed
@@ -0,0 +1,337 @@
+#include "reed/procs.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace reed {
+
+namespace {
+
+constexpr size_t DIRENT_BUFFER = 32768;
+constexpr size_t FILE_BUFFER = 1024;
+constexpr size_t INITIAL_SLOTS = 4096;
+
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[256];  // Actually d_reclen - 19 bytes, NUL-terminated
+};
+
+int64_t monotonic_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// "1234" -> 1234; 0 for anything that is not all digits
+int32_t parse_pid(const char* name) {
+  int32_t pid = 0;
+  for (; *name; ++name) {
+    if (*name < '0' || *name > '9') {
+      return 0;
+    }
+    pid = pid * 10 + (*name - '0');
+  }
+  return pid;
+}
+
+uint32_t hash_pid(int32_t pid) {
+  return static_cast<uint32_t>(pid) * 2654435761u;
+}
+
+// The n-th space-separated number (from 0) starting at p
+uint64_t nth_number(const char* p, const char* end, int n) {
+  for (; n > 0 && p < end; --n) {
+    while (p < end && *p != ' ') ++p;
+    while (p < end && *p == ' ') ++p;
+  }
+  uint64_t value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10 + static_cast<uint64_t>(*p++ - '0');
+  }
+  return value;
+}
+
+// utime + stime from <pid>/stat. comm (field 2) may contain spaces and
+// parentheses, so fields are counted after its last ')': state is 0 there,
+// utime 11.
+uint64_t stat_ticks(const char* buf, size_t size) {
+  const char* close = static_cast<const char*>(memrchr(buf, ')', size));
+  if (!close || close + 2 >= buf + size) {
+    return 0;
+  }
+  const char* fields = close + 2;
+  const char* end = buf + size;
+  return nth_number(fields, end, 11) + nth_number(fields, end, 12);
+}
+
+}  // namespace
+
+ProcessScanner::ProcessScanner(const std::string& proc)
+    : tick_ns_(1000000000 / sysconf(_SC_CLK_TCK)),
+      page_kb_(sysconf(_SC_PAGESIZE) / 1024),
+      previous_(INITIAL_SLOTS),
+      current_(INITIAL_SLOTS) {
+  proc_fd_ = open(proc.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (proc_fd_ >= 0) {
+    // Needs CONFIG_SCHED_INFO; nanoseconds and far cheaper than stat
+    has_schedstat_ = faccessat(proc_fd_, "self/schedstat", R_OK, 0) == 0;
+  }
+
+  // Leave at least half the descriptor limit to the rest of the process
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    file_budget_ = limit.rlim_cur == RLIM_INFINITY
+                       ? 65536
+                       : static_cast<size_t>(limit.rlim_cur / 2);
+  }
+}
+
+ProcessScanner::~ProcessScanner() {
+  for (auto* table : {&previous_, &current_}) {
+    for (Slot& slot : *table) {
+      close_slot(slot);
+    }
+  }
+  if (proc_fd_ >= 0) {
+    close(proc_fd_);
+  }
+}
+
+void ProcessScanner::reserve_slots(size_t processes) {
+  // Keep the load factor under 1/2 so probes stay short
+  size_t capacity = current_.size();
+  while (processes * 2 > capacity) {
+    capacity *= 2;
+  }
+  if (capacity == current_.size()) {
+    return;
+  }
+
+  std::vector<Slot> grown(capacity);
+  for (const Slot& slot : previous_) {
+    if (slot.pid != 0) {
+      *insert(grown, slot.pid) = slot;
+    }
+  }
+  previous_ = std::move(grown);
+  current_.assign(capacity, Slot{});
+}
+
+ProcessScanner::Slot* ProcessScanner::find(std::vector<Slot>& table,
+                                           int32_t pid) {
+  size_t mask = table.size() - 1;
+  for (size_t i = hash_pid(pid) & mask;; i = (i + 1) & mask) {
+    if (table[i].pid == pid) {
+      return &table[i];
+    }
+    if (table[i].pid == 0) {
+      return nullptr;
+    }
+  }
+}
+
+ProcessScanner::Slot* ProcessScanner::insert(std::vector<Slot>& table,
+                                             int32_t pid) {
+  size_t mask = table.size() - 1;
+  for (size_t i = hash_pid(pid) & mask;; i = (i + 1) & mask) {
+    if (table[i].pid == 0 || table[i].pid == pid) {
+      table[i].pid = pid;
+      return &table[i];
+    }
+  }
+}
+
+void ProcessScanner::close_slot(Slot& slot) {
+  for (int* fd : {&slot.cpu_fd, &slot.mem_fd}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+      --open_files_;
+    }
+  }
+}
+
+long ProcessScanner::read_file(Slot& slot, int& fd, const char* file,
+                               char* buf, size_t size) {
+  if (fd >= 0) {
+    ssize_t n = pread(fd, buf, size, 0);
+    if (n > 0) {
+      return n;
+    }
+    // ESRCH: that process exited and the PID now names another one
+    close(fd);
+    fd = -1;
+    --open_files_;
+    slot.sampled_ns = 0;
+  }
+
+  char path[32];
+  std::snprintf(path, sizeof(path), "%d/%s", slot.pid, file);
+  int opened = openat(proc_fd_, path, O_RDONLY | O_CLOEXEC);
+  if (opened < 0) {
+    return -1;
+  }
+  ssize_t n = pread(opened, buf, size, 0);
+  if (n > 0 && open_files_ < file_budget_) {
+    fd = opened;
+    ++open_files_;
+  } else {
+    close(opened);
+  }
+  return n;
+}
+
+bool ProcessScanner::sample_cpu(Slot& slot, int64_t now, double& percent) {
+  char buf[FILE_BUFFER];
+  long n = read_file(slot, slot.cpu_fd, has_schedstat_ ? "schedstat" : "stat",
+                     buf, sizeof(buf));
+  if (n <= 0) {
+    return false;
+  }
+  uint64_t runtime = has_schedstat_ ? nth_number(buf, buf + n, 0)
+                                    : stat_ticks(buf, n) * tick_ns_;
+
+  percent = 0;
+  if (slot.sampled_ns > 0 && now > slot.sampled_ns &&
+      runtime >= slot.runtime_ns) {
+    percent = 100.0 * (runtime - slot.runtime_ns) / (now - slot.sampled_ns);
+  }
+  slot.runtime_ns = runtime;
+  slot.sampled_ns = now;
+  return true;
+}
+
+bool ProcessScanner::sample_rss(Slot& slot, uint64_t& rss_kb) {
+  char buf[128];
+  long n = read_file(slot, slot.mem_fd, "statm", buf, sizeof(buf));
+  if (n <= 0) {
+    return false;
+  }
+  rss_kb = nth_number(buf, buf + n, 1) * page_kb_;
+  return true;
+}
+
+void ProcessScanner::read_name(int pid, char (&name)[16]) {
+  char path[32];
+  std::snprintf(path, sizeof(path), "%d/comm", pid);
+  int fd = openat(proc_fd_, path, O_RDONLY | O_CLOEXEC);
+  ssize_t n = fd >= 0 ? read(fd, name, sizeof(name) - 1) : -1;
+  if (fd >= 0) {
+    close(fd);
+  }
+  n = std::max<ssize_t>(n, 0);
+  if (n > 0 && name[n - 1] == '\n') {
+    --n;
+  }
+  name[n] = '\0';
+}
+
+bool ProcessScanner::scan(size_t n, ProcessOrder order) {
+  if (proc_fd_ < 0 || lseek(proc_fd_, 0, SEEK_SET) != 0) {
+    return false;
+  }
+
+  reserve_slots(processes_ + processes_ / 4);
+  size_t limit = current_.size() * 3 / 4;
+  int64_t now = monotonic_ns();
+
+  top_.clear();
+  top_.reserve(n);
+  auto higher = [order](const ProcessUsage& a, const ProcessUsage& b) {
+    return order == ProcessOrder::Cpu ? a.cpu_percent > b.cpu_percent
+                                      : a.rss_kb > b.rss_kb;
+  };
+
+  alignas(8) char dirents[DIRENT_BUFFER];
+  size_t count = 0;
+  while (true) {
+    long size = syscall(SYS_getdents64, proc_fd_, dirents, sizeof(dirents));
+    if (size <= 0) {
+      break;
+    }
+    for (long offset = 0; offset < size;) {
+      auto* entry = reinterpret_cast<LinuxDirent64*>(dirents + offset);
+      offset += entry->d_reclen;
+
+      int32_t pid = parse_pid(entry->d_name);
+      if (pid <= 0) {
+        continue;
+      }
+
+      // Carry the slot (and its open files) over from the previous scan.
+      // Past the load limit, use a slot that is dropped right away.
+      Slot overflow;
+      Slot* slot = count < limit ? insert(current_, pid) : &overflow;
+      if (Slot* before = find(previous_, pid)) {
+        *slot = *before;
+        before->cpu_fd = -1;
+        before->mem_fd = -1;
+      }
+      slot->pid = pid;
+
+      ProcessUsage usage;
+      usage.pid = pid;
+      bool ok = order == ProcessOrder::Cpu
+                    ? sample_cpu(*slot, now, usage.cpu_percent)
+                    : sample_rss(*slot, usage.rss_kb);
+      if (slot == &overflow) {
+        close_slot(overflow);
+      }
+      if (!ok) {
+        continue;  // Exited since the directory was read
+      }
+      ++count;
+
+      // Min-heap of the best n so far
+      if (top_.size() < n) {
+        top_.push_back(usage);
+        std::push_heap(top_.begin(), top_.end(), higher);
+      } else if (n > 0 && higher(usage, top_.front())) {
+        std::pop_heap(top_.begin(), top_.end(), higher);
+        top_.back() = usage;
+        std::push_heap(top_.begin(), top_.end(), higher);
+      }
+    }
+  }
+  std::sort_heap(top_.begin(), top_.end(), higher);
+
+  // Only the winners need a name and the other metric
+  for (ProcessUsage& usage : top_) {
+    read_name(usage.pid, usage.name);
+    Slot overflow;
+    overflow.pid = usage.pid;
+    Slot* slot = find(current_, usage.pid);
+    if (!slot) {
+      slot = &overflow;
+    }
+    if (order == ProcessOrder::Cpu) {
+      sample_rss(*slot, usage.rss_kb);
+    } else {
+      sample_cpu(*slot, now, usage.cpu_percent);
+    }
+    close_slot(overflow);
+  }
+
+  // Whatever is left belonged to processes that exited
+  for (Slot& slot : previous_) {
+    if (slot.pid != 0) {
+      close_slot(slot);
+      slot = Slot{};
+    }
+  }
+  std::swap(previous_, current_);
+  processes_ = count;
+  return true;
+}
+
+}  // namespace reed
@@ -1,6 +1,6 @@
 #include "reed/protocol.hpp"
 
-#include <sstream>
+#include <charconv>
 
 namespace reed {
 
@@ -58,101 +58,217 @@ std::vector<uint8_t> build_frame(const std::string& request_state,
                                  const std::string& cmd_type,
                                  const std::string& content,
                                  const std::string& version, int ack_number) {
-  std::ostringstream body;
-
-  // First line: REQUEST_STATE CMD_TYPE VERSION
-  body << request_state << " " << cmd_type << " " << version << "\r\n";
-
-  // Headers
-  body << "ContentType=json\r\n";
-  body << "ContentLength=" << content.size() << "\r\n";
-  body << "AckNumber=" << ack_number << "\r\n";
+  std::vector<uint8_t> frame;
+  build_frame_into(frame, request_state, cmd_type, content, version,
+                   ack_number);
+  return frame;
+}
 
-  // Double CRLF separator + content
-  body << "\r\n" << content;
+std::optional<Response> parse_response(const std::vector<uint8_t>& data) {
+  std::vector<uint8_t> scratch;
+  auto view = parse_frame(data.data(), data.size(), scratch);
+  if (!view) {
+    return std::nullopt;
+  }
 
-  std::string message_body = body.str();
+  return to_response(*view);
+}
 
-  // Total length = message length + 5 (overhead)
-  uint16_t total_length = static_cast<uint16_t>(message_body.size() + 5);
+Response to_response(const FrameView& view) {
+  Response response;
+  response.raw = std::string(view.message);
+  response.body = std::string(view.body);
+  response.version = std::string(view.version);
+  response.status = std::string(view.status);
+
+  // Try to parse body as JSON
+  if (!response.body.empty()) {
+    picojson::value v;
+    std::string err = picojson::parse(v, response.body);
+    if (err.empty()) {
+      response.json = v;
+    }
+  }
 
-  // Build data: length (2 bytes BE) + message
-  std::vector<uint8_t> data_with_length;
-  data_with_length.push_back(static_cast<uint8_t>((total_length >> 8) & 0xFF));
-  data_with_length.push_back(static_cast<uint8_t>(total_length & 0xFF));
+  return response;
+}
 
-  for (char c : message_body) {
-    data_with_length.push_back(static_cast<uint8_t>(c));
+void build_frame_into(std::vector<uint8_t>& out, std::string_view request_state,
+                      std::string_view cmd_type, std::string_view content,
+                      std::string_view version, int ack_number) {
+  char content_length[24];
+  char ack[24];
+  auto cl_end = std::to_chars(content_length,
+                              content_length + sizeof(content_length),
+                              content.size())
+                    .ptr;
+  auto ack_end = std::to_chars(ack, ack + sizeof(ack), ack_number).ptr;
+
+  // REQUEST_STATE CMD_TYPE VERSION, headers, blank line, content
+  const std::string_view parts[] = {
+      request_state,
+      " ",
+      cmd_type,
+      " ",
+      version,
+      "\r\nContentType=json\r\nContentLength=",
+      std::string_view(content_length, cl_end - content_length),
+      "\r\nAckNumber=",
+      std::string_view(ack, ack_end - ack),
+      "\r\n\r\n",
+      content,
+  };
+
+  size_t message_size = 0;
+  for (auto part : parts) {
+    message_size += part.size();
   }
 
-  // Add CRC
-  uint8_t crc = calculate_crc(data_with_length);
-  data_with_length.push_back(crc);
-
-  // Escape special bytes
-  std::vector<uint8_t> escaped = escape_data(data_with_length);
+  // Total length = message length + 5 (overhead)
+  uint16_t total_length = static_cast<uint16_t>(message_size + 5);
 
-  // Add frame markers
-  std::vector<uint8_t> frame;
-  frame.reserve(escaped.size() + 2);
-  frame.push_back(FRAME_MARKER);
-  frame.insert(frame.end(), escaped.begin(), escaped.end());
-  frame.push_back(FRAME_MARKER);
+  // Length (2 bytes BE) + message + CRC, escaped, between frame markers
+  out.clear();
+  out.push_back(FRAME_MARKER);
+  uint32_t sum = 0;
+  auto put = [&out, &sum](uint8_t b) {
+    sum += b;
+    if (b == 0x5A) {
+      out.push_back(0x5B);
+      out.push_back(0x01);
+    } else if (b == 0x5B) {
+      out.push_back(0x5B);
+      out.push_back(0x02);
+    } else {
+      out.push_back(b);
+    }
+  };
 
-  return frame;
+  put(static_cast<uint8_t>((total_length >> 8) & 0xFF));
+  put(static_cast<uint8_t>(total_length & 0xFF));
+  for (auto part : parts) {
+    for (char c : part) {
+      put(static_cast<uint8_t>(c));
+    }
+  }
+  put(static_cast<uint8_t>(sum & 0xFF));
+  out.push_back(FRAME_MARKER);
 }
 
-std::optional<Response> parse_response(const std::vector<uint8_t>& data) {
-  if (data.size() < 4) {
+std::optional<FrameView> parse_frame(const uint8_t* data, size_t size,
+                                     std::vector<uint8_t>& scratch) {
+  if (size < 4) {
     return std::nullopt;
   }
 
   // Check frame markers
-  if (data.front() != FRAME_MARKER || data.back() != FRAME_MARKER) {
+  if (data[0] != FRAME_MARKER || data[size - 1] != FRAME_MARKER) {
     return std::nullopt;
   }
 
   // Unescape payload (between markers)
-  std::vector<uint8_t> payload(data.begin() + 1, data.end() - 1);
-  payload = unescape_data(payload);
+  scratch.clear();
+  for (size_t i = 1; i + 1 < size; ++i) {
+    if (data[i] == 0x5B && i + 2 < size) {
+      if (data[i + 1] == 0x01) {
+        scratch.push_back(0x5A);
+        ++i;
+        continue;
+      }
+      if (data[i + 1] == 0x02) {
+        scratch.push_back(0x5B);
+        ++i;
+        continue;
+      }
+    }
+    scratch.push_back(data[i]);
+  }
 
-  if (payload.size() < 3) {
+  if (scratch.size() < 3) {
     return std::nullopt;
   }
 
   // Skip length (2 bytes) and CRC (1 byte at end)
-  std::string message(payload.begin() + 2, payload.end() - 1);
-
-  Response response;
-  response.raw = message;
+  FrameView view;
+  view.message = std::string_view(
+      reinterpret_cast<const char*>(scratch.data()) + 2, scratch.size() - 3);
 
   // Split headers and body
-  size_t separator = message.find("\r\n\r\n");
-  if (separator != std::string::npos) {
-    std::string header_part = message.substr(0, separator);
-    response.body = message.substr(separator + 4);
-
-    // Try to parse body as JSON
-    if (!response.body.empty()) {
-      picojson::value v;
-      std::string err = picojson::parse(v, response.body);
-      if (err.empty()) {
-        response.json = v;
-      }
+  size_t separator = view.message.find("\r\n\r\n");
+  if (separator == std::string_view::npos) {
+    return view;
+  }
+  view.body = view.message.substr(separator + 4);
+
+  // Version and status are the first two words of the first line
+  std::string_view first_line = view.message.substr(0, separator);
+  first_line = first_line.substr(0, first_line.find("\r\n"));
+
+  auto next_word = [&first_line]() {
+    size_t begin = first_line.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+      first_line = {};
+      return std::string_view();
     }
+    size_t end = first_line.find_first_of(" \t", begin);
+    std::string_view word = first_line.substr(begin, end - begin);
+    first_line = end == std::string_view::npos ? std::string_view()
+                                               : first_line.substr(end);
+    return word;
+  };
+  view.version = next_word();
+  view.status = next_word();
+
+  return view;
+}
 
-    // Parse first line
-    size_t first_line_end = header_part.find("\r\n");
-    std::string first_line = (first_line_end != std::string::npos)
-                                 ? header_part.substr(0, first_line_end)
-                                 : header_part;
+bool is_valid_json(std::string_view text) {
+  picojson::null_parse_context ctx;
+  picojson::input<const char*> in(text.data(), text.data() + text.size());
+  return picojson::_parse(ctx, in);
+}
 
-    // Extract version and status from first line
-    std::istringstream iss(first_line);
-    iss >> response.version >> response.status;
-  }
+std::optional<int> find_pump_rpm(std::string_view json) {
+  auto is_space = [](char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  };
+  auto has_pump = [](std::string_view key) {
+    for (size_t i = 0; i + 4 <= key.size(); ++i) {
+      if ((key[i] | 0x20) == 'p' && (key[i + 1] | 0x20) == 'u' &&
+          (key[i + 2] | 0x20) == 'm' && (key[i + 3] | 0x20) == 'p') {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  size_t i = 0;
+  while ((i = json.find('"', i)) != std::string_view::npos) {
+    size_t end = i + 1;
+    while (end < json.size() && json[end] != '"') {
+      end += json[end] == '\\' ? 2 : 1;
+    }
+    if (end >= json.size()) {
+      break;
+    }
 
-  return response;
+    // A key is a string followed by ':'
+    size_t p = end + 1;
+    while (p < json.size() && is_space(json[p])) ++p;
+    if (p < json.size() && json[p] == ':' &&
+        has_pump(json.substr(i + 1, end - i - 1))) {
+      ++p;
+      while (p < json.size() && is_space(json[p])) ++p;
+      int value = 0;
+      auto [ptr, ec] =
+          std::from_chars(json.data() + p, json.data() + json.size(), value);
+      if (ec == std::errc() && ptr != json.data() + p) {
+        return value;
+      }
+    }
+    i = end + 1;
+  }
+  return std::nullopt;
 }
 
 }  // namespace reed
@@ -0,0 +1,63 @@
+#include "reed/ring_buffer.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace reed {
+
+RingBuffer::RingBuffer(size_t capacity) {
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  capacity = std::max(page, (capacity + page - 1) / page * page);
+
+  int fd = memfd_create("reed-ring", MFD_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  if (ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+    close(fd);
+    return;
+  }
+
+  // Reserve twice the size, then map the same pages into both halves
+  void* area = mmap(nullptr, capacity * 2, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (area == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+
+  auto* bytes = static_cast<uint8_t*>(area);
+  bool mapped =
+      mmap(bytes, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+           0) != MAP_FAILED &&
+      mmap(bytes + capacity, capacity, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+  close(fd);
+
+  if (!mapped) {
+    munmap(area, capacity * 2);
+    return;
+  }
+
+  base_ = bytes;
+  capacity_ = capacity;
+}
+
+RingBuffer::~RingBuffer() {
+  if (base_) {
+    munmap(base_, capacity_ * 2);
+  }
+}
+
+void RingBuffer::consume(size_t n) {
+  head_ += std::min(n, size());
+}
+
+void RingBuffer::commit(size_t n) {
+  tail_ += std::min(n, free_space());
+  peak_ = std::max(peak_, size());
+}
+
+}  // namespace reed
@@ -0,0 +1,129 @@
+#include "reed/self_profile.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace reed {
+
+namespace {
+
+int open_counter(uint64_t config) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = config;
+  attr.inherit = 1;  // Threads started later count too
+
+  // This process, on any CPU
+  int fd = static_cast<int>(
+      syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+  if (fd < 0 && errno == EACCES) {
+    // perf_event_paranoid 2 only allows user-space counting
+    attr.exclude_kernel = 1;
+    fd = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+  }
+  return fd;
+}
+
+uint64_t read_counter(int fd) {
+  // Not pread: perf event files are not seekable
+  uint64_t value = 0;
+  if (::read(fd, &value, sizeof(value)) != sizeof(value)) {
+    return 0;
+  }
+  return value;
+}
+
+void close_fd(int& fd) {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+// The number after "key:" in /proc/self/status, in kB
+uint64_t status_kb(const char* text, const char* key) {
+  const char* at = std::strstr(text, key);
+  return at ? std::strtoull(at + std::strlen(key), nullptr, 10) : 0;
+}
+
+}  // namespace
+
+SelfProfiler::~SelfProfiler() {
+  close_fd(task_clock_fd_);
+  close_fd(switches_fd_);
+  close_fd(faults_fd_);
+}
+
+void SelfProfiler::open() {
+  task_clock_fd_ = open_counter(PERF_COUNT_SW_TASK_CLOCK);
+  switches_fd_ = open_counter(PERF_COUNT_SW_CONTEXT_SWITCHES);
+  faults_fd_ = open_counter(PERF_COUNT_SW_PAGE_FAULTS);
+  if (task_clock_fd_ < 0 || switches_fd_ < 0 || faults_fd_ < 0) {
+    close_fd(task_clock_fd_);
+    close_fd(switches_fd_);
+    close_fd(faults_fd_);
+  }
+  schedstat_.open("/proc/self/schedstat");
+  status_.open("/proc/self/status");
+}
+
+SelfUsage SelfProfiler::read() const {
+  SelfUsage usage;
+  if (uses_perf()) {
+    usage.cpu_us = static_cast<int64_t>(read_counter(task_clock_fd_) / 1000);
+    usage.context_switches = read_counter(switches_fd_);
+    usage.page_faults = read_counter(faults_fd_);
+  } else {
+    struct rusage self {};
+    getrusage(RUSAGE_SELF, &self);
+    usage.cpu_us =
+        (self.ru_utime.tv_sec + self.ru_stime.tv_sec) * int64_t{1000000} +
+        self.ru_utime.tv_usec + self.ru_stime.tv_usec;
+    usage.context_switches = self.ru_nvcsw + self.ru_nivcsw;
+    usage.page_faults = self.ru_minflt + self.ru_majflt;
+  }
+
+  // "<run ns> <wait ns> <timeslices>"
+  char buf[4096];
+  if (schedstat_.read(buf, sizeof(buf)) > 0) {
+    char* wait = nullptr;
+    std::strtoull(buf, &wait, 10);
+    usage.run_delay_us =
+        static_cast<int64_t>(std::strtoull(wait, nullptr, 10) / 1000);
+  }
+  if (status_.read(buf, sizeof(buf)) > 0) {
+    usage.rss_kb = status_kb(buf, "VmRSS:");
+    usage.rss_peak_kb = status_kb(buf, "VmHWM:");
+  }
+  return usage;
+}
+
+void CpuWindow::add(int64_t cpu_us) {
+  readings_[next_] = cpu_us;
+  next_ = (next_ + 1) % readings_.size();
+  if (count_ < readings_.size()) {
+    ++count_;
+  }
+}
+
+int64_t CpuWindow::per_hour_us() const {
+  if (count_ < 2) {
+    return 0;
+  }
+  size_t newest = (next_ + readings_.size() - 1) % readings_.size();
+  size_t oldest = (next_ + readings_.size() - count_) % readings_.size();
+  int64_t used = readings_[newest] - readings_[oldest];
+  return used * static_cast<int64_t>(MINUTES) /
+         static_cast<int64_t>(count_ - 1);
+}
+
+}  // namespace reed
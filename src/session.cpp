@@ -0,0 +1,360 @@
+#include "reed/session.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+
+#include "reed/config.hpp"
+#include "reed/media.hpp"
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+namespace {
+
+CommandResult ok_result(const std::string& output) {
+  CommandResult result;
+  result.ok = true;
+  result.output = output;
+  return result;
+}
+
+CommandResult error_result(const std::string& output) {
+  CommandResult result;
+  result.output = output;
+  return result;
+}
+
+std::function<CommandResult()> timed(std::function<CommandResult()> job) {
+  return [job = std::move(job)]() {
+    auto start = std::chrono::steady_clock::now();
+    CommandResult result = job();
+    result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    return result;
+  };
+}
+
+}  // namespace
+
+Session::Session(Device& device) : device_(device) {
+  worker_ = std::thread([this]() { worker_loop(); });
+}
+
+Session::~Session() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  worker_.join();
+}
+
+std::vector<std::string> Session::split(const std::string& line) {
+  std::vector<std::string> words;
+  std::string word;
+  bool in_word = false;
+  char quote = 0;
+
+  for (char c : line) {
+    if (quote) {
+      if (c == quote) {
+        quote = 0;
+      } else {
+        word += c;
+      }
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      in_word = true;
+    } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      if (in_word) {
+        words.push_back(word);
+        word.clear();
+        in_word = false;
+      }
+    } else if (c == '#' && !in_word) {
+      break;
+    } else {
+      word += c;
+      in_word = true;
+    }
+  }
+
+  if (in_word) {
+    words.push_back(word);
+  }
+  return words;
+}
+
+std::string Session::help() {
+  return "Commands:\n"
+         "  info                          Show device info\n"
+         "  brightness <0-100>            Set display brightness\n"
+         "  display <file...> [--ratio r] [--brightness n]\n"
+         "                                Set display content\n"
+         "  upload <file>                 Upload media file\n"
+         "  list                          List media files on device\n"
+         "  delete <file...>              Delete media files from device\n"
+         "  sleep <ms>                    Pause\n"
+         "  wait                          Wait for queued uploads\n";
+}
+
+bool Session::submit(const std::vector<std::string>& args) {
+  if (args.empty()) {
+    return true;
+  }
+
+  const std::string& cmd = args[0];
+  std::vector<std::string> rest(args.begin() + 1, args.end());
+
+  if (cmd == "info") {
+    submit_serial([this]() { return cmd_info(); });
+  } else if (cmd == "brightness") {
+    submit_serial([this, rest]() { return cmd_brightness(rest); });
+  } else if (cmd == "display") {
+    submit_serial([this, rest]() {
+      if (last_adb_.valid()) {
+        last_adb_.wait();
+      }
+      return cmd_display(rest);
+    });
+  } else if (cmd == "sleep") {
+    submit_serial([this, rest]() { return cmd_sleep(rest); });
+  } else if (cmd == "wait") {
+    submit_serial([this]() {
+      if (last_adb_.valid()) {
+        last_adb_.wait();
+      }
+      return ok_result("");
+    });
+  } else if (cmd == "upload") {
+    if (rest.empty()) {
+      submit_serial([]() { return error_result("Usage: upload <file>"); });
+    } else {
+      submit_adb([this, file = rest[0]]() { return cmd_upload(file); });
+    }
+  } else if (cmd == "list") {
+    submit_adb([this]() { return cmd_list(); });
+  } else if (cmd == "delete") {
+    submit_adb([this, rest]() { return cmd_delete(rest); });
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<CommandResult> Session::collect(bool wait) {
+  std::vector<CommandResult> results;
+  while (!pending_.empty()) {
+    auto& front = pending_.front();
+    if (!wait &&
+        front.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      break;
+    }
+    results.push_back(front.get());
+    pending_.pop_front();
+  }
+  return results;
+}
+
+CommandResult Session::run(const std::vector<std::string>& args) {
+  // Earlier results would otherwise be mistaken for this one
+  collect(true);
+  if (!submit(args)) {
+    return error_result("Unknown command: " + args[0]);
+  }
+  auto results = collect(true);
+  return results.empty() ? ok_result("") : results.back();
+}
+
+void Session::worker_loop() {
+  while (true) {
+    std::packaged_task<CommandResult()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    task();
+  }
+}
+
+void Session::submit_adb(std::function<CommandResult()> job) {
+  std::packaged_task<CommandResult()> task(timed(std::move(job)));
+  last_adb_ = task.get_future().share();
+  pending_.push_back(last_adb_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+void Session::submit_serial(std::function<CommandResult()> job) {
+  CommandResult result = timed(std::move(job))();
+  result.serial = true;
+
+  std::promise<CommandResult> promise;
+  promise.set_value(std::move(result));
+  pending_.push_back(promise.get_future().share());
+}
+
+CommandResult Session::cmd_info() {
+  auto info = device_.handshake();
+  if (!info) {
+    return error_result("Failed to get device info");
+  }
+
+  std::ostringstream out;
+  out << "Product: " << info->product_id << "\n"
+      << "OS: " << info->os << "\n"
+      << "Serial: " << info->serial << "\n"
+      << "App Version: " << info->app_version << "\n"
+      << "Firmware: " << info->firmware << "\n"
+      << "Hardware: " << info->hardware;
+  return ok_result(out.str());
+}
+
+CommandResult Session::cmd_brightness(const std::vector<std::string>& args) {
+  if (args.empty()) {
+    return error_result("Usage: brightness <0-100>");
+  }
+
+  int value = std::atoi(args[0].c_str());
+  if (value < 0 || value > 100) {
+    return error_result("Brightness must be 0-100");
+  }
+
+  if (!device_.set_brightness(value)) {
+    return error_result("No response to brightness " + args[0]);
+  }
+  return ok_result("Brightness set to " + std::to_string(value));
+}
+
+CommandResult Session::cmd_display(const std::vector<std::string>& args) {
+  auto saved = ConfigManager::load_state();
+  DisplayState state = saved ? *saved : DisplayState{};
+  bool set_brightness = false;
+  state.media.clear();
+
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i] == "--ratio" && i + 1 < args.size()) {
+      state.ratio = args[++i];
+    } else if (args[i] == "--brightness" && i + 1 < args.size()) {
+      state.brightness = std::atoi(args[++i].c_str());
+      set_brightness = true;
+    } else if (Media::is_converted(args[i])) {
+      state.media.push_back(Media::get_converted_name(args[i]));
+    } else {
+      state.media.push_back(Media::get_filename(args[i]));
+    }
+  }
+
+  if (state.media.empty()) {
+    return error_result("Usage: display <file...>");
+  }
+  if (state.brightness < 0 || state.brightness > 100) {
+    return error_result("Brightness must be 0-100");
+  }
+
+  ScreenConfig config;
+  config.media = state.media;
+  config.ratio = state.ratio;
+  config.screen_mode = state.screen_mode;
+  config.play_mode = state.play_mode;
+
+  if (!device_.set_screen_config(config)) {
+    return error_result("No response to screen config");
+  }
+  if (set_brightness && !device_.set_brightness(state.brightness)) {
+    return error_result("No response to brightness");
+  }
+
+  ConfigManager::save_state(state);
+
+  std::string shown;
+  for (const auto& m : state.media) {
+    shown += (shown.empty() ? "" : ", ") + m;
+  }
+  return ok_result("Display set to: " + shown);
+}
+
+CommandResult Session::cmd_sleep(const std::vector<std::string>& args) {
+  int ms = args.empty() ? 0 : std::atoi(args[0].c_str());
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  return ok_result("");
+}
+
+CommandResult Session::cmd_upload(const std::string& file) {
+  std::error_code ec;
+  if (!fs::is_regular_file(file, ec)) {
+    return error_result("File not found: " + file);
+  }
+
+  if (Media::is_converted(file) && !Media::is_ffmpeg_available()) {
+    return error_result("ffmpeg not found. Install ffmpeg to upload " +
+                        Media::get_extension(file).substr(1) + " files.");
+  }
+
+  // Images are sized for the ratio currently on screen
+  auto state = ConfigManager::load_state();
+  auto remote = Media::upload(file, state ? state->ratio : "2:1");
+  if (!remote) {
+    return error_result("Failed to upload " + file);
+  }
+  return ok_result("Uploaded " + *remote);
+}
+
+CommandResult Session::cmd_list() {
+  AdbShell* shell = adb_shell();
+  auto files = shell ? shell->list_media() : Adb::list_media();
+  if (!files) {
+    return error_result("Failed to list media files");
+  }
+
+  if (files->empty()) {
+    return ok_result("No media files on device.");
+  }
+
+  std::string out = "Media files on device:";
+  for (const auto& f : *files) {
+    out += "\n  " + f;
+  }
+  return ok_result(out);
+}
+
+CommandResult Session::cmd_delete(const std::vector<std::string>& files) {
+  if (files.empty()) {
+    return error_result("Usage: delete <file...>");
+  }
+
+  AdbShell* shell = adb_shell();
+  CommandResult result = ok_result("");
+  for (const auto& f : files) {
+    bool removed = shell ? shell->remove(f) : Adb::remove(f);
+    if (!result.output.empty()) {
+      result.output += "\n";
+    }
+    result.output += (removed ? "Deleted: " : "Failed to delete: ") + f;
+    result.ok = result.ok && removed;
+  }
+  return result;
+}
+
+AdbShell* Session::adb_shell() {
+  // Started lazily on the worker thread; fall back to one-shot adb
+  // invocations if no persistent shell can be had
+  if (!shell_.is_running() && !shell_tried_) {
+    shell_tried_ = true;
+    shell_.start();
+  }
+  return shell_.is_running() ? &shell_ : nullptr;
+}
+
+}  // namespace reed
@@ -0,0 +1,160 @@
+#include "reed/status.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace reed {
+
+void RttWindow::add(uint32_t rtt_us) {
+  samples_[next_] = rtt_us;
+  next_ = (next_ + 1) % CAPACITY;
+  if (count_ < CAPACITY) {
+    ++count_;
+  }
+}
+
+uint32_t RttWindow::percentile(int p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  std::array<uint32_t, CAPACITY> sorted;
+  std::copy(samples_.begin(), samples_.begin() + count_, sorted.begin());
+
+  size_t rank = (static_cast<size_t>(std::clamp(p, 0, 100)) * (count_ - 1) +
+                 50) / 100;
+  std::nth_element(sorted.begin(), sorted.begin() + rank,
+                   sorted.begin() + count_);
+  return sorted[rank];
+}
+
+StatusPage::~StatusPage() {
+  close();
+}
+
+bool StatusPage::create(const std::string& path) {
+  close();
+
+  std::error_code ec;
+  fs::path dir = fs::path(path).parent_path();
+  if (!dir.empty()) {
+    fs::create_directories(dir, ec);
+    fs::permissions(dir, fs::perms::owner_all, ec);
+  }
+
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  if (ftruncate(fd_, sizeof(StatusPageLayout)) != 0) {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  void* mem = mmap(nullptr, sizeof(StatusPageLayout), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd_, 0);
+  if (mem == MAP_FAILED) {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  page_ = static_cast<StatusPageLayout*>(mem);
+  path_ = path;
+
+  // Leave seq odd while the header is (re)initialised so a reader racing a
+  // restarting daemon never accepts a half-written page
+  page_->seq.store(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  page_->magic = STATUS_MAGIC;
+  page_->version = STATUS_VERSION;
+  page_->size = sizeof(StatusPageLayout);
+  page_->status = DaemonStatus{};
+  page_->seq.store(2, std::memory_order_release);
+
+  return true;
+}
+
+void StatusPage::publish(const DaemonStatus& status) {
+  if (!page_) {
+    return;
+  }
+
+  uint32_t seq = page_->seq.load(std::memory_order_relaxed);
+  page_->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(&page_->status, &status, sizeof(DaemonStatus));
+  page_->seq.store(seq + 2, std::memory_order_release);
+}
+
+void StatusPage::close() {
+  if (page_) {
+    munmap(page_, sizeof(StatusPageLayout));
+    page_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+    unlink(path_.c_str());
+  }
+  path_.clear();
+}
+
+std::optional<DaemonStatus> StatusPage::read(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(StatusPageLayout))) {
+    ::close(fd);
+    return std::nullopt;
+  }
+
+  void* mem =
+      mmap(nullptr, sizeof(StatusPageLayout), PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    return std::nullopt;
+  }
+
+  const auto* page = static_cast<const StatusPageLayout*>(mem);
+  std::optional<DaemonStatus> result;
+
+  if (page->magic == STATUS_MAGIC && page->version == STATUS_VERSION &&
+      page->size == sizeof(StatusPageLayout)) {
+    // Bounded retries: a writer publishes at most a few times per second
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+      uint32_t before = page->seq.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;
+      }
+
+      DaemonStatus copy;
+      std::memcpy(&copy, &page->status, sizeof(DaemonStatus));
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if (page->seq.load(std::memory_order_relaxed) == before) {
+        result = copy;
+        break;
+      }
+    }
+  }
+
+  munmap(mem, sizeof(StatusPageLayout));
+  return result;
+}
+
+}  // namespace reed
@@ -0,0 +1,85 @@
+#include "reed/sysfs.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+
+namespace reed {
+
+SysfsFile::~SysfsFile() {
+  close();
+}
+
+SysfsFile::SysfsFile(SysfsFile&& other) noexcept : fd_(other.fd_) {
+  other.fd_ = -1;
+}
+
+SysfsFile& SysfsFile::operator=(SysfsFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    fd_ = other.fd_;
+    other.fd_ = -1;
+  }
+  return *this;
+}
+
+bool SysfsFile::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  return fd_ >= 0;
+}
+
+void SysfsFile::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+long SysfsFile::read(char* buf, size_t size) const {
+  if (fd_ < 0 || size == 0) {
+    errno = fd_ < 0 ? EBADF : EINVAL;
+    return -1;
+  }
+  ssize_t n = pread(fd_, buf, size - 1, 0);
+  if (n < 0) {
+    return -1;
+  }
+  buf[n] = '\0';
+  return n;
+}
+
+std::optional<int64_t> SysfsFile::read_int(int* error) const {
+  char buf[32];
+  long n = read(buf, sizeof(buf));
+  if (error) {
+    *error = n < 0 ? errno : 0;
+  }
+  if (n <= 0) {
+    return std::nullopt;
+  }
+  char* end;
+  long long value = std::strtoll(buf, &end, 10);
+  if (end == buf) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<std::string> SysfsFile::read_string(const std::string& path) {
+  SysfsFile file(path);
+  char buf[256];
+  long n = file.read(buf, sizeof(buf));
+  if (n < 0) {
+    return std::nullopt;
+  }
+  std::string value(buf, n);
+  while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {
+    value.pop_back();
+  }
+  return value;
+}
+
+}  // namespace reed
@@ -0,0 +1,34 @@
+#include "reed/time_of_day.hpp"
+
+#include <ctime>
+
+namespace reed {
+
+using Clock = std::chrono::system_clock;
+
+int minute_of_day(Clock::time_point t) {
+  std::time_t tt = Clock::to_time_t(t);
+  std::tm tm{};
+  localtime_r(&tt, &tm);
+  return tm.tm_hour * 60 + tm.tm_min;
+}
+
+Clock::time_point next_occurrence(int minute, Clock::time_point after) {
+  std::time_t tt = Clock::to_time_t(after);
+  std::tm tm{};
+  localtime_r(&tt, &tm);
+  tm.tm_hour = minute / 60;
+  tm.tm_min = minute % 60;
+  tm.tm_sec = 0;
+  tm.tm_isdst = -1;
+
+  auto t = Clock::from_time_t(std::mktime(&tm));
+  if (t <= after) {
+    tm.tm_mday += 1;
+    tm.tm_isdst = -1;
+    t = Clock::from_time_t(std::mktime(&tm));
+  }
+  return t;
+}
+
+}  // namespace reed
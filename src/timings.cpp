@@ -0,0 +1,218 @@
+#include "reed/timings.hpp"
+
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "reed/picojson.h"
+
+namespace reed {
+
+namespace {
+
+struct Phase {
+  std::string name;
+  long parent;
+  int thread;
+  int64_t start_us;
+  int64_t end_us = -1;  // -1 while open
+  int64_t cpu_start_us;
+  int64_t cpu_end_us = 0;
+};
+
+std::atomic<bool> g_enabled{false};
+std::mutex g_mutex;
+std::vector<Phase> g_phases;
+size_t g_dropped = 0;
+std::chrono::steady_clock::time_point g_epoch;
+std::atomic<int> g_threads{0};
+
+thread_local long t_current = -1;
+thread_local int t_thread = -1;
+
+int64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - g_epoch)
+      .count();
+}
+
+int64_t to_us(const timeval& tv) {
+  return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// This thread's CPU time plus that of every child reaped so far
+int64_t cpu_us() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  struct rusage children {};
+  getrusage(RUSAGE_CHILDREN, &children);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000 +
+         to_us(children.ru_utime) + to_us(children.ru_stime);
+}
+
+// Phases merged by name under the same parent
+struct Node {
+  std::string name;
+  size_t count = 0;
+  int64_t wall_us = 0;
+  int64_t cpu_us = 0;
+  std::vector<size_t> children;
+};
+
+void print_node(std::ostream& out, const std::vector<Node>& nodes,
+                size_t index, int depth) {
+  const Node& node = nodes[index];
+  std::string label = std::string(depth * 2, ' ') + node.name;
+  if (node.count > 1) {
+    label += " x" + std::to_string(node.count);
+  }
+  char line[160];
+  std::snprintf(line, sizeof(line), "  %-40s %10.1f %9.1f\n", label.c_str(),
+                node.wall_us / 1000.0, node.cpu_us / 1000.0);
+  out << line;
+  for (size_t child : node.children) {
+    print_node(out, nodes, child, depth + 1);
+  }
+}
+
+}  // namespace
+
+void Timings::enable() {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_enabled) {
+    g_epoch = std::chrono::steady_clock::now();
+    g_enabled = true;
+  }
+}
+
+bool Timings::enabled() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+void Timings::print(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  // Node 0 is the root; phases are in start order, so a parent always
+  // has its node before its children look for it
+  std::vector<Node> nodes(1);
+  std::vector<size_t> node_of(g_phases.size(), 0);
+  for (size_t i = 0; i < g_phases.size(); ++i) {
+    const Phase& phase = g_phases[i];
+    if (phase.end_us < 0) {
+      continue;
+    }
+    size_t parent = phase.parent >= 0 ? node_of[phase.parent] : 0;
+    size_t node = 0;
+    for (size_t child : nodes[parent].children) {
+      if (nodes[child].name == phase.name) {
+        node = child;
+        break;
+      }
+    }
+    if (node == 0) {
+      node = nodes.size();
+      nodes.emplace_back();
+      nodes.back().name = phase.name;
+      nodes[parent].children.push_back(node);
+    }
+    ++nodes[node].count;
+    nodes[node].wall_us += phase.end_us - phase.start_us;
+    nodes[node].cpu_us += phase.cpu_end_us - phase.cpu_start_us;
+    node_of[i] = node;
+  }
+
+  char header[160];
+  std::snprintf(header, sizeof(header), "Timings %36s %10s %9s\n", "",
+                "wall ms", "cpu ms");
+  out << header;
+  for (size_t child : nodes[0].children) {
+    print_node(out, nodes, child, 0);
+  }
+  if (g_dropped > 0) {
+    out << "  (" << g_dropped << " phases not recorded)\n";
+  }
+}
+
+bool Timings::write_trace(const std::string& path) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  picojson::array events;
+  double pid = static_cast<double>(getpid());
+  for (const Phase& phase : g_phases) {
+    if (phase.end_us < 0) {
+      continue;
+    }
+    picojson::object args;
+    args["cpu_ms"] =
+        picojson::value((phase.cpu_end_us - phase.cpu_start_us) / 1000.0);
+    picojson::object event;
+    event["name"] = picojson::value(phase.name);
+    event["ph"] = picojson::value("X");
+    event["ts"] = picojson::value(static_cast<double>(phase.start_us));
+    event["dur"] =
+        picojson::value(static_cast<double>(phase.end_us - phase.start_us));
+    event["pid"] = picojson::value(pid);
+    event["tid"] = picojson::value(static_cast<double>(phase.thread));
+    event["args"] = picojson::value(args);
+    events.push_back(picojson::value(event));
+  }
+  picojson::object trace;
+  trace["traceEvents"] = picojson::value(events);
+  trace["displayTimeUnit"] = picojson::value("ms");
+
+  std::ofstream file(path);
+  file << picojson::value(trace).serialize() << "\n";
+  return static_cast<bool>(file);
+}
+
+ScopedTimer::ScopedTimer(std::string_view name, std::string_view detail) {
+  if (!Timings::enabled()) {
+    return;
+  }
+  if (t_thread < 0) {
+    t_thread = ++g_threads;
+  }
+
+  Phase phase;
+  phase.name = name;
+  if (!detail.empty()) {
+    phase.name += ' ';
+    phase.name += detail;
+  }
+  phase.parent = t_current;
+  phase.thread = t_thread;
+  phase.cpu_start_us = cpu_us();
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (g_phases.size() >= Timings::MAX_PHASES) {
+    ++g_dropped;
+    return;
+  }
+  phase.start_us = now_us();
+  g_phases.push_back(std::move(phase));
+  index_ = static_cast<long>(g_phases.size()) - 1;
+  parent_ = t_current;
+  t_current = index_;
+}
+
+ScopedTimer::~ScopedTimer() {
+  if (index_ < 0) {
+    return;
+  }
+  int64_t cpu = cpu_us();
+  std::lock_guard<std::mutex> lock(g_mutex);
+  Phase& phase = g_phases[index_];
+  phase.end_us = now_us();
+  phase.cpu_end_us = cpu;
+  t_current = parent_;
+}
+
+}  // namespace reed
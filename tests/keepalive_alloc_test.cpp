@@ -0,0 +1,226 @@
+// The daemon sends a keepalive every few seconds for as long as it runs,
+// so that path must not touch the heap. This replaces global operator new,
+// runs a real Daemon against a pty standing in for the device, and checks
+// that the daemon thread allocates nothing across timer-dispatched
+// keepalives (event loop dispatch, the exchange and publish_status) once
+// its buffers are warm.
+
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "reed/config.hpp"
+#include "reed/daemon.hpp"
+#include "reed/protocol.hpp"
+#include "reed/status.hpp"
+
+namespace {
+
+// Only the daemon thread counts, and only while g_counting is set
+thread_local bool t_daemon = false;
+std::atomic<bool> g_counting{false};
+std::atomic<long> g_allocations{0};
+
+constexpr int WARM_UP = 2;
+constexpr int ITERATIONS = 8;  // One per second, the shortest interval
+
+// A device reply: marker, escaped (length, message, CRC), marker
+std::vector<uint8_t> reply_frame(const std::string& body) {
+  std::string message = "1 200\r\nContentType=json\r\nContentLength=" +
+                        std::to_string(body.size()) + "\r\n\r\n" + body;
+  size_t length = message.size() + 5;
+  std::vector<uint8_t> data{static_cast<uint8_t>(length >> 8),
+                            static_cast<uint8_t>(length & 0xFF)};
+  data.insert(data.end(), message.begin(), message.end());
+  data.push_back(reed::calculate_crc(data));
+
+  std::vector<uint8_t> frame{reed::FRAME_MARKER};
+  auto escaped = reed::escape_data(data);
+  frame.insert(frame.end(), escaped.begin(), escaped.end());
+  frame.push_back(reed::FRAME_MARKER);
+  return frame;
+}
+
+// Answers every complete frame written to master with reply
+void serve(int master, const std::vector<uint8_t>& reply,
+           const std::atomic<bool>& stop) {
+  uint8_t buf[4096];
+  int markers = 0;
+  while (!stop) {
+    pollfd pfd{master, POLLIN, 0};
+    if (poll(&pfd, 1, 50) <= 0) {
+      continue;
+    }
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n <= 0) {
+      continue;
+    }
+    for (ssize_t i = 0; i < n; ++i) {
+      if (buf[i] == reed::FRAME_MARKER && ++markers == 2) {
+        markers = 0;
+        ssize_t ignored = write(master, reply.data(), reply.size());
+        (void)ignored;
+      }
+    }
+  }
+}
+
+// Keepalives the daemon has sent, answered or not; -1 before its status
+// page exists
+long keepalives(const std::string& status_path) {
+  auto status = reed::StatusPage::read(status_path);
+  if (!status) {
+    return -1;
+  }
+  return static_cast<long>(status->keepalives_ok +
+                           status->keepalive_failures);
+}
+
+// Waits until the daemon has sent count keepalives or has stopped
+bool wait_for(const std::string& status_path, long count,
+              const std::atomic<bool>& running) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(count + 15);
+  while (running && std::chrono::steady_clock::now() < deadline) {
+    if (keepalives(status_path) >= count) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return false;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (t_daemon && g_counting) {
+    ++g_allocations;
+  }
+  void* p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+int main() {
+  // The daemon takes SIGTERM through a signalfd; block it in every thread
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+  char root[] = "/tmp/reed-alloc-test-XXXXXX";
+  if (!mkdtemp(root)) {
+    std::perror("mkdtemp");
+    return 1;
+  }
+  std::string dir = root;
+  setenv("XDG_CONFIG_HOME", (dir + "/config").c_str(), 1);
+  setenv("XDG_STATE_HOME", (dir + "/state").c_str(), 1);
+  setenv("XDG_RUNTIME_DIR", (dir + "/run").c_str(), 1);
+
+  // Keepalives only: no sampling, fade or playlist on the daemon thread
+  reed::Config config;
+  config.keepalive_interval = 1;
+  config.sample_interval_ms = 0;
+  config.fade_in_ms = 0;
+  reed::DisplayState state;
+  state.media = {"test.mp4"};
+  if (!reed::ConfigManager::save_config(config) ||
+      !reed::ConfigManager::save_state(state)) {
+    std::fprintf(stderr, "could not write config under %s\n", root);
+    return 1;
+  }
+
+  int master = -1;
+  int slave = -1;
+  char name[64];
+  if (openpty(&master, &slave, name, nullptr, nullptr) != 0) {
+    std::perror("openpty");
+    return 1;
+  }
+  termios raw{};
+  tcgetattr(slave, &raw);
+  cfmakeraw(&raw);
+  tcsetattr(slave, TCSANOW, &raw);
+
+  auto reply = reply_frame(
+      "{\"productId\":\"TPSE\",\"OS\":\"android\",\"sn\":\"123\","
+      "\"version\":{\"app\":\"1\",\"firmware\":\"2\",\"hardware\":\"3\"},"
+      "\"pumpSpeed\":2150}");
+  std::atomic<bool> stop{false};
+  std::thread device_thread(serve, master, std::cref(reply), std::cref(stop));
+
+  std::atomic<bool> running{true};
+  int exit_code = -1;
+  std::thread daemon_thread([&]() {
+    t_daemon = true;
+    reed::Daemon daemon(name);
+    exit_code = daemon.run();
+    running = false;
+  });
+
+  std::string status_path = reed::ConfigManager::get_status_path();
+  int failures = 0;
+  long sent = 0;
+  if (!wait_for(status_path, WARM_UP, running)) {
+    std::fprintf(stderr, "daemon did not start keepalives\n");
+    failures = 1;
+  } else {
+    long first = keepalives(status_path);
+    g_counting = true;
+    bool done = wait_for(status_path, first + ITERATIONS, running);
+    g_counting = false;
+    sent = keepalives(status_path) - first;
+
+    auto status = reed::StatusPage::read(status_path);
+    long allocations = g_allocations.load();
+    std::printf("%ld keepalives, %llu answered in all, %ld allocations\n",
+                sent,
+                static_cast<unsigned long long>(status ? status->keepalives_ok
+                                                       : 0),
+                allocations);
+    if (!done || !status || status->keepalive_failures != 0 ||
+        allocations != 0) {
+      failures = 1;
+    }
+  }
+
+  kill(getpid(), SIGTERM);
+  daemon_thread.join();
+  stop = true;
+  device_thread.join();
+  if (exit_code != 0) {
+    std::fprintf(stderr, "daemon exited with %d\n", exit_code);
+    failures = 1;
+  }
+
+  close(slave);
+  close(master);
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  return failures;
+}